@@ -7,11 +7,17 @@
     CONDITIONS OF ANY KIND, either express or implied.
 */
 
+#include "captdns.h"
+#include "dns_parser.h"
+
+#include <string.h>
 #include <sys/param.h>
 
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_wifi.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -19,143 +25,62 @@
 #include "lwip/netdb.h"
 
 #define DNS_PORT (53)
-#define DNS_MAX_LEN (256)
-
-#define OPCODE_MASK (0x7800)
-#define QR_FLAG (1 << 7)
-#define QD_TYPE_A (0x0001)
+// Largest query without EDNS, replies are built in the same buffer
+#define DNS_MAX_LEN (512)
 #define ANS_TTL_SEC (300)
 
 static const char *TAG = "dns_captive_portal";
 
-// DNS Header Packet
-typedef struct __attribute__((__packed__))
-{
-    uint16_t id;
-    uint16_t flags;
-    uint16_t qd_count;
-    uint16_t an_count;
-    uint16_t ns_count;
-    uint16_t ar_count;
-} dns_header_t;
-
-// DNS Question Packet
-typedef struct {
-    uint16_t type;
-    uint16_t class;
-} dns_question_t;
-
-// DNS Answer Packet
-typedef struct __attribute__((__packed__))
-{
-    uint16_t ptr_offset;
-    uint16_t type;
-    uint16_t class;
-    uint32_t ttl;
-    uint16_t addr_len;
-    uint32_t ip_addr;
-} dns_answer_t;
-
-/*
-    Parse the name from the packet from the DNS name format to a regular .-seperated name
-    returns the pointer to the next part of the packet
-*/
-static char *parse_dns_name(char *raw_name, char *parsed_name, size_t parsed_name_max_len)
-{
-
-    char *label = raw_name;
-    char *name_itr = parsed_name;
-    int name_len = 0;
-
-    do {
-        int sub_name_len = *label;
-        // (len + 1) since we are adding  a '.'
-        name_len += (sub_name_len + 1);
-        if (name_len > parsed_name_max_len) {
-            return NULL;
-        }
+// softAP address in network order, cached from IP events
+static volatile uint32_t ap_address = 0;
 
-        // Copy the sub name that follows the the label
-        memcpy(name_itr, label + 1, sub_name_len);
-        name_itr[sub_name_len] = '.';
-        name_itr += (sub_name_len + 1);
-        label += sub_name_len + 1;
-    } while (*label != 0);
-
-    // Terminate the final string, replacing the last '.'
-    parsed_name[name_len - 1] = '\0';
-    // Return pointer to first char after the name
-    return label + 1;
-}
+static captive_dns_stats_t stats;
 
-// Parses the DNS request and prepares a DNS response with the IP of the softAP
-static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len)
+static void update_ap_address(void)
 {
-    if (req_len > dns_reply_max_len) {
-        return -1;
-    }
-
-    // Prepare the reply
-    memset(dns_reply, 0, dns_reply_max_len);
-    memcpy(dns_reply, req, req_len);
-
-    // Endianess of NW packet different from chip
-    dns_header_t *header = (dns_header_t *)dns_reply;
-    ESP_LOGD(TAG, "DNS query with header id: 0x%X, flags: 0x%X, qd_count: %d",
-             ntohs(header->id), ntohs(header->flags), ntohs(header->qd_count));
-
-    // Not a standard query
-    if ((header->flags & OPCODE_MASK) != 0) {
-        return 0;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    if (netif && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK && ip_info.ip.addr != ap_address) {
+        ap_address = ip_info.ip.addr;
+        ESP_LOGI(TAG, "Answering with " IPSTR, IP2STR(&ip_info.ip));
     }
+}
 
-    // Set question response flag
-    header->flags |= QR_FLAG;
-
-    uint16_t qd_count = ntohs(header->qd_count);
-    header->an_count = htons(qd_count);
-
-    int reply_len = qd_count * sizeof(dns_answer_t) + req_len;
-    if (reply_len > dns_reply_max_len) {
-        return -1;
-    }
+static void ip_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    update_ap_address();
+}
 
-    // Pointer to current answer and question
-    char *cur_ans_ptr = dns_reply + req_len;
-    char *cur_qd_ptr = dns_reply + sizeof(dns_header_t);
-    char name[128];
-
-    // Respond to all questions with the ESP32's IP address
-    for (int i = 0; i < qd_count; i++) {
-        char *name_end_ptr = parse_dns_name(cur_qd_ptr, name, sizeof(name));
-        if (name_end_ptr == NULL) {
-            ESP_LOGE(TAG, "Failed to parse DNS question: %s", cur_qd_ptr);
-            return -1;
+/*
+    Turn the DNS query in packet into its reply, in place: A questions get the
+    softAP address, other types an empty answer so that clients don't retry.
+    Returns the reply length, or -1 if the packet must be dropped
+*/
+static int answer_dns_query(uint8_t *packet, size_t len, size_t max_len)
+{
+    dns_question_t question;
+    dns_query_status_t status = dns_parse_query(packet, len, &question);
+
+    if (status == DNS_QUERY_OK) {
+        if (question.type == DNS_TYPE_A && question.class == DNS_CLASS_IN) {
+            stats.a++;
+        } else if (question.type == DNS_TYPE_AAAA) {
+            stats.aaaa++;
+        } else if (question.type == DNS_TYPE_HTTPS || question.type == DNS_TYPE_SVCB) {
+            stats.https++;
+        } else {
+            stats.other++;
         }
 
-        dns_question_t *question = (dns_question_t *)(name_end_ptr);
-        uint16_t qd_type = ntohs(question->type);
-        uint16_t qd_class = ntohs(question->class);
-
-        ESP_LOGD(TAG, "Received type: %d | Class: %d | Question for: %s", qd_type, qd_class, name);
-
-        if (qd_type == QD_TYPE_A) {
-            dns_answer_t *answer = (dns_answer_t *)cur_ans_ptr;
-
-            answer->ptr_offset = htons(0xC000 | (cur_qd_ptr - dns_reply));
-            answer->type = htons(qd_type);
-            answer->class = htons(qd_class);
-            answer->ttl = htonl(ANS_TTL_SEC);
-
-            esp_netif_ip_info_t ip_info;
-            esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey("WIFI_AP_DEF"), &ip_info);
-            ESP_LOGD(TAG, "Answer with PTR offset: 0x%X and IP 0x%X", ntohs(answer->ptr_offset), ip_info.ip.addr);
-
-            answer->addr_len = htons(sizeof(ip_info.ip.addr));
-            answer->ip_addr = ip_info.ip.addr;
+#if LOG_LOCAL_LEVEL >= ESP_LOG_VERBOSE
+        char name[DNS_NAME_MAX_LEN + 1];
+        if (dns_parse_name(packet, len, question.name_offset, name, sizeof(name)) > 0) {
+            ESP_LOGV(TAG, "Query %s, type %d", name, question.type);
         }
+#endif
     }
-    return reply_len;
+
+    return dns_build_reply(packet, max_len, status, &question, ap_address, ANS_TTL_SEC);
 }
 
 /*
@@ -164,10 +89,8 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
 */
 void dns_server_task(void *pvParameters)
 {
-    char rx_buffer[128];
-    char addr_str[128];
-    int addr_family;
-    int ip_protocol;
+    // Room for the answer after the largest query
+    uint8_t packet[DNS_MAX_LEN + DNS_ANSWER_LEN];
 
     while (1) {
 
@@ -175,16 +98,12 @@ void dns_server_task(void *pvParameters)
         dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
         dest_addr.sin_family = AF_INET;
         dest_addr.sin_port = htons(DNS_PORT);
-        addr_family = AF_INET;
-        ip_protocol = IPPROTO_IP;
-        inet_ntoa_r(dest_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
 
-        int sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
+        int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
         if (sock < 0) {
             ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
             break;
         }
-        ESP_LOGI(TAG, "Socket created");
 
         int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
         if (err < 0) {
@@ -193,10 +112,10 @@ void dns_server_task(void *pvParameters)
         ESP_LOGI(TAG, "Socket bound, port %d", DNS_PORT);
 
         while (1) {
-            ESP_LOGI(TAG, "Waiting for data");
             struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
             socklen_t socklen = sizeof(source_addr);
-            int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
+            // Blocks until a query arrives
+            int len = recvfrom(sock, packet, DNS_MAX_LEN, 0, (struct sockaddr *)&source_addr, &socklen);
 
             // Error occurred during receiving
             if (len < 0) {
@@ -204,31 +123,18 @@ void dns_server_task(void *pvParameters)
                 close(sock);
                 break;
             }
-            // Data received
-            else {
-                // Get the sender's ip address as string
-                if (source_addr.sin6_family == PF_INET) {
-                    inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                } else if (source_addr.sin6_family == PF_INET6) {
-                    inet6_ntoa_r(source_addr.sin6_addr, addr_str, sizeof(addr_str) - 1);
-                }
-
-                // Null-terminate whatever we received and treat like a string...
-                rx_buffer[len] = 0;
-
-                char reply[DNS_MAX_LEN];
-                int reply_len = parse_dns_request(rx_buffer, len, reply, DNS_MAX_LEN);
-
-                ESP_LOGI(TAG, "Received %d bytes from %s | DNS reply with len: %d", len, addr_str, reply_len);
-                if (reply_len <= 0) {
-                    ESP_LOGE(TAG, "Failed to prepare a DNS reply");
-                } else {
-                    int err = sendto(sock, reply, reply_len, 0, (struct sockaddr *)&source_addr, sizeof(source_addr));
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                        break;
-                    }
-                }
+
+            int reply_len = answer_dns_query(packet, len, sizeof(packet));
+            if (reply_len <= 0) {
+                stats.malformed++;
+                ESP_LOGD(TAG, "Dropped malformed query of %d bytes", len);
+                continue;
+            }
+
+            err = sendto(sock, packet, reply_len, 0, (struct sockaddr *)&source_addr, socklen);
+            if (err < 0) {
+                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                break;
             }
         }
 
@@ -241,7 +147,17 @@ void dns_server_task(void *pvParameters)
     vTaskDelete(NULL);
 }
 
+void captive_dns_get_stats(captive_dns_stats_t *result)
+{
+    *result = stats;
+}
+
 void setup_captive_dns(void)
 {
+    // The softAP address is known once the access point starts
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_START, &ip_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, &ip_event_handler, NULL));
+    update_ap_address();
+
     xTaskCreate(dns_server_task, "dns_server", 4096, NULL, 5, NULL);
 }
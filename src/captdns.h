@@ -1,6 +1,20 @@
 #ifndef CAPTDNS_H
 #define CAPTDNS_H
 
+#include <stdint.h>
+
+// Queries answered since boot, per question type
+typedef struct {
+    uint32_t a;
+    uint32_t aaaa;
+    uint32_t https;
+    uint32_t other;
+    // Dropped without answer
+    uint32_t malformed;
+} captive_dns_stats_t;
+
 void setup_captive_dns(void);
 
-#endif
\ No newline at end of file
+void captive_dns_get_stats(captive_dns_stats_t *stats);
+
+#endif
@@ -0,0 +1,159 @@
+#include "captive_probe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "cJSON.h"
+#include "websocket.h"
+#include "captdns.h"
+
+static const char *TAG = "captive_probe";
+
+#define PORTAL_URL_MAX 32
+#define PROBE_RESPONSE_MAX 96
+
+typedef struct {
+  const char *uri;
+  captive_probe_os_t os;
+  uint32_t hash;
+} captive_probe_t;
+
+// Paths requested by the OS connectivity checks, whatever the host
+static captive_probe_t probes[] = {
+  { "/hotspot-detect.html", CAPTIVE_PROBE_APPLE },
+  { "/library/test/success.html", CAPTIVE_PROBE_APPLE },
+  { "/generate_204", CAPTIVE_PROBE_ANDROID },
+  { "/gen_204", CAPTIVE_PROBE_ANDROID },
+  { "/connecttest.txt", CAPTIVE_PROBE_WINDOWS },
+  { "/ncsi.txt", CAPTIVE_PROBE_WINDOWS },
+  { "/redirect", CAPTIVE_PROBE_WINDOWS },
+  { "/canonical.html", CAPTIVE_PROBE_FIREFOX },
+  { "/success.txt", CAPTIVE_PROBE_FIREFOX },
+  { "/kindle-wifi/wifistub.html", CAPTIVE_PROBE_OTHER },
+  { "/check_network_status.txt", CAPTIVE_PROBE_OTHER }
+};
+
+#define PROBES_COUNT (sizeof(probes) / sizeof(probes[0]))
+
+static const char *os_names[CAPTIVE_PROBE_OS_COUNT] = { "Apple", "Android", "Windows", "Firefox", "other" };
+static const char *os_keys[CAPTIVE_PROBE_OS_COUNT] = { "apple", "android", "windows", "firefox", "other" };
+
+// Local variables
+
+static char portal_url[PORTAL_URL_MAX] = "http://192.168.4.1/";
+// Same small redirection page for every probe
+static char response_body[PROBE_RESPONSE_MAX];
+static size_t response_len = 0;
+
+static uint32_t counters[CAPTIVE_PROBE_OS_COUNT];
+
+// Implementations
+
+// FNV-1a of the path, up to the query string
+static uint32_t hash_path(const char *uri) {
+  uint32_t hash = 2166136261u;
+  for (; *uri != '\0' && *uri != '?'; ++uri) {
+    hash = (hash ^ (uint8_t)*uri) * 16777619u;
+  }
+  return hash;
+}
+
+static bool is_same_path(const char *uri, const char *path) {
+  size_t len = strlen(path);
+  return strncmp(uri, path, len) == 0 && (uri[len] == '\0' || uri[len] == '?');
+}
+
+// Broadcast the probes answered per OS and the DNS queries per type since boot
+// {
+//   "captive_portal": {
+//     "probes": { "apple": 2, "android": 5, "windows": 0, "firefox": 0, "other": 0 },
+//     "dns": { "a": 40, "aaaa": 38, "https": 12, "other": 1, "malformed": 0 }
+//   }
+// }
+static void broadcast_captive_stats(void) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON *diagnostics = cJSON_AddObjectToObject(root, "captive_portal");
+  cJSON *probe_counts = cJSON_AddObjectToObject(diagnostics, "probes");
+  for (int os = 0; os < CAPTIVE_PROBE_OS_COUNT; ++os) {
+    cJSON_AddNumberToObject(probe_counts, os_keys[os], captive_probe_count(os));
+  }
+
+  captive_dns_stats_t dns_stats;
+  captive_dns_get_stats(&dns_stats);
+  cJSON *dns = cJSON_AddObjectToObject(diagnostics, "dns");
+  cJSON_AddNumberToObject(dns, "a", dns_stats.a);
+  cJSON_AddNumberToObject(dns, "aaaa", dns_stats.aaaa);
+  cJSON_AddNumberToObject(dns, "https", dns_stats.https);
+  cJSON_AddNumberToObject(dns, "other", dns_stats.other);
+  cJSON_AddNumberToObject(dns, "malformed", dns_stats.malformed);
+
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  broadcast_message(message);
+  free(message);
+}
+
+// Manage commands from web sockets
+// - Read the captive portal diagnostics
+// { "command": "captive_portal" }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return;
+  }
+
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (cJSON_IsString(command) && strcmp("captive_portal", command->valuestring) == 0) {
+    broadcast_captive_stats();
+  }
+
+  cJSON_Delete(root);
+}
+
+void setup_captive_probes(void) {
+  esp_netif_ip_info_t ip_info;
+  esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+  if (netif && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK) {
+    snprintf(portal_url, sizeof(portal_url), "http://" IPSTR "/", IP2STR(&ip_info.ip));
+  }
+
+  response_len = snprintf(response_body, sizeof(response_body), "<a href=\"%s\">PowerJeep</a>", portal_url);
+
+  for (int i = 0; i < PROBES_COUNT; ++i) {
+    probes[i].hash = hash_path(probes[i].uri);
+  }
+
+  register_callback(data_received);
+
+  ESP_LOGI(TAG, "Captive portal probes redirect to %s", portal_url);
+}
+
+esp_err_t captive_probe_handler(httpd_req_t *req) {
+  uint32_t hash = hash_path(req->uri);
+
+  for (int i = 0; i < PROBES_COUNT; ++i) {
+    if (probes[i].hash != hash || !is_same_path(req->uri, probes[i].uri)) {
+      continue;
+    }
+
+    captive_probe_os_t os = probes[i].os;
+    if (counters[os]++ == 0) {
+      ESP_LOGI(TAG, "First %s captive portal probe: %s", os_names[os], probes[i].uri);
+    }
+
+    // Probes must not be cached, the portal only shows while they fail
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", portal_url);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_type(req, "text/html");
+    return httpd_resp_send(req, response_body, response_len);
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+uint32_t captive_probe_count(captive_probe_os_t os) {
+  return os < CAPTIVE_PROBE_OS_COUNT ? counters[os] : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef CAPTIVE_PROBE_H
+#define CAPTIVE_PROBE_H
+
+#include <stdint.h>
+#include <esp_http_server.h>
+
+// Connectivity checks sent by phones and laptops when they join the access
+// point. Answering anything but the expected success page makes them open
+// the dashboard as a captive portal.
+
+typedef enum {
+  CAPTIVE_PROBE_APPLE,
+  CAPTIVE_PROBE_ANDROID,
+  CAPTIVE_PROBE_WINDOWS,
+  CAPTIVE_PROBE_FIREFOX,
+  CAPTIVE_PROBE_OTHER,
+  CAPTIVE_PROBE_OS_COUNT
+} captive_probe_os_t;
+
+// To call once the access point is up, the redirection points to its address
+void setup_captive_probes(void);
+
+// Answer a known probe URI from a precomputed response, without any file
+// system access. Returns ESP_ERR_NOT_FOUND, without responding, for other URIs.
+esp_err_t captive_probe_handler(httpd_req_t *req);
+
+// Number of probes answered per OS since boot
+uint32_t captive_probe_count(captive_probe_os_t os);
+
+#endif
@@ -0,0 +1,69 @@
+#include "channel_score.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// Channels are 5 MHz apart and 20 MHz wide: an access point interferes up to
+// 4 channels away, less and less with the distance
+#define OVERLAP_DISTANCE 5
+// Cost of an access point, whatever its signal
+#define AP_COST 10
+// Signals are counted from the noise floor, up to a strong neighbour
+#define NOISE_FLOOR_DBM (-95)
+#define STRONG_SIGNAL_DBM (-30)
+// Another channel must be 25% better to leave the current one
+#define SWITCH_MARGIN_PERCENT 75
+
+// Implementations
+
+static uint32_t ap_interference(int8_t rssi) {
+  int strength = rssi - NOISE_FLOOR_DBM;
+  if (strength < 0) {
+    strength = 0;
+  } else if (strength > STRONG_SIGNAL_DBM - NOISE_FLOOR_DBM) {
+    strength = STRONG_SIGNAL_DBM - NOISE_FLOOR_DBM;
+  }
+  return AP_COST + strength;
+}
+
+// 1, 6 and 11 don't overlap each other, the usual choice of the neighbours
+static bool is_non_overlapping(uint8_t channel) {
+  return channel == 1 || channel == 6 || channel == 11;
+}
+
+void channel_score(const channel_scan_entry_t *entries, size_t count, channel_scores_t *scores) {
+  memset(scores, 0, sizeof(channel_scores_t));
+
+  for (size_t i = 0; i < count; ++i) {
+    // Access points on 12-14 still interfere with the upper channels
+    int ap_channel = entries[i].channel;
+    uint32_t interference = ap_interference(entries[i].rssi);
+
+    for (int channel = CHANNEL_MIN; channel <= CHANNEL_MAX; ++channel) {
+      int distance = channel > ap_channel ? channel - ap_channel : ap_channel - channel;
+      if (distance < OVERLAP_DISTANCE) {
+        scores->score[channel] += (OVERLAP_DISTANCE - distance) * interference;
+      }
+    }
+    if (ap_channel >= CHANNEL_MIN && ap_channel <= CHANNEL_MAX && scores->ap_count[ap_channel] < UINT8_MAX) {
+      scores->ap_count[ap_channel]++;
+    }
+  }
+}
+
+uint8_t channel_select(const channel_scores_t *scores, uint8_t current) {
+  uint8_t best = CHANNEL_MIN;
+
+  for (int channel = CHANNEL_MIN + 1; channel <= CHANNEL_MAX; ++channel) {
+    if (scores->score[channel] < scores->score[best] ||
+        (scores->score[channel] == scores->score[best] && is_non_overlapping(channel) && !is_non_overlapping(best))) {
+      best = channel;
+    }
+  }
+
+  if (current >= CHANNEL_MIN && current <= CHANNEL_MAX && current != best &&
+      scores->score[best] * 100 >= scores->score[current] * SWITCH_MARGIN_PERCENT) {
+    return current;
+  }
+  return best;
+}
@@ -0,0 +1,32 @@
+#ifndef CHANNEL_SCORE_H
+#define CHANNEL_SCORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scoring of the 2.4 GHz channels from a scan of the neighbouring access
+// points, the least congested one hosts the softAP. No ESP-IDF dependency,
+// so that recorded scans can be replayed on a host.
+
+#define CHANNEL_MIN 1
+#define CHANNEL_MAX 11 // Allowed in every country
+
+typedef struct {
+  uint8_t channel;
+  int8_t rssi;
+} channel_scan_entry_t;
+
+typedef struct {
+  // Interference from the access points on the channel and the overlapping ones, lower is better
+  uint32_t score[CHANNEL_MAX + 1];
+  // Access points on the channel itself
+  uint8_t ap_count[CHANNEL_MAX + 1];
+} channel_scores_t;
+
+void channel_score(const channel_scan_entry_t *entries, size_t count, channel_scores_t *scores);
+
+// Best channel. The current one, 0 if none, is kept unless another one is
+// clearly better, so that the channel doesn't flip between close scores
+uint8_t channel_select(const channel_scores_t *scores, uint8_t current);
+
+#endif
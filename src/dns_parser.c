@@ -0,0 +1,168 @@
+#include "dns_parser.h"
+
+#include <string.h>
+
+#define QR_FLAG 0x8000
+#define OPCODE_MASK 0x7800
+#define AA_FLAG 0x0400
+#define RD_FLAG 0x0100
+#define RA_FLAG 0x0080
+#define RCODE_NOT_IMPLEMENTED 4
+
+#define LABEL_POINTER 0xc0
+// Bounds the pointers followed, a loop of pointers would never end otherwise
+#define MAX_POINTERS 16
+
+// Header fields, in network order
+#define HEADER_FLAGS 2
+#define HEADER_QD_COUNT 4
+#define HEADER_AN_COUNT 6
+#define HEADER_NS_COUNT 8
+#define HEADER_AR_COUNT 10
+
+// Implementations
+
+static uint16_t read_u16(const uint8_t *data) {
+  return (data[0] << 8) | data[1];
+}
+
+static void write_u16(uint8_t *data, uint16_t value) {
+  data[0] = value >> 8;
+  data[1] = value & 0xff;
+}
+
+static void write_u32(uint8_t *data, uint32_t value) {
+  write_u16(data, value >> 16);
+  write_u16(data + 2, value & 0xffff);
+}
+
+// Offset following the uncompressed name of a question, -1 if malformed
+static int skip_name(const uint8_t *packet, size_t len, size_t offset) {
+  size_t name_len = 0;
+
+  while (offset < len) {
+    uint8_t label_len = packet[offset];
+    if (label_len == 0) {
+      return offset + 1;
+    }
+    // Questions of a query are never compressed
+    if ((label_len & LABEL_POINTER) != 0) {
+      return -1;
+    }
+    name_len += label_len + 1;
+    if (name_len > DNS_NAME_MAX_LEN || offset + 1 + label_len >= len) {
+      return -1;
+    }
+    offset += label_len + 1;
+  }
+  return -1;
+}
+
+dns_query_status_t dns_parse_query(const uint8_t *packet, size_t len, dns_question_t *question) {
+  if (len < DNS_HEADER_LEN) {
+    return DNS_QUERY_MALFORMED;
+  }
+
+  uint16_t flags = read_u16(packet + HEADER_FLAGS);
+  if ((flags & QR_FLAG) != 0) {
+    return DNS_QUERY_MALFORMED;
+  }
+  if ((flags & OPCODE_MASK) != 0 || read_u16(packet + HEADER_QD_COUNT) == 0) {
+    return DNS_QUERY_NOT_IMPLEMENTED;
+  }
+
+  int name_end = skip_name(packet, len, DNS_HEADER_LEN);
+  if (name_end < 0 || (size_t)name_end + 4 > len) {
+    return DNS_QUERY_MALFORMED;
+  }
+
+  question->name_offset = DNS_HEADER_LEN;
+  question->type = read_u16(packet + name_end);
+  question->class = read_u16(packet + name_end + 2);
+  question->question_end = name_end + 4;
+  return DNS_QUERY_OK;
+}
+
+int dns_parse_name(const uint8_t *packet, size_t len, size_t offset, char *name, size_t name_max_len) {
+  size_t name_len = 0;
+  int end = -1;
+  int pointers = 0;
+
+  if (name_max_len == 0) {
+    return -1;
+  }
+
+  while (offset < len) {
+    uint8_t label_len = packet[offset];
+
+    if (label_len == 0) {
+      name[name_len > 0 ? name_len - 1 : 0] = '\0';
+      return end >= 0 ? end : (int)offset + 1;
+    }
+
+    if ((label_len & LABEL_POINTER) == LABEL_POINTER) {
+      if (offset + 1 >= len || ++pointers > MAX_POINTERS) {
+        return -1;
+      }
+      // The name continues elsewhere, it ends here in the packet
+      if (end < 0) {
+        end = offset + 2;
+      }
+      offset = ((label_len & ~LABEL_POINTER) << 8) | packet[offset + 1];
+      continue;
+    }
+    if ((label_len & LABEL_POINTER) != 0) {
+      // Reserved label types
+      return -1;
+    }
+
+    // Room for the label, and the '.' or the final '\0'
+    if (offset + 1 + label_len >= len || name_len + label_len + 1 > name_max_len ||
+        name_len + label_len + 1 > DNS_NAME_MAX_LEN) {
+      return -1;
+    }
+    memcpy(name + name_len, packet + offset + 1, label_len);
+    name_len += label_len;
+    name[name_len++] = '.';
+    offset += label_len + 1;
+  }
+  return -1;
+}
+
+int dns_build_reply(uint8_t *packet, size_t max_len, dns_query_status_t status,
+                    const dns_question_t *question, uint32_t address, uint32_t ttl) {
+  if (status == DNS_QUERY_MALFORMED) {
+    return -1;
+  }
+
+  uint16_t flags = read_u16(packet + HEADER_FLAGS);
+  if (status == DNS_QUERY_NOT_IMPLEMENTED) {
+    write_u16(packet + HEADER_FLAGS, QR_FLAG | (flags & (OPCODE_MASK | RD_FLAG)) | RCODE_NOT_IMPLEMENTED);
+    memset(packet + HEADER_QD_COUNT, 0, DNS_HEADER_LEN - HEADER_QD_COUNT);
+    return DNS_HEADER_LEN;
+  }
+  // Only the first question is answered, additional records like EDNS are dropped
+  write_u16(packet + HEADER_FLAGS, QR_FLAG | AA_FLAG | RA_FLAG | (flags & RD_FLAG));
+  write_u16(packet + HEADER_QD_COUNT, 1);
+  memset(packet + HEADER_AN_COUNT, 0, DNS_HEADER_LEN - HEADER_AN_COUNT);
+
+  size_t reply_len = question->question_end;
+  if (question->type != DNS_TYPE_A || question->class != DNS_CLASS_IN) {
+    return reply_len;
+  }
+
+  if (reply_len + DNS_ANSWER_LEN > max_len) {
+    return -1;
+  }
+  uint8_t *answer = packet + reply_len;
+  // Name pointer to the question
+  write_u16(answer, (LABEL_POINTER << 8) | question->name_offset);
+  write_u16(answer + 2, DNS_TYPE_A);
+  write_u16(answer + 4, DNS_CLASS_IN);
+  write_u32(answer + 6, ttl);
+  write_u16(answer + 10, sizeof(address));
+  memcpy(answer + 12, &address, sizeof(address));
+
+  write_u16(packet + HEADER_AN_COUNT, 1);
+  return reply_len + DNS_ANSWER_LEN;
+}
@@ -0,0 +1,52 @@
+#ifndef DNS_PARSER_H
+#define DNS_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// DNS query parsing and reply building for the captive DNS, on raw packets
+// only: no ESP-IDF dependency, so that it builds and runs on a host too.
+// Every read is checked against the packet length, packets come from anyone
+// on the access point.
+
+#define DNS_HEADER_LEN 12
+#define DNS_NAME_MAX_LEN 255
+// Space needed after a query for its reply
+#define DNS_ANSWER_LEN 16
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_TYPE_SVCB 64
+#define DNS_TYPE_HTTPS 65
+#define DNS_CLASS_IN 1
+
+typedef enum {
+  DNS_QUERY_OK,
+  // Not a standard query, answered with NOTIMP
+  DNS_QUERY_NOT_IMPLEMENTED,
+  // Dropped without answer
+  DNS_QUERY_MALFORMED
+} dns_query_status_t;
+
+// First question of a query
+typedef struct {
+  uint16_t type;
+  uint16_t class;
+  // Offset of the name and of the first byte after the question
+  size_t name_offset;
+  size_t question_end;
+} dns_question_t;
+
+dns_query_status_t dns_parse_query(const uint8_t *packet, size_t len, dns_question_t *question);
+
+// Decode the name at offset as a dot separated string, following compression
+// pointers. Returns the offset following the name in place, or -1 if malformed.
+int dns_parse_name(const uint8_t *packet, size_t len, size_t offset, char *name, size_t name_max_len);
+
+// Turn the parsed query into its reply, in place. A questions are answered
+// with address (network order), other types get an empty answer.
+// Returns the reply length, or -1 if max_len is too small.
+int dns_build_reply(uint8_t *packet, size_t max_len, dns_query_status_t status,
+                    const dns_question_t *question, uint32_t address, uint32_t ttl);
+
+#endif
@@ -0,0 +1,118 @@
+#include "driver_profile.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include "settings.h"
+
+static const char *TAG = "profile";
+
+// Variables in memory
+
+// Read by the drive task on every tick, the profiles themselves live in the settings
+static driver_profile_t active;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Implementations
+
+static void set_active(const driver_profile_t *profile) {
+  portENTER_CRITICAL(&lock);
+  active = *profile;
+  portEXIT_CRITICAL(&lock);
+}
+
+static int find_profile(const settings_t *settings, const char *name) {
+  for (int i = 0; i < settings->profile_count; ++i) {
+    if (strncmp(settings->profiles[i].name, name, DRIVER_PROFILE_NAME_LEN) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void driver_profile_get_active(driver_profile_t *profile) {
+  portENTER_CRITICAL(&lock);
+  *profile = active;
+  portEXIT_CRITICAL(&lock);
+}
+
+int driver_profile_list(driver_profile_t *profiles, int *active_index) {
+  settings_t settings;
+  settings_get(&settings);
+
+  memcpy(profiles, settings.profiles, settings.profile_count * sizeof(driver_profile_t));
+  *active_index = settings.active_profile;
+  return settings.profile_count;
+}
+
+esp_err_t driver_profile_select(const char *name) {
+  settings_t settings;
+  settings_get(&settings);
+
+  int index = find_profile(&settings, name);
+  if (index < 0) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  set_active(&settings.profiles[index]);
+  ESP_LOGI(TAG, "Driving as %s", settings.profiles[index].name);
+
+  settings.active_profile = index;
+  settings_update(&settings);
+  return ESP_OK;
+}
+
+esp_err_t driver_profile_save(const driver_profile_t *profile) {
+  if (profile->name[0] == '\0' || strnlen(profile->name, DRIVER_PROFILE_NAME_LEN) == DRIVER_PROFILE_NAME_LEN ||
+      profile->max_forward > 100 || profile->max_backward > 100 || profile->acceleration == 0 || profile->braking < DRIVER_PROFILE_BRAKING_MIN) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  settings_t settings;
+  settings_get(&settings);
+
+  int index = find_profile(&settings, profile->name);
+  if (index < 0) {
+    if (settings.profile_count == DRIVER_PROFILES_MAX) {
+      return ESP_ERR_NO_MEM;
+    }
+    index = settings.profile_count++;
+  }
+  settings.profiles[index] = *profile;
+
+  if (index == settings.active_profile) {
+    set_active(profile);
+  }
+  settings_update(&settings);
+  return ESP_OK;
+}
+
+esp_err_t driver_profile_set_speed_caps(uint8_t max_forward, uint8_t max_backward) {
+  settings_t settings;
+  settings_get(&settings);
+
+  driver_profile_t *profile = &settings.profiles[settings.active_profile];
+  if ((profile->permissions & DRIVER_PROFILE_ALLOW_SPEED_CAPS) == 0) {
+    ESP_LOGW(TAG, "Speed caps of %s are locked", profile->name);
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (max_forward > 100 || max_backward > 100) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  profile->max_forward = max_forward;
+  profile->max_backward = max_backward;
+
+  set_active(profile);
+  settings_update(&settings);
+  return ESP_OK;
+}
+
+void setup_driver_profiles(void) {
+  settings_t settings;
+  settings_get(&settings);
+
+  set_active(&settings.profiles[settings.active_profile]);
+  ESP_LOGI(TAG, "Driving as %s", active.name);
+}
@@ -0,0 +1,50 @@
+#ifndef DRIVER_PROFILE_H
+#define DRIVER_PROFILE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define DRIVER_PROFILES_MAX 6
+#define DRIVER_PROFILE_NAME_LEN 16 // With the trailing '\0'
+// Braking can only be stronger than the default, the safety slowdown must stop the car in time
+#define DRIVER_PROFILE_BRAKING_MIN 100
+
+// Permissions of the dashboard while a profile is active
+#define DRIVER_PROFILE_ALLOW_SPEED_CAPS 0x01 // "update_max" changes the caps
+
+// Everything that changes the way the car drives, stored as is in the settings
+typedef struct {
+  char name[DRIVER_PROFILE_NAME_LEN];
+  uint8_t max_forward; // %
+  uint8_t max_backward; // %
+  uint8_t acceleration; // Tenth of % per control tick
+  uint8_t braking; // % of the default braking strength, DRIVER_PROFILE_BRAKING_MIN at least
+  uint8_t permissions;
+} driver_profile_t;
+
+// Profiles created on first boot, the first one is active.
+// With a 18v battery, 66% is equivalent to a 12v
+#define DRIVER_PROFILE_DEFAULTS { \
+  { "kid", 60, 35, 5, 100, DRIVER_PROFILE_ALLOW_SPEED_CAPS }, \
+  { "toddler", 30, 15, 2, 150, 0 }, \
+  { "parent test", 100, 40, 10, 100, DRIVER_PROFILE_ALLOW_SPEED_CAPS }, \
+}
+#define DRIVER_PROFILE_DEFAULTS_COUNT 3
+
+void setup_driver_profiles(void);
+
+// Copy of the active profile, cheap enough for every control tick
+void driver_profile_get_active(driver_profile_t *profile);
+
+// Copy all profiles, returns how many and the index of the active one
+int driver_profile_list(driver_profile_t *profiles, int *active_index);
+
+esp_err_t driver_profile_select(const char *name);
+
+// Create a profile, or replace the one with the same name
+esp_err_t driver_profile_save(const driver_profile_t *profile);
+
+// Change the speed caps of the active profile, if it allows it
+esp_err_t driver_profile_set_speed_caps(uint8_t max_forward, uint8_t max_backward);
+
+#endif
@@ -0,0 +1,113 @@
+#include "embedded_assets.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_vfs.h"
+#include "filesystem.h"
+
+static const char *TAG = "embedded_assets";
+
+#define GZIP_EXTENSION ".gz"
+// Assets replaced by an upload, one path per line. The flashed storage image
+// holds copies of the embedded files, only uploads made since count.
+#define OVERRIDES_FILEPATH FILESYSTEM_BASE_PATH "/.overrides"
+
+// Implementations
+
+static bool is_on_filesystem(const char *path) {
+  char filepath[ESP_VFS_PATH_MAX + FILESYSTEM_OBJ_NAME_LEN];
+  struct stat file_stat;
+
+  snprintf(filepath, sizeof(filepath), FILESYSTEM_BASE_PATH "%s", path);
+  if (stat(filepath, &file_stat) == 0) {
+    return true;
+  }
+
+  snprintf(filepath, sizeof(filepath), FILESYSTEM_BASE_PATH "%s" GZIP_EXTENSION, path);
+  return stat(filepath, &file_stat) == 0;
+}
+
+static int find_index(const char *path) {
+  for (int i = 0; i < embedded_assets_count; ++i) {
+    if (strcmp(embedded_assets[i].path, path) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void load_overrides(void) {
+  char path[ESP_VFS_PATH_MAX + FILESYSTEM_OBJ_NAME_LEN];
+
+  FILE *fd = fopen(OVERRIDES_FILEPATH, "r");
+  if (!fd) {
+    return;
+  }
+  while (fgets(path, sizeof(path), fd)) {
+    path[strcspn(path, "\n")] = '\0';
+    int index = find_index(path);
+    if (index >= 0) {
+      embedded_assets_overridden[index] = is_on_filesystem(path);
+    }
+  }
+  fclose(fd);
+}
+
+static void save_overrides(void) {
+  FILE *fd = fopen(OVERRIDES_FILEPATH, "w");
+  if (!fd) {
+    ESP_LOGE(TAG, "Failed to create file : %s", OVERRIDES_FILEPATH);
+    return;
+  }
+  for (int i = 0; i < embedded_assets_count; ++i) {
+    if (embedded_assets_overridden[i]) {
+      fprintf(fd, "%s\n", embedded_assets[i].path);
+    }
+  }
+  fclose(fd);
+}
+
+void setup_embedded_assets(void) {
+  size_t total_size = 0;
+
+  load_overrides();
+  for (int i = 0; i < embedded_assets_count; ++i) {
+    total_size += embedded_assets[i].size;
+    if (embedded_assets_overridden[i]) {
+      ESP_LOGI(TAG, "%s is overridden by an upload", embedded_assets[i].path);
+    }
+  }
+
+  ESP_LOGI(TAG, "%d embedded assets (%d bytes)", embedded_assets_count, total_size);
+}
+
+const embedded_asset_t* embedded_asset_find(const char *path) {
+  int index = find_index(path);
+  if (index < 0 || embedded_assets_overridden[index]) {
+    return NULL;
+  }
+  return &embedded_assets[index];
+}
+
+void embedded_assets_update_override(const char *filepath) {
+  char path[ESP_VFS_PATH_MAX + FILESYSTEM_OBJ_NAME_LEN];
+
+  size_t base_len = strlen(FILESYSTEM_BASE_PATH);
+  if (strncmp(filepath, FILESYSTEM_BASE_PATH, base_len) != 0) {
+    return;
+  }
+  strlcpy(path, filepath + base_len, sizeof(path));
+
+  // Either the original file or its precompressed sibling
+  size_t len = strlen(path);
+  if (len > strlen(GZIP_EXTENSION) && strcmp(path + len - strlen(GZIP_EXTENSION), GZIP_EXTENSION) == 0) {
+    path[len - strlen(GZIP_EXTENSION)] = '\0';
+  }
+
+  int index = find_index(path);
+  if (index >= 0 && embedded_assets_overridden[index] != is_on_filesystem(path)) {
+    embedded_assets_overridden[index] = !embedded_assets_overridden[index];
+    save_overrides();
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef EMBEDDED_ASSETS_H
+#define EMBEDDED_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Serve the dashboard compiled into the firmware, so it loads without any
+// file system access and survives a corrupted storage partition. Files
+// uploaded at runtime still take precedence over the embedded version, the
+// copies flashed with the storage image don't.
+#define WITH_EMBEDDED_ASSETS 0
+
+// A gzipped file, generated by tools/embed_assets.py at build time
+typedef struct {
+  const char *path;
+  const uint8_t *data;
+  size_t size;
+  // Strong ETag, quoted SHA-256 of the compressed content
+  const char *etag;
+  const char *content_type;
+} embedded_asset_t;
+
+extern const embedded_asset_t embedded_assets[];
+extern const size_t embedded_assets_count;
+// Set when an uploaded file replaces the embedded one
+extern bool embedded_assets_overridden[];
+
+// Restore which assets were overridden by uploads before the restart
+void setup_embedded_assets(void);
+
+// Embedded version of the file at path, like "/index.html".
+// NULL if there is none or a file on storage replaces it.
+const embedded_asset_t* embedded_asset_find(const char *path);
+
+// To call whenever a file is uploaded to or removed from storage at runtime
+void embedded_assets_update_override(const char *filepath);
+
+#endif
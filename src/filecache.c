@@ -0,0 +1,202 @@
+#include "filecache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "filecache";
+
+// Hot static files kept in RAM, least recently used ones are evicted first
+#define CACHE_MAX_ENTRIES 8
+#define CACHE_MAX_FILE_SIZE (32*1024) // 32 KB
+#define CACHE_MAX_TOTAL_SIZE (48*1024) // 48 KB
+
+// Local variables
+
+static filecache_entry_t entries[CACHE_MAX_ENTRIES];
+static size_t total_size = 0;
+static uint32_t use_counter = 0;
+
+static SemaphoreHandle_t lock = NULL;
+
+// Implementations
+
+static void free_entry(filecache_entry_t *entry) {
+  ESP_LOGD(TAG, "Evict %s (%d bytes)", entry->path, entry->size);
+
+  total_size -= entry->size;
+  free(entry->data);
+  memset(entry, 0, sizeof(filecache_entry_t));
+}
+
+// Drop an entry now, or once its last user releases it
+static void drop_entry(filecache_entry_t *entry) {
+  if (entry->users > 0) {
+    entry->stale = true;
+  } else {
+    free_entry(entry);
+  }
+}
+
+static filecache_entry_t* find_entry(const char *filepath) {
+  for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+    if (entries[i].data != NULL && !entries[i].stale && strcmp(entries[i].path, filepath) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+// Evict least recently used entries until size bytes and one slot are available
+static filecache_entry_t* make_room(size_t size) {
+  while (true) {
+    filecache_entry_t *free_slot = NULL;
+    filecache_entry_t *oldest = NULL;
+
+    for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+      filecache_entry_t *entry = &entries[i];
+      if (entry->data == NULL) {
+        free_slot = free_slot ? free_slot : entry;
+      } else if (entry->users == 0 && (oldest == NULL || entry->last_used < oldest->last_used)) {
+        oldest = entry;
+      }
+    }
+
+    if (free_slot != NULL && total_size + size <= CACHE_MAX_TOTAL_SIZE) {
+      return free_slot;
+    }
+    if (oldest == NULL) {
+      // Everything left is being sent
+      return NULL;
+    }
+    free_entry(oldest);
+  }
+}
+
+// sha256 may be NULL to compute it from the content
+static filecache_entry_t* load_entry(const char *filepath, const uint8_t *sha256) {
+  struct stat file_stat;
+  if (stat(filepath, &file_stat) == -1 || file_stat.st_size > CACHE_MAX_FILE_SIZE) {
+    return NULL;
+  }
+
+  filecache_entry_t *entry = make_room(file_stat.st_size);
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  char *data = malloc(file_stat.st_size > 0 ? file_stat.st_size : 1);
+  if (data == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate %ld bytes for %s", file_stat.st_size, filepath);
+    return NULL;
+  }
+
+  FILE *fd = fopen(filepath, "r");
+  if (!fd) {
+    free(data);
+    return NULL;
+  }
+  size_t size = fread(data, 1, file_stat.st_size, fd);
+  fclose(fd);
+
+  if (size != file_stat.st_size) {
+    ESP_LOGE(TAG, "Failed to read %s", filepath);
+    free(data);
+    return NULL;
+  }
+
+  strlcpy(entry->path, filepath, sizeof(entry->path));
+  entry->data = data;
+  entry->size = size;
+  uint8_t digest[FILECACHE_SHA256_SIZE];
+  if (sha256 == NULL) {
+    mbedtls_sha256_ret((uint8_t*)data, size, digest, 0);
+    sha256 = digest;
+  }
+  filecache_format_etag(entry->etag, sha256);
+  total_size += size;
+
+  ESP_LOGI(TAG, "Cached %s (%d bytes, %d bytes in cache)", filepath, size, total_size);
+  return entry;
+}
+
+const filecache_entry_t* filecache_acquire(const char *filepath) {
+  if (lock == NULL) {
+    return NULL;
+  }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  filecache_entry_t *entry = find_entry(filepath);
+  if (entry == NULL) {
+    entry = load_entry(filepath, NULL);
+  }
+  if (entry != NULL) {
+    entry->users++;
+    entry->last_used = ++use_counter;
+  }
+
+  xSemaphoreGive(lock);
+
+  return entry;
+}
+
+void filecache_release(const filecache_entry_t *released) {
+  filecache_entry_t *entry = (filecache_entry_t*)released;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  entry->users--;
+  if (entry->stale && entry->users == 0) {
+    free_entry(entry);
+  }
+
+  xSemaphoreGive(lock);
+}
+
+void filecache_invalidate(const char *filepath) {
+  if (lock == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  filecache_entry_t *entry = find_entry(filepath);
+  if (entry != NULL) {
+    drop_entry(entry);
+  }
+
+  xSemaphoreGive(lock);
+}
+
+void filecache_update(const char *filepath, const uint8_t *sha256) {
+  if (lock == NULL) {
+    return;
+  }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  filecache_entry_t *entry = find_entry(filepath);
+  if (entry != NULL) {
+    drop_entry(entry);
+  }
+  load_entry(filepath, sha256);
+
+  xSemaphoreGive(lock);
+}
+
+void filecache_format_etag(char *etag, const uint8_t *sha256) {
+  *etag++ = '"';
+  for (int i = 0; i < FILECACHE_SHA256_SIZE; ++i) {
+    etag += sprintf(etag, "%02x", sha256[i]);
+  }
+  strcpy(etag, "\"");
+}
+
+void setup_filecache(void) {
+  lock = xSemaphoreCreateMutex();
+}
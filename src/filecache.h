@@ -0,0 +1,43 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_vfs.h"
+#include "filesystem.h"
+
+#define FILECACHE_PATH_MAX (ESP_VFS_PATH_MAX + FILESYSTEM_OBJ_NAME_LEN)
+#define FILECACHE_SHA256_SIZE 32
+// Quoted hex SHA-256 of the content
+#define FILECACHE_ETAG_MAX (2 * FILECACHE_SHA256_SIZE + 3)
+
+// A file fully loaded in RAM
+typedef struct {
+  char path[FILECACHE_PATH_MAX];
+  char *data;
+  size_t size;
+  // Strong ETag, quoted, derived from the content
+  char etag[FILECACHE_ETAG_MAX];
+  uint32_t last_used;
+  int users;
+  bool stale;
+} filecache_entry_t;
+
+void setup_filecache(void);
+
+// Return the cached file, loading it from storage on a miss.
+// NULL if the file doesn't exist or is too large to be cached.
+// The entry stays valid until released.
+const filecache_entry_t* filecache_acquire(const char *filepath);
+void filecache_release(const filecache_entry_t *entry);
+
+// Drop the cached content, to call whenever the file changes on storage
+void filecache_invalidate(const char *filepath);
+// Replace the cached content with the new file, whose digest is already known
+void filecache_update(const char *filepath, const uint8_t *sha256);
+
+// Format a SHA-256 digest as a strong ETag
+void filecache_format_etag(char *etag, const uint8_t *sha256);
+
+#endif
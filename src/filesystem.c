@@ -0,0 +1,144 @@
+#include "filesystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/unistd.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#if WITH_LITTLEFS
+#include "esp_littlefs.h"
+#else
+#include "esp_spiffs.h"
+#endif
+
+static const char *TAG = "filesystem";
+
+#if WITH_FILESYSTEM_BENCHMARK
+#define BENCHMARK_FILEPATH FILESYSTEM_BASE_PATH "/benchmark.tmp"
+#define BENCHMARK_FILE_SIZE (64*1024) // 64 KB
+#define BENCHMARK_CHUNK_SIZE 4096
+#define BENCHMARK_OPENS 20
+#endif
+
+// File system on which is stored the webpage
+
+static esp_err_t mount(void) {
+#if WITH_LITTLEFS
+    esp_vfs_littlefs_conf_t conf = {
+      .base_path = FILESYSTEM_BASE_PATH,
+      .partition_label = FILESYSTEM_PARTITION_LABEL,
+      .format_if_mount_failed = true,
+      .dont_mount = false
+    };
+
+    return esp_vfs_littlefs_register(&conf);
+#else
+    esp_vfs_spiffs_conf_t conf = {
+      .base_path = FILESYSTEM_BASE_PATH,
+      .partition_label = FILESYSTEM_PARTITION_LABEL,
+      .max_files = FILESYSTEM_MAX_FILES,
+      .format_if_mount_failed = true
+    };
+
+    return esp_vfs_spiffs_register(&conf);
+#endif
+}
+
+esp_err_t filesystem_info(size_t *total, size_t *used) {
+#if WITH_LITTLEFS
+    return esp_littlefs_info(FILESYSTEM_PARTITION_LABEL, total, used);
+#else
+    return esp_spiffs_info(FILESYSTEM_PARTITION_LABEL, total, used);
+#endif
+}
+
+#if WITH_FILESYSTEM_BENCHMARK
+static int64_t throughput_kbps(size_t size, int64_t duration_us) {
+    return duration_us > 0 ? (int64_t)size * 1000000 / 1024 / duration_us : 0;
+}
+
+// Sequential write then read of a temporary file, in chunks like the file server
+static void run_benchmark(void) {
+    char *buffer = malloc(BENCHMARK_CHUNK_SIZE);
+    if (buffer == NULL) {
+        return;
+    }
+    for (int i = 0; i < BENCHMARK_CHUNK_SIZE; ++i) {
+        buffer[i] = i;
+    }
+
+    int64_t start = esp_timer_get_time();
+    FILE *fd = fopen(BENCHMARK_FILEPATH, "w");
+    int64_t create_us = esp_timer_get_time() - start;
+    if (!fd) {
+        ESP_LOGE(TAG, "Benchmark: failed to create %s", BENCHMARK_FILEPATH);
+        free(buffer);
+        return;
+    }
+    for (size_t written = 0; written < BENCHMARK_FILE_SIZE; written += BENCHMARK_CHUNK_SIZE) {
+        fwrite(buffer, 1, BENCHMARK_CHUNK_SIZE, fd);
+    }
+    fclose(fd);
+    int64_t write_us = esp_timer_get_time() - start;
+
+    // Opening an existing file is what every download pays
+    start = esp_timer_get_time();
+    for (int i = 0; i < BENCHMARK_OPENS; ++i) {
+        fd = fopen(BENCHMARK_FILEPATH, "r");
+        if (fd) {
+            fclose(fd);
+        }
+    }
+    int64_t open_us = (esp_timer_get_time() - start) / BENCHMARK_OPENS;
+
+    start = esp_timer_get_time();
+    fd = fopen(BENCHMARK_FILEPATH, "r");
+    size_t read = 0, chunk;
+    while (fd && (chunk = fread(buffer, 1, BENCHMARK_CHUNK_SIZE, fd)) > 0) {
+        read += chunk;
+    }
+    if (fd) {
+        fclose(fd);
+    }
+    int64_t read_us = esp_timer_get_time() - start;
+
+    unlink(BENCHMARK_FILEPATH);
+    free(buffer);
+
+    ESP_LOGI(TAG, "Benchmark: create %lld us, open %lld us, write %lld KB/s, read %lld KB/s (%d bytes)",
+             create_us, open_us, throughput_kbps(BENCHMARK_FILE_SIZE, write_us), throughput_kbps(read, read_us), read);
+}
+#endif
+
+esp_err_t setup_filesystem(void) {
+    ESP_LOGI(TAG, "Initializing %s", WITH_LITTLEFS ? "LittleFS" : "SPIFFS");
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = mount();
+    int64_t mount_us = esp_timer_get_time() - start;
+    if (ret != ESP_OK) {
+        if (ret == ESP_FAIL) {
+            ESP_LOGE(TAG, "Failed to mount or format filesystem");
+        } else if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to find storage partition");
+        } else {
+            ESP_LOGE(TAG, "Failed to initialize filesystem (%s)", esp_err_to_name(ret));
+        }
+        return ESP_FAIL;
+    }
+
+    size_t total = 0, used = 0;
+    ret = filesystem_info(&total, &used);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get storage partition information (%s)", esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Partition size: total: %d, used: %d, mounted in %lld ms", total, used, mount_us / 1000);
+
+#if WITH_FILESYSTEM_BENCHMARK
+    run_benchmark();
+#endif
+    return ESP_OK;
+}
@@ -0,0 +1,33 @@
+#ifndef FILESYSTEM_H
+#define FILESYSTEM_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+// File system of the "storage" partition, on which is stored the webpage.
+// LittleFS mounts faster, has directories and atomic renames, and keeps its
+// speed as the partition fills. It needs the esp_littlefs component, and the
+// partition to be flashed with a LittleFS image (see README).
+#define WITH_LITTLEFS 0
+
+#define FILESYSTEM_PARTITION_LABEL "storage"
+#define FILESYSTEM_BASE_PATH "/spiffs"
+#define FILESYSTEM_MAX_FILES 10 // This decides the maximum number of files that can be opened at once on SPIFFS
+
+#if WITH_LITTLEFS
+#define FILESYSTEM_OBJ_NAME_LEN CONFIG_LITTLEFS_OBJ_NAME_LEN
+// rename() replaces an existing file in a single step
+#define FILESYSTEM_HAS_ATOMIC_RENAME 1
+#else
+#define FILESYSTEM_OBJ_NAME_LEN CONFIG_SPIFFS_OBJ_NAME_LEN
+#define FILESYSTEM_HAS_ATOMIC_RENAME 0
+#endif
+
+// Log mount time, open latency and sequential throughput at boot, to compare backends
+#define WITH_FILESYSTEM_BENCHMARK 0
+
+esp_err_t setup_filesystem(void);
+
+esp_err_t filesystem_info(size_t *total, size_t *used);
+
+#endif
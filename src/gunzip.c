@@ -0,0 +1,332 @@
+#include "gunzip.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+#else
+#include <zlib.h>
+#endif
+
+// RFC 1952
+#define GZIP_ID1 0x1f
+#define GZIP_ID2 0x8b
+#define GZIP_CM_DEFLATE 8
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 8
+
+#define GZIP_FLAG_HCRC (1 << 1)
+#define GZIP_FLAG_EXTRA (1 << 2)
+#define GZIP_FLAG_NAME (1 << 3)
+#define GZIP_FLAG_COMMENT (1 << 4)
+
+typedef enum {
+  STATE_HEADER,
+  STATE_EXTRA_LEN,
+  STATE_EXTRA,
+  STATE_NAME,
+  STATE_COMMENT,
+  STATE_HCRC,
+  STATE_DEFLATE,
+  STATE_TRAILER,
+  STATE_DONE,
+  STATE_ERROR
+} gunzip_state_t;
+
+struct gunzip {
+  gunzip_state_t state;
+  gunzip_status_t error;
+  uint8_t flags;
+
+  // Fixed size fields are gathered here across chunks
+  uint8_t field[GZIP_HEADER_SIZE];
+  size_t field_len;
+  size_t extra_remaining;
+
+  #ifdef ESP_PLATFORM
+  tinfl_decompressor inflator;
+  // Output window, deflate back-references point up to 32 KB behind
+  uint8_t dict[TINFL_LZ_DICT_SIZE];
+  size_t dict_offset;
+  #else
+  z_stream stream;
+  uint8_t out[32768];
+  #endif
+
+  uint32_t crc;
+  size_t size;
+};
+
+// Implementations
+
+gunzip_t* gunzip_create(void) {
+  gunzip_t *gz = calloc(1, sizeof(gunzip_t));
+  if (gz == NULL) {
+    return NULL;
+  }
+
+  gz->state = STATE_HEADER;
+  #ifdef ESP_PLATFORM
+  tinfl_init(&gz->inflator);
+  #else
+  // Raw deflate, the gzip framing is parsed here
+  if (inflateInit2(&gz->stream, -15) != Z_OK) {
+    free(gz);
+    return NULL;
+  }
+  #endif
+  return gz;
+}
+
+void gunzip_destroy(gunzip_t *gz) {
+  #ifndef ESP_PLATFORM
+  inflateEnd(&gz->stream);
+  #endif
+  free(gz);
+}
+
+size_t gunzip_output_size(const gunzip_t *gz) {
+  return gz->size;
+}
+
+bool gunzip_upload_part_valid(bool is_gzipped, const uint8_t *data, size_t len, size_t offset, size_t total_len) {
+  const uint8_t magic[] = { GZIP_ID1, GZIP_ID2 };
+
+  if (!is_gzipped) {
+    return true;
+  }
+  if (total_len < sizeof(magic)) {
+    return false;
+  }
+  for (size_t i = 0; i < len && offset + i < sizeof(magic); ++i) {
+    if (data[i] != magic[offset + i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Gather a fixed size field, returns true once complete
+static bool gather_field(gunzip_t *gz, const uint8_t **data, size_t *len, size_t field_size) {
+  size_t count = field_size - gz->field_len;
+  if (count > *len) {
+    count = *len;
+  }
+
+  memcpy(gz->field + gz->field_len, *data, count);
+  gz->field_len += count;
+  *data += count;
+  *len -= count;
+
+  if (gz->field_len < field_size) {
+    return false;
+  }
+  gz->field_len = 0;
+  return true;
+}
+
+// Skip a zero terminated string, returns true once the end is found
+static bool skip_string(const uint8_t **data, size_t *len) {
+  const uint8_t *end = memchr(*data, 0, *len);
+  if (end == NULL) {
+    *data += *len;
+    *len = 0;
+    return false;
+  }
+
+  *len -= end + 1 - *data;
+  *data = end + 1;
+  return true;
+}
+
+// Next optional header part, following the order of RFC 1952
+static gunzip_state_t next_header_state(gunzip_state_t state, uint8_t flags) {
+  switch (state) {
+    case STATE_HEADER:
+      if (flags & GZIP_FLAG_EXTRA) return STATE_EXTRA_LEN;
+      // fall through
+    case STATE_EXTRA:
+      if (flags & GZIP_FLAG_NAME) return STATE_NAME;
+      // fall through
+    case STATE_NAME:
+      if (flags & GZIP_FLAG_COMMENT) return STATE_COMMENT;
+      // fall through
+    case STATE_COMMENT:
+      if (flags & GZIP_FLAG_HCRC) return STATE_HCRC;
+      // fall through
+    default:
+      return STATE_DEFLATE;
+  }
+}
+
+// Account for and hand over decompressed data
+static gunzip_status_t emit(gunzip_t *gz, const uint8_t *out, size_t len, gunzip_output_fn output, void *ctx) {
+  #ifdef ESP_PLATFORM
+  gz->crc = esp_rom_crc32_le(gz->crc, out, len);
+  #else
+  gz->crc = crc32(gz->crc, out, len);
+  #endif
+  gz->size += len;
+  return output(out, len, ctx) ? GUNZIP_OK : GUNZIP_ERR_OUTPUT;
+}
+
+#ifdef ESP_PLATFORM
+static gunzip_status_t inflate_data(gunzip_t *gz, const uint8_t **data, size_t *len, gunzip_output_fn output, void *ctx) {
+  tinfl_status status;
+
+  do {
+    size_t in_bytes = *len;
+    size_t out_bytes = TINFL_LZ_DICT_SIZE - gz->dict_offset;
+
+    status = tinfl_decompress(&gz->inflator, *data, &in_bytes,
+                              gz->dict, gz->dict + gz->dict_offset, &out_bytes,
+                              TINFL_FLAG_HAS_MORE_INPUT);
+    *data += in_bytes;
+    *len -= in_bytes;
+
+    if (out_bytes > 0) {
+      const uint8_t *out = gz->dict + gz->dict_offset;
+      gz->dict_offset = (gz->dict_offset + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+      gunzip_status_t ret = emit(gz, out, out_bytes, output, ctx);
+      if (ret != GUNZIP_OK) {
+        return ret;
+      }
+    }
+
+    if (status < TINFL_STATUS_DONE) {
+      return GUNZIP_ERR_CORRUPTED;
+    }
+  } while (status == TINFL_STATUS_HAS_MORE_OUTPUT || (status == TINFL_STATUS_NEEDS_MORE_INPUT && *len > 0));
+
+  if (status == TINFL_STATUS_DONE) {
+    // The ROM inflater (miniz 1.x) reads up to 4 bytes ahead into its bit buffer
+    // and keeps them when done: they are the first bytes of the trailer, possibly
+    // from an earlier chunk. Skip the rest of the last deflate byte, take them back
+    tinfl_bit_buf_t bit_buf = gz->inflator.m_bit_buf >> (gz->inflator.m_num_bits & 7);
+    for (mz_uint32 i = 0; i < gz->inflator.m_num_bits / 8; ++i) {
+      gz->field[gz->field_len++] = bit_buf & 0xff;
+      bit_buf >>= 8;
+    }
+    gz->state = STATE_TRAILER;
+  }
+  return GUNZIP_OK;
+}
+#else
+static gunzip_status_t inflate_data(gunzip_t *gz, const uint8_t **data, size_t *len, gunzip_output_fn output, void *ctx) {
+  int status;
+
+  do {
+    gz->stream.next_in = (Bytef*)*data;
+    gz->stream.avail_in = *len;
+    gz->stream.next_out = gz->out;
+    gz->stream.avail_out = sizeof(gz->out);
+
+    status = inflate(&gz->stream, Z_NO_FLUSH);
+    *data += *len - gz->stream.avail_in;
+    *len = gz->stream.avail_in;
+
+    size_t out_bytes = sizeof(gz->out) - gz->stream.avail_out;
+    if (out_bytes > 0) {
+      gunzip_status_t ret = emit(gz, gz->out, out_bytes, output, ctx);
+      if (ret != GUNZIP_OK) {
+        return ret;
+      }
+    }
+
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+      return GUNZIP_ERR_CORRUPTED;
+    }
+  } while (status == Z_OK && (gz->stream.avail_out == 0 || *len > 0));
+
+  if (status == Z_STREAM_END) {
+    gz->state = STATE_TRAILER;
+  }
+  return GUNZIP_OK;
+}
+#endif
+
+gunzip_status_t gunzip_feed(gunzip_t *gz, const uint8_t *data, size_t len, gunzip_output_fn output, void *ctx) {
+  gunzip_status_t ret = GUNZIP_OK;
+
+  while (len > 0 && ret == GUNZIP_OK) {
+    switch (gz->state) {
+      case STATE_HEADER:
+        if (!gather_field(gz, &data, &len, GZIP_HEADER_SIZE)) break;
+        if (gz->field[0] != GZIP_ID1 || gz->field[1] != GZIP_ID2 || gz->field[2] != GZIP_CM_DEFLATE) {
+          ret = GUNZIP_ERR_FORMAT;
+          break;
+        }
+        gz->flags = gz->field[3];
+        gz->state = next_header_state(STATE_HEADER, gz->flags);
+        break;
+      case STATE_EXTRA_LEN:
+        if (!gather_field(gz, &data, &len, 2)) break;
+        gz->extra_remaining = gz->field[0] | (gz->field[1] << 8);
+        gz->state = STATE_EXTRA;
+        break;
+      case STATE_EXTRA: {
+        size_t count = gz->extra_remaining < len ? gz->extra_remaining : len;
+        data += count;
+        len -= count;
+        gz->extra_remaining -= count;
+        if (gz->extra_remaining == 0) {
+          gz->state = next_header_state(STATE_EXTRA, gz->flags);
+        }
+        break;
+      }
+      case STATE_NAME:
+      case STATE_COMMENT:
+        if (skip_string(&data, &len)) {
+          gz->state = next_header_state(gz->state, gz->flags);
+        }
+        break;
+      case STATE_HCRC:
+        if (gather_field(gz, &data, &len, 2)) {
+          gz->state = STATE_DEFLATE;
+        }
+        break;
+      case STATE_DEFLATE:
+        ret = inflate_data(gz, &data, &len, output, ctx);
+        break;
+      case STATE_TRAILER:
+        if (gather_field(gz, &data, &len, GZIP_TRAILER_SIZE)) {
+          gz->state = STATE_DONE;
+        }
+        break;
+      case STATE_DONE:
+        ret = GUNZIP_ERR_TRAILING;
+        break;
+      case STATE_ERROR:
+        ret = gz->error;
+        break;
+    }
+  }
+
+  if (ret != GUNZIP_OK) {
+    gz->state = STATE_ERROR;
+    gz->error = ret;
+  }
+  return ret;
+}
+
+gunzip_status_t gunzip_finish(gunzip_t *gz) {
+  if (gz->state == STATE_ERROR) {
+    return gz->error;
+  }
+  if (gz->state != STATE_DONE) {
+    return GUNZIP_ERR_TRUNCATED;
+  }
+
+  // Trailer is the CRC32 then the size modulo 2^32, little endian
+  uint32_t crc = gz->field[0] | (gz->field[1] << 8) | (gz->field[2] << 16) | ((uint32_t)gz->field[3] << 24);
+  uint32_t size = gz->field[4] | (gz->field[5] << 8) | (gz->field[6] << 16) | ((uint32_t)gz->field[7] << 24);
+
+  if (crc != gz->crc || size != (uint32_t)gz->size) {
+    return GUNZIP_ERR_INTEGRITY;
+  }
+
+  return GUNZIP_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef GUNZIP_H
+#define GUNZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming gzip decoder with bounded RAM (one 32 KB window), using the
+// inflate implementation of the ROM. Input can be fed in chunks of any size.
+// No ESP-IDF dependency: on a host, zlib inflates and the framing, CRC32 and
+// size checks are the same.
+
+typedef enum {
+  GUNZIP_OK = 0,
+  GUNZIP_ERR_FORMAT, // Not a gzip stream
+  GUNZIP_ERR_CORRUPTED, // Invalid deflate data
+  GUNZIP_ERR_OUTPUT, // Rejected by the output callback
+  GUNZIP_ERR_TRAILING, // Data after the end of the stream
+  GUNZIP_ERR_TRUNCATED,
+  GUNZIP_ERR_INTEGRITY, // CRC32 or size mismatch
+} gunzip_status_t;
+
+typedef struct gunzip gunzip_t;
+
+// Receives the decompressed data as it is produced, returns false to stop
+typedef bool (*gunzip_output_fn)(const uint8_t *data, size_t len, void *ctx);
+
+// NULL if out of memory
+gunzip_t* gunzip_create(void);
+void gunzip_destroy(gunzip_t *gz);
+
+gunzip_status_t gunzip_feed(gunzip_t *gz, const uint8_t *data, size_t len, gunzip_output_fn output, void *ctx);
+
+// GUNZIP_OK once the whole stream was decoded and matches its CRC32 and size
+gunzip_status_t gunzip_finish(gunzip_t *gz);
+
+// Number of decompressed bytes so far
+size_t gunzip_output_size(const gunzip_t *gz);
+
+// Uploads named .gz must start with the gzip magic bytes, which can come in
+// separate parts: data is the part at offset of an upload of total_len bytes.
+// Any other upload is valid, whatever its size
+bool gunzip_upload_part_valid(bool is_gzipped, const uint8_t *data, size_t len, size_t offset, size_t total_len);
+
+#endif
@@ -0,0 +1,270 @@
+#include "link_stats.h"
+
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_netif_sta_list.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/inet.h"
+
+#include "websocket.h"
+#include "cJSON.h"
+#include "utils.h"
+
+static const char *TAG = "link_stats";
+
+#define LINK_STATS_INTERVAL_MS 1000
+#define LINK_STATS_MAX_STATIONS 4
+#define LINK_STATS_MAX_CLIENTS 4
+// Weight of the last RSSI sample in the average, in %
+#define RSSI_AVERAGE_WEIGHT 20
+
+typedef struct {
+  uint8_t mac[6];
+  uint32_t address; // Network order, 0 until leased
+  int8_t rssi;
+  int8_t rssi_min;
+  float rssi_average;
+  const char *phy;
+  int64_t connected_at;
+} link_station_t;
+
+// Variables in memory
+
+static link_station_t stations[LINK_STATS_MAX_STATIONS];
+static int station_count = 0;
+static uint32_t joins = 0;
+static uint32_t leaves = 0;
+// Broadcast every poll to the websocket clients
+static bool publish_enabled = false;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Implementations
+
+static const char* get_phy_name(const wifi_sta_info_t *info) {
+  if (info->phy_lr) return "lr";
+  if (info->phy_11n) return "11n";
+  if (info->phy_11g) return "11g";
+  if (info->phy_11b) return "11b";
+  return "unknown";
+}
+
+static link_station_t* find_station(link_station_t *list, int count, const uint8_t *mac) {
+  for (int i = 0; i < count; ++i) {
+    if (memcmp(list[i].mac, mac, sizeof(list[i].mac)) == 0) {
+      return &list[i];
+    }
+  }
+  return NULL;
+}
+
+// Refresh the stations from the driver, keeping the history of the known ones
+static void poll_stations(void) {
+  wifi_sta_list_t wifi_stations;
+  esp_netif_sta_list_t netif_stations;
+  if (esp_wifi_ap_get_sta_list(&wifi_stations) != ESP_OK) {
+    return;
+  }
+  if (esp_netif_get_sta_list(&wifi_stations, &netif_stations) != ESP_OK) {
+    netif_stations.num = 0;
+  }
+
+  link_station_t polled[LINK_STATS_MAX_STATIONS];
+  int polled_count = 0;
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&lock);
+  for (int i = 0; i < wifi_stations.num && polled_count < LINK_STATS_MAX_STATIONS; ++i) {
+    const wifi_sta_info_t *info = &wifi_stations.sta[i];
+    link_station_t *station = &polled[polled_count++];
+
+    link_station_t *known = find_station(stations, station_count, info->mac);
+    if (known != NULL) {
+      *station = *known;
+      station->rssi_min = min(station->rssi_min, info->rssi);
+      station->rssi_average += (info->rssi - station->rssi_average) * RSSI_AVERAGE_WEIGHT / 100.0f;
+    } else {
+      memset(station, 0, sizeof(link_station_t));
+      memcpy(station->mac, info->mac, sizeof(station->mac));
+      station->rssi_min = info->rssi;
+      station->rssi_average = info->rssi;
+      station->connected_at = now;
+    }
+    station->rssi = info->rssi;
+    station->phy = get_phy_name(info);
+
+    for (int j = 0; j < netif_stations.num; ++j) {
+      if (memcmp(netif_stations.sta[j].mac, info->mac, sizeof(info->mac)) == 0) {
+        station->address = netif_stations.sta[j].ip.addr;
+      }
+    }
+  }
+  memcpy(stations, polled, polled_count * sizeof(link_station_t));
+  station_count = polled_count;
+  portEXIT_CRITICAL(&lock);
+}
+
+// Diagnostics of the stations and of their websocket clients
+// {
+//   "link_stats": {
+//     "uptime_ms": 123456,
+//     "joins": 3,
+//     "leaves": 2,
+//     "stations": [{
+//       "mac": "aa:bb:cc:dd:ee:ff", "ip": "192.168.4.2", "phy": "11n", "connected_ms": 60000,
+//       "rssi": -52, "rssi_min": -70, "rssi_average": -55.4,
+//       "websockets": [{ "rtt_ms": 12, "frames_sent": 240, "send_failures": 0, "last_send_us": 450, "max_send_us": 3200 }]
+//     }]
+//   }
+// }
+static char* format_stats(void) {
+  link_station_t snapshot[LINK_STATS_MAX_STATIONS];
+  websocket_client_stats_t clients[LINK_STATS_MAX_CLIENTS];
+
+  portENTER_CRITICAL(&lock);
+  int count = station_count;
+  memcpy(snapshot, stations, count * sizeof(link_station_t));
+  uint32_t join_count = joins;
+  uint32_t leave_count = leaves;
+  portEXIT_CRITICAL(&lock);
+
+  int client_count = websocket_get_client_stats(clients, LINK_STATS_MAX_CLIENTS);
+  int64_t now = esp_timer_get_time();
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON *stats = cJSON_AddObjectToObject(root, "link_stats");
+  cJSON_AddNumberToObject(stats, "uptime_ms", now / 1000);
+  cJSON_AddNumberToObject(stats, "joins", join_count);
+  cJSON_AddNumberToObject(stats, "leaves", leave_count);
+  cJSON *list = cJSON_AddArrayToObject(stats, "stations");
+
+  for (int i = 0; i < count; ++i) {
+    link_station_t *station = &snapshot[i];
+    char mac[18];
+    char ip[16];
+    snprintf(mac, sizeof(mac), MACSTR, MAC2STR(station->mac));
+    inet_ntoa_r(station->address, ip, sizeof(ip));
+
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "mac", mac);
+    cJSON_AddStringToObject(item, "ip", ip);
+    cJSON_AddStringToObject(item, "phy", station->phy);
+    cJSON_AddNumberToObject(item, "connected_ms", (now - station->connected_at) / 1000);
+    cJSON_AddNumberToObject(item, "rssi", station->rssi);
+    cJSON_AddNumberToObject(item, "rssi_min", station->rssi_min);
+    cJSON_AddNumberToObject(item, "rssi_average", roundf(station->rssi_average * 10) / 10);
+
+    // The dashboards opened from this station
+    cJSON *websockets = cJSON_AddArrayToObject(item, "websockets");
+    for (int j = 0; j < client_count; ++j) {
+      if (station->address == 0 || clients[j].address != station->address) {
+        continue;
+      }
+      cJSON *client = cJSON_CreateObject();
+      cJSON_AddNumberToObject(client, "rtt_ms", clients[j].rtt_ms);
+      cJSON_AddNumberToObject(client, "frames_sent", clients[j].frames_sent);
+      cJSON_AddNumberToObject(client, "send_failures", clients[j].send_failures);
+      cJSON_AddNumberToObject(client, "last_send_us", clients[j].last_send_us);
+      cJSON_AddNumberToObject(client, "max_send_us", clients[j].max_send_us);
+      cJSON_AddItemToArray(websockets, client);
+    }
+
+    cJSON_AddItemToArray(list, item);
+  }
+
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return message;
+}
+
+// GET /diagnostics/link
+static esp_err_t link_stats_get_handler(httpd_req_t *req) {
+  char *message = format_stats();
+  if (message == NULL) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  esp_err_t ret = httpd_resp_sendstr(req, message);
+  free(message);
+  return ret;
+}
+
+// Manage commands from web sockets
+// - Publish the link stats every second
+// { "command": "link_stats", "parameters": { "enabled": bool } }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return;
+  }
+
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (!cJSON_IsString(command) || strcmp("link_stats", command->valuestring) != 0) {
+    goto end;
+  }
+
+  cJSON *parameters = cJSON_GetObjectItem(root, "parameters");
+  cJSON *enabled = parameters ? cJSON_GetObjectItem(parameters, "enabled") : NULL;
+  if (!cJSON_IsBool(enabled)) {
+    goto end;
+  }
+  publish_enabled = cJSON_IsTrue(enabled);
+  ESP_LOGI(TAG, "Link stats publishing %s", publish_enabled ? "enabled" : "disabled");
+
+end:
+  cJSON_Delete(root);
+}
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+  portENTER_CRITICAL(&lock);
+  if (event_id == WIFI_EVENT_AP_STACONNECTED) {
+    joins++;
+  } else {
+    leaves++;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+// Low priority task polling the driver, it never competes with driving
+static void link_stats_task(void *pvParameter) {
+  while (true) {
+    poll_stations();
+
+    if (publish_enabled) {
+      char *message = format_stats();
+      if (message != NULL) {
+        broadcast_message(message);
+        free(message);
+      }
+    }
+
+    vTaskDelay(LINK_STATS_INTERVAL_MS / portTICK_PERIOD_MS);
+  }
+}
+
+void start_link_stats(httpd_handle_t server) {
+  static const httpd_uri_t link_stats_get = {
+    .uri      = "/diagnostics/link",
+    .method   = HTTP_GET,
+    .handler  = link_stats_get_handler,
+    .user_ctx = NULL
+  };
+  httpd_register_uri_handler(server, &link_stats_get);
+}
+
+void setup_link_stats(void) {
+  ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, &wifi_event_handler, NULL));
+  ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STADISCONNECTED, &wifi_event_handler, NULL));
+
+  register_callback(data_received);
+
+  xTaskCreate(&link_stats_task, "link_stats_task", 3072, NULL, 1, NULL);
+}
@@ -0,0 +1,14 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <esp_http_server.h>
+
+// Wi-Fi link quality of the connected stations, correlated with their
+// websocket clients, to tell a bad link from a stalled firmware
+
+void setup_link_stats(void);
+
+// Register GET /diagnostics/link, before the "/*" file handler
+void start_link_stats(httpd_handle_t server);
+
+#endif
@@ -6,11 +6,19 @@
 #include "esp_netif.h"
 
 #include "storage.h"
+#include "settings.h"
 #include "captdns.h"
 #include "power_wheel.h"
 #include "wifi.h"
 #include "webserver.h"
-#include "spiffs.h"
+#include "filesystem.h"
+#include "filecache.h"
+#include "embedded_assets.h"
+#include "upload_progress.h"
+#include "telemetry.h"
+#include "captive_probe.h"
+#include "link_stats.h"
+#include "radio_profile.h"
 
 static const char *TAG = "main";
 
@@ -25,13 +33,27 @@ void app_main() {
   // Init NVS storage
   setup_storage();
 
+  // Load the settings, changes are written in the background
+  setup_settings();
+
   // Init TCP/IP stack
   ESP_ERROR_CHECK(esp_netif_init());
   // Init event mechanism
   ESP_ERROR_CHECK(esp_event_loop_create_default());
 
   // Init file storage
-  ESP_ERROR_CHECK(setup_spiffs());
+  #if WITH_EMBEDDED_ASSETS
+  // The dashboard is still served from the firmware without it
+  if (setup_filesystem() != ESP_OK) {
+    ESP_LOGE(TAG, "File storage unavailable, serving the embedded dashboard only");
+  }
+  setup_embedded_assets();
+  #else
+  ESP_ERROR_CHECK(setup_filesystem());
+  #endif
+
+  // Init in RAM cache of the static files
+  setup_filecache();
 
   // Setup captive portal - automatically opens the page when we connect to the wifi
   setup_captive_dns();
@@ -39,9 +61,24 @@ void app_main() {
   // Setup wifi access point
   setup_softap();
 
+  // Answer OS connectivity checks with a redirection to the access point
+  setup_captive_probes();
+
+  // Setup upload progress events
+  setup_upload_progress();
+
   // Setup HTTP server
   setup_server();
 
   // Setup driving
   setup_driving();
+
+  // Follow the vehicle state with the radio settings
+  setup_radio_profiles();
+
+  // Setup UDP telemetry, disabled until requested over the websocket
+  setup_telemetry();
+
+  // Setup Wi-Fi link diagnostics, published when requested over the websocket
+  setup_link_stats();
 }
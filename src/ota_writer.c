@@ -0,0 +1,213 @@
+#include "ota_writer.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "ota_writer";
+
+// Max time to wait for a free buffer before giving up on the flash
+#define ACQUIRE_TIMEOUT_MS 10000
+
+// Local variables
+
+typedef struct {
+  char *buffer;
+  size_t len;
+} ota_chunk_t;
+
+static const esp_partition_t *update_partition = NULL;
+static esp_ota_handle_t ota_handle;
+
+static char *buffers[OTA_WRITER_BUFFERS];
+// Buffers ready to be received into
+static QueueHandle_t free_queue = NULL;
+// Buffers waiting to be flashed
+static QueueHandle_t write_queue = NULL;
+// Given by the writer task when it stops
+static SemaphoreHandle_t writer_done = NULL;
+
+static volatile esp_err_t write_error = ESP_OK;
+static ota_writer_stats_t stats;
+static int64_t start_time;
+
+// Implementations
+
+static void release_resources(void) {
+  for (int i = 0; i < OTA_WRITER_BUFFERS; ++i) {
+    free(buffers[i]);
+    buffers[i] = NULL;
+  }
+  if (free_queue) vQueueDelete(free_queue);
+  if (write_queue) vQueueDelete(write_queue);
+  if (writer_done) vQueueDelete(writer_done);
+  free_queue = NULL;
+  write_queue = NULL;
+  writer_done = NULL;
+  update_partition = NULL;
+}
+
+// Task flashing the buffers in the order they are submitted
+static void ota_writer_task(void *pvParameter) {
+  ota_chunk_t chunk;
+
+  while (true) {
+    int64_t wait_start = esp_timer_get_time();
+    xQueueReceive(write_queue, &chunk, portMAX_DELAY);
+    stats.write_stall_us += esp_timer_get_time() - wait_start;
+
+    // Empty chunk asks the writer to stop
+    if (chunk.buffer == NULL) {
+      break;
+    }
+
+    // After a failure, buffers are only recycled until the receiver notices
+    if (write_error == ESP_OK) {
+      int64_t write_start = esp_timer_get_time();
+      write_error = esp_ota_write(ota_handle, chunk.buffer, chunk.len);
+      stats.write_time_us += esp_timer_get_time() - write_start;
+      stats.bytes_written += chunk.len;
+
+      if (write_error != ESP_OK) {
+        ESP_LOGE(TAG, "OTA write failed (%s)", esp_err_to_name(write_error));
+      }
+    }
+
+    xQueueSend(free_queue, &chunk.buffer, portMAX_DELAY);
+  }
+
+  xSemaphoreGive(writer_done);
+  vTaskDelete(NULL);
+}
+
+// Ask the writer to stop once every queued buffer is flashed
+static void stop_writer(void) {
+  ota_chunk_t stop = { .buffer = NULL, .len = 0 };
+  xQueueSend(write_queue, &stop, portMAX_DELAY);
+  xSemaphoreTake(writer_done, portMAX_DELAY);
+}
+
+esp_err_t ota_writer_begin(void) {
+  if (update_partition != NULL) {
+    ESP_LOGE(TAG, "An update is already in progress");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  update_partition = esp_ota_get_next_update_partition(NULL);
+  if (update_partition == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  memset(&stats, 0, sizeof(stats));
+  write_error = ESP_OK;
+
+  free_queue = xQueueCreate(OTA_WRITER_BUFFERS, sizeof(char*));
+  write_queue = xQueueCreate(OTA_WRITER_BUFFERS + 1, sizeof(ota_chunk_t));
+  writer_done = xSemaphoreCreateBinary();
+  if (free_queue == NULL || write_queue == NULL || writer_done == NULL) {
+    release_resources();
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (int i = 0; i < OTA_WRITER_BUFFERS; ++i) {
+    buffers[i] = malloc(OTA_WRITER_BUFSIZE);
+    if (buffers[i] == NULL) {
+      release_resources();
+      return ESP_ERR_NO_MEM;
+    }
+    xQueueSend(free_queue, &buffers[i], 0);
+  }
+
+  // Sectors are erased as they are written, instead of the whole partition upfront
+  esp_err_t ret = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+  if (ret != ESP_OK) {
+    release_resources();
+    return ret;
+  }
+
+  // Same priority as the http server, flashing runs while it waits on the network
+  if (xTaskCreate(&ota_writer_task, "ota_writer_task", 3072, NULL, 5, NULL) != pdPASS) {
+    esp_ota_abort(ota_handle);
+    release_resources();
+    return ESP_ERR_NO_MEM;
+  }
+
+  start_time = esp_timer_get_time();
+  return ESP_OK;
+}
+
+char* ota_writer_acquire_buffer(void) {
+  char *buffer = NULL;
+
+  int64_t wait_start = esp_timer_get_time();
+  BaseType_t ret = xQueueReceive(free_queue, &buffer, ACQUIRE_TIMEOUT_MS / portTICK_PERIOD_MS);
+  stats.receive_stall_us += esp_timer_get_time() - wait_start;
+
+  if (ret != pdTRUE) {
+    ESP_LOGE(TAG, "Timeout waiting for the flash");
+    return NULL;
+  }
+
+  if (write_error != ESP_OK) {
+    xQueueSend(free_queue, &buffer, 0);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+esp_err_t ota_writer_submit(char *buffer, size_t len) {
+  if (write_error != ESP_OK) {
+    xQueueSend(free_queue, &buffer, 0);
+    return write_error;
+  }
+
+  ota_chunk_t chunk = { .buffer = buffer, .len = len };
+  xQueueSend(write_queue, &chunk, portMAX_DELAY);
+  return ESP_OK;
+}
+
+esp_err_t ota_writer_finish(ota_writer_stats_t *result) {
+  stop_writer();
+
+  esp_err_t ret = write_error;
+  if (ret != ESP_OK) {
+    esp_ota_abort(ota_handle);
+    release_resources();
+    return ret;
+  }
+
+  // Also validates the image
+  ret = esp_ota_end(ota_handle);
+  if (ret == ESP_OK) {
+    ret = esp_ota_set_boot_partition(update_partition);
+  }
+
+  stats.duration_us = esp_timer_get_time() - start_time;
+  if (result != NULL) {
+    *result = stats;
+  }
+
+  ESP_LOGI(TAG, "Wrote %d bytes in %lld ms (%.1f KB/s), receive stalled %lld ms, write stalled %lld ms, flash busy %lld ms",
+           stats.bytes_written, stats.duration_us / 1000,
+           stats.bytes_written / 1024.0f / (stats.duration_us / 1000000.0f),
+           stats.receive_stall_us / 1000, stats.write_stall_us / 1000, stats.write_time_us / 1000);
+
+  release_resources();
+  return ret;
+}
+
+void ota_writer_abort(void) {
+  if (update_partition == NULL) {
+    return;
+  }
+
+  stop_writer();
+  esp_ota_abort(ota_handle);
+  release_resources();
+}
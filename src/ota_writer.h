@@ -0,0 +1,36 @@
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Firmware update pipeline: the caller receives into one buffer while
+// a dedicated task flashes the previous ones.
+
+#define OTA_WRITER_BUFSIZE 4096 // One flash sector
+#define OTA_WRITER_BUFFERS 4
+
+typedef struct {
+  size_t bytes_written;
+  int64_t duration_us;
+  // Receiver waiting for a free buffer, the flash is the bottleneck
+  int64_t receive_stall_us;
+  // Writer waiting for data, the network is the bottleneck
+  int64_t write_stall_us;
+  // Time spent erasing and programming the flash
+  int64_t write_time_us;
+} ota_writer_stats_t;
+
+esp_err_t ota_writer_begin(void);
+
+// Wait for a free buffer of OTA_WRITER_BUFSIZE bytes, NULL if the update failed
+char* ota_writer_acquire_buffer(void);
+// Queue a filled buffer for flashing, the buffer must not be used afterwards
+esp_err_t ota_writer_submit(char *buffer, size_t len);
+
+// Flush the pending buffers, validate the image and select it for next boot
+esp_err_t ota_writer_finish(ota_writer_stats_t *stats);
+void ota_writer_abort(void);
+
+#endif
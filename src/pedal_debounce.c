@@ -0,0 +1,47 @@
+#include "pedal_debounce.h"
+
+#include <string.h>
+
+// Implementations
+
+void pedal_debounce_init(pedal_debounce_t *pedal, bool pressed, int64_t now_us) {
+  memset(pedal, 0, sizeof(pedal_debounce_t));
+  pedal->pressed = pressed;
+  pedal->raw = pressed;
+  pedal->raw_since_us = now_us;
+  pedal->changed_at_us = now_us;
+}
+
+void pedal_debounce_edge(pedal_debounce_t *pedal, bool pressed, int64_t time_us) {
+  pedal->edges++;
+
+  if (!pedal->settling) {
+    // Leaving the debounced state, possibly just a bounce
+    pedal->settling = true;
+    pedal->change_from_us = time_us;
+  }
+  pedal->raw = pressed;
+  pedal->raw_since_us = time_us;
+}
+
+int64_t pedal_debounce_update(pedal_debounce_t *pedal, int64_t now_us, int64_t debounce_us) {
+  if (!pedal->settling) {
+    return 0;
+  }
+
+  int64_t held_us = now_us - pedal->raw_since_us;
+  if (held_us < debounce_us) {
+    return debounce_us - held_us;
+  }
+
+  pedal->settling = false;
+  if (pedal->raw == pedal->pressed) {
+    // Bounced back
+    return 0;
+  }
+
+  pedal->pressed = pedal->raw;
+  pedal->changed_at_us = pedal->change_from_us;
+  pedal->changes++;
+  return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef PEDAL_DEBOUNCE_H
+#define PEDAL_DEBOUNCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Debouncing of a digital pedal from its raw edges. A new level is accepted
+// once it has held for the debounce time, and keeps the time of the edge that
+// started it. No ESP-IDF dependency, so that edge traces can be replayed on a host.
+
+typedef struct {
+  bool pressed;           // Debounced state
+  bool raw;               // Level after the last edge
+  int64_t raw_since_us;   // Time of the last edge
+  bool settling;          // Edges seen since the debounced state last held
+  int64_t change_from_us; // First of these edges
+  int64_t changed_at_us;  // First edge of the last accepted change
+  uint32_t edges;
+  uint32_t changes;       // Accepted changes, the other edges were bounces
+} pedal_debounce_t;
+
+void pedal_debounce_init(pedal_debounce_t *pedal, bool pressed, int64_t now_us);
+
+// Record the level read on an edge. Missed edges are fine, the same level can come twice
+void pedal_debounce_edge(pedal_debounce_t *pedal, bool pressed, int64_t time_us);
+
+// Accept the raw level if it has held for debounce_us. Returns the time left
+// before it settles, 0 if there is nothing pending
+int64_t pedal_debounce_update(pedal_debounce_t *pedal, int64_t now_us, int64_t debounce_us);
+
+#endif
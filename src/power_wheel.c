@@ -2,6 +2,7 @@
 
 #include <sys/param.h>
 #include <math.h>
+#include <string.h>
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_timer.h"
@@ -12,7 +13,7 @@
 
 #include "websocket.h"
 #include "cJSON.h"
-#include "storage.h"
+#include "driver_profile.h"
 #include "utils.h"
 
 static const char *TAG = "drive";
@@ -25,10 +26,32 @@ static void led_task(void *pvParameter);
 
 #define WITH_ADC_THROTTLE 0
 
-#if WITH_ADC_THROTTLE
+// Battery current capability, from a hall effect sensor like the ACS712
+#define WITH_CURRENT_SENSE 0
+
+#if WITH_ADC_THROTTLE || WITH_CURRENT_SENSE
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 #endif
+#if WITH_ADC_THROTTLE
+#include "settings.h"
+#include "throttle_curve.h"
+#else
+#include "pedal_debounce.h"
+#endif
+
+// Power management capability: lower clock and light sleep while parked,
+// needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE in sdkconfig
+
+#define WITH_POWER_MANAGEMENT 1
+
+#if WITH_POWER_MANAGEMENT
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#endif
+
+// The drive task waits for a pedal interrupt once parked, digital pedals only
+#define WITH_PARKING (WITH_POWER_MANAGEMENT && !WITH_ADC_THROTTLE)
 
 // PIN
 
@@ -40,6 +63,11 @@ static void led_task(void *pvParameter);
 #define GAS_PEDAL_FORWARD_PIN GPIO_NUM_32
 #define GAS_PEDAL_BACKWARD_PIN GPIO_NUM_33
 #endif
+#if WITH_CURRENT_SENSE
+#define CURRENT_SENSE_PIN ADC1_CHANNEL_6 // GPIO 34
+#define CURRENT_SENSE_ZERO_MV 1650 // Output at 0 A, behind a divider to stay below 3.3v
+#define CURRENT_SENSE_MV_PER_A 44 // ACS712-30A (66 mV/A) behind the same divider
+#endif
 // - Outputs
 #define FORWARD_PWM_PIN GPIO_NUM_18
 #define BACKWARD_PWM_PIN GPIO_NUM_19
@@ -50,47 +78,102 @@ static void led_task(void *pvParameter);
 #define FORWARD_SHUTOFF_THRESOLD 15 // %
 #define BACKWARD_SHUTOFF_THRESOLD 10 // %
 
-// - With a 18v battery, 66% is equivalent to a 12v
-#define DEFAULT_FORWARD_MAX_SPEED 60 // %
-#define DEFAULT_BACKWARD_MAX_SPEED 35 // %
-
-#define SPEED_INCREMENT 0.5f // % of increment per loop
-
 #define MOTOR_PWM_CHANNEL_FORWARD LEDC_CHANNEL_1
 #define MOTOR_PWM_CHANNEL_BACKWARD LEDC_CHANNEL_2
 #define MOTOR_PWM_TIMER LEDC_TIMER_1
 #define MOTOR_PWM_DUTY_RESOLUTION LEDC_TIMER_10_BIT
 
+#define DRIVE_LOOP_MS 20
+// Contacts bounce for a few ms, a pedal level is accepted once it held this long
+#define PEDAL_DEBOUNCE_US 5000
+#define PEDAL_FORWARD 0
+#define PEDAL_BACKWARD 1
+#define PEDAL_COUNT 2
+// Parked after this long without pedal nor speed
+#define PARKED_DELAY_MS 5000
+// Pedals are still read while parked, in case an interrupt is missed
+#define PARKED_POLL_MS 1000
+#define PM_MIN_FREQ_MHZ 40
+
 // Variables in memory
 
 float current_speed = 0;
 float emergency_stop = false;
-float max_forward = 0;
-float max_backward = 0;
 int led_sleep_delay = 20;
 
-#if WITH_ADC_THROTTLE
+static TaskHandle_t drive_task_handle = NULL;
+static volatile power_stats_t power_stats;
+// esp_timer time of the pedal interrupt, until the debounced change is applied
+static volatile int64_t wake_time = 0;
+
+#if WITH_POWER_MANAGEMENT
+// Full clock and no light sleep while held, released once parked
+static esp_pm_lock_handle_t driving_lock = NULL;
+#endif
+
+#if !WITH_ADC_THROTTLE
+// Debounced from the pin edges in the interrupt handler, read by the drive task
+static portMUX_TYPE pedals_lock = portMUX_INITIALIZER_UNLOCKED;
+static pedal_debounce_t pedals[PEDAL_COUNT];
+static const gpio_num_t pedal_pins[PEDAL_COUNT] = { GAS_PEDAL_FORWARD_PIN, GAS_PEDAL_BACKWARD_PIN };
+// Wakes the drive task up when a pending edge settles
+static esp_timer_handle_t pedal_settle_timer = NULL;
+// First edge of a pedal change, until the duty update that follows
+static int64_t pedal_changed_at = 0;
+static int64_t last_pedal_response_us = 0;
+static int64_t max_pedal_response_us = 0;
+#endif
+#if WITH_PARKING
+// Level interrupts wake the chip up while parked, edges otherwise
+static volatile bool pedals_parked = false;
+#endif
+
+#if WITH_ADC_THROTTLE || WITH_CURRENT_SENSE
 static esp_adc_cal_characteristics_t adc1_chars;
 bool adc_calibration_enabled = false;
-uint32_t adc_average = 0;
-uint32_t adc_voltage = 0;
+#endif
+#if WITH_ADC_THROTTLE
+static const adc1_channel_t throttle_channels[PEDAL_COUNT] = { GAS_PEDAL_FORWARD_PIN, GAS_PEDAL_BACKWARD_PIN };
+static const char *throttle_curve_names[] = { "linear", "progressive", "custom" };
+// Built from the settings, the drive task only does lookups
+static portMUX_TYPE throttle_lock = portMUX_INITIALIZER_UNLOCKED;
+static throttle_map_t throttle_maps[PEDAL_COUNT];
+// The car doesn't drive while the pedal voltages are learnt
+static bool throttle_calibrating = false;
+static throttle_learn_t throttle_learning[PEDAL_COUNT];
+// Last readings, to follow a calibration
+static uint32_t throttle_mv[PEDAL_COUNT];
 #endif
 
 // ***************
 // **** WEBSOCKETS
 // ***************
 
+// Every message carries the device time (esp_timer, in µs) at which the values were read,
+// so the dashboard can tell how old they are once its clock is synced with a ping
+
 // Broadcast all values
 // {
 //   "current_speed": 12,
 //   "max_forward": 66,
 //   "max_backward": 50,
-//   "emergency_stop": false
+//   "profile": "kid",
+//   "emergency_stop": false,
+//   "device_time": 123456789
 //}
 void broadcast_all_values() {
-  char *message;
-  char *format = "{\"current_speed\":%f,\"max_forward\":%f,\"max_backward\":%f,\"emergency_stop\":%s}";
-  asprintf(&message, format, current_speed, max_forward, max_backward, emergency_stop ? "true" : "false");
+  driver_profile_t profile;
+  driver_profile_get_active(&profile);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "current_speed", current_speed);
+  cJSON_AddNumberToObject(root, "max_forward", profile.max_forward);
+  cJSON_AddNumberToObject(root, "max_backward", profile.max_backward);
+  cJSON_AddStringToObject(root, "profile", profile.name);
+  cJSON_AddBoolToObject(root, "emergency_stop", emergency_stop);
+  cJSON_AddNumberToObject(root, "device_time", esp_timer_get_time());
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
   ESP_LOGI(TAG, "Send %s", message);
   broadcast_message(message);
   free(message);
@@ -98,28 +181,302 @@ void broadcast_all_values() {
 
 // Broadcast only the current speed value - can be negative if going backward
 // {
-//   "current_speed": 12
+//   "current_speed": 12,
+//   "device_time": 123456789
 // }
 void broadcast_current_speed() {
   char *message;
-  asprintf(&message, "{\"current_speed\":%f}", current_speed);
+  asprintf(&message, "{\"current_speed\":%f,\"device_time\":%lld}", current_speed, esp_timer_get_time());
   ESP_LOGI(TAG, "Send %s", message);
   broadcast_message(message);
   free(message);
 }
 
+// Broadcast the power management statistics
+// {
+//   "power": { "parked": false, "parks": 3, "wakes": 2, "last_wake_latency_us": 850, "max_wake_latency_us": 1200 }
+// }
+void broadcast_power_stats() {
+  power_stats_t stats;
+  get_power_stats(&stats);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON *power = cJSON_AddObjectToObject(root, "power");
+  cJSON_AddBoolToObject(power, "parked", stats.parked);
+  cJSON_AddNumberToObject(power, "parks", stats.parks);
+  cJSON_AddNumberToObject(power, "wakes", stats.wakes);
+  cJSON_AddNumberToObject(power, "last_wake_latency_us", stats.last_wake_latency_us);
+  cJSON_AddNumberToObject(power, "max_wake_latency_us", stats.max_wake_latency_us);
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+
+  ESP_LOGI(TAG, "Send %s", message);
+  broadcast_message(message);
+  free(message);
+}
+
+#if !WITH_ADC_THROTTLE
+// Broadcast the pedal edges, and the time from the first edge of a change to the duty update
+// {
+//   "pedals": {
+//     "forward": { "pressed": true, "edges": 14, "changes": 2 },
+//     "backward": { "pressed": false, "edges": 0, "changes": 0 },
+//     "last_response_us": 5180,
+//     "max_response_us": 9950
+//   }
+// }
+void broadcast_pedals() {
+  pedal_debounce_t states[PEDAL_COUNT];
+  portENTER_CRITICAL(&pedals_lock);
+  memcpy(states, pedals, sizeof(states));
+  portEXIT_CRITICAL(&pedals_lock);
+
+  const char *names[PEDAL_COUNT] = { "forward", "backward" };
+  cJSON *root = cJSON_CreateObject();
+  cJSON *node = cJSON_AddObjectToObject(root, "pedals");
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    cJSON *pedal = cJSON_AddObjectToObject(node, names[i]);
+    cJSON_AddBoolToObject(pedal, "pressed", states[i].pressed);
+    cJSON_AddNumberToObject(pedal, "edges", states[i].edges);
+    cJSON_AddNumberToObject(pedal, "changes", states[i].changes);
+  }
+  cJSON_AddNumberToObject(node, "last_response_us", last_pedal_response_us);
+  cJSON_AddNumberToObject(node, "max_response_us", max_pedal_response_us);
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+
+  ESP_LOGI(TAG, "Send %s", message);
+  broadcast_message(message);
+  free(message);
+}
+#endif
+
+#if WITH_ADC_THROTTLE
+// Broadcast the analog pedal calibration and response curve
+// {
+//   "throttle": {
+//     "calibrating": false,
+//     "curve": "progressive",
+//     "points": [0, 25, 50, 75, 100],
+//     "forward": { "idle_mv": 1000, "full_mv": 2600, "mv": 1012 },
+//     "backward": { "idle_mv": 1000, "full_mv": 2600, "mv": 1008 }
+//   }
+// }
+void broadcast_throttle() {
+  settings_t settings;
+  settings_get(&settings);
+  throttle_settings_t *throttle = &settings.throttle;
+
+  uint32_t voltages[PEDAL_COUNT];
+  portENTER_CRITICAL(&throttle_lock);
+  bool calibrating = throttle_calibrating;
+  memcpy(voltages, throttle_mv, sizeof(voltages));
+  portEXIT_CRITICAL(&throttle_lock);
+
+  const char *names[PEDAL_COUNT] = { "forward", "backward" };
+  const throttle_calibration_t *calibrations[PEDAL_COUNT] = { &throttle->forward, &throttle->backward };
+  cJSON *root = cJSON_CreateObject();
+  cJSON *node = cJSON_AddObjectToObject(root, "throttle");
+  cJSON_AddBoolToObject(node, "calibrating", calibrating);
+  cJSON_AddStringToObject(node, "curve", throttle_curve_names[min(throttle->curve.type, THROTTLE_CURVE_CUSTOM)]);
+  cJSON *points = cJSON_AddArrayToObject(node, "points");
+  for (int i = 0; i < THROTTLE_CURVE_POINTS; ++i) {
+    cJSON_AddItemToArray(points, cJSON_CreateNumber(throttle->curve.points[i]));
+  }
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    cJSON *pedal = cJSON_AddObjectToObject(node, names[i]);
+    cJSON_AddNumberToObject(pedal, "idle_mv", calibrations[i]->idle_mv);
+    cJSON_AddNumberToObject(pedal, "full_mv", calibrations[i]->full_mv);
+    cJSON_AddNumberToObject(pedal, "mv", voltages[i]);
+  }
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+
+  ESP_LOGI(TAG, "Send %s", message);
+  broadcast_message(message);
+  free(message);
+}
+
+// Build the lookup tables from the settings
+static void load_throttle_settings(void) {
+  settings_t settings;
+  settings_get(&settings);
+  throttle_curve_sanitize(&settings.throttle.curve);
+
+  throttle_map_t maps[PEDAL_COUNT];
+  throttle_map_build(&maps[PEDAL_FORWARD], &settings.throttle.forward, &settings.throttle.curve);
+  throttle_map_build(&maps[PEDAL_BACKWARD], &settings.throttle.backward, &settings.throttle.curve);
+
+  portENTER_CRITICAL(&throttle_lock);
+  memcpy(throttle_maps, maps, sizeof(maps));
+  portEXIT_CRITICAL(&throttle_lock);
+}
+
+// Learn the voltages while the driver presses the pedals, saved once stopped
+static void calibrate_throttle(const char *action) {
+  if (strcmp("start", action) == 0) {
+    portENTER_CRITICAL(&throttle_lock);
+    for (int i = 0; i < PEDAL_COUNT; ++i) {
+      throttle_learn_start(&throttle_learning[i], throttle_mv[i]);
+    }
+    throttle_calibrating = true;
+    portEXIT_CRITICAL(&throttle_lock);
+    ESP_LOGI(TAG, "Throttle calibration started, press the pedals fully");
+    return;
+  }
+
+  throttle_learn_t learnt[PEDAL_COUNT];
+  portENTER_CRITICAL(&throttle_lock);
+  bool calibrating = throttle_calibrating;
+  throttle_calibrating = false;
+  memcpy(learnt, throttle_learning, sizeof(learnt));
+  portEXIT_CRITICAL(&throttle_lock);
+
+  if (!calibrating || strcmp("stop", action) != 0) {
+    return;
+  }
+
+  settings_t settings;
+  settings_get(&settings);
+  throttle_calibration_t *calibrations[PEDAL_COUNT] = { &settings.throttle.forward, &settings.throttle.backward };
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    // A pedal that didn't travel keeps its previous calibration
+    if (!throttle_learn_finish(&learnt[i], calibrations[i])) {
+      ESP_LOGW(TAG, "Pedal %d only moved between %d and %d mV, calibration ignored", i, learnt[i].min_mv, learnt[i].max_mv);
+    }
+  }
+  settings_update(&settings);
+  load_throttle_settings();
+}
+
+// Read the response curve from the parameters of "throttle_curve"
+static bool parse_throttle_curve(cJSON *parameters, throttle_curve_t *curve) {
+  cJSON *type = cJSON_GetObjectItem(parameters, "curve");
+  if (!cJSON_IsString(type)) {
+    return false;
+  }
+
+  int index = -1;
+  for (int i = 0; i < (int)(sizeof(throttle_curve_names) / sizeof(throttle_curve_names[0])); ++i) {
+    if (strcmp(throttle_curve_names[i], type->valuestring) == 0) {
+      index = i;
+    }
+  }
+  if (index < 0) {
+    return false;
+  }
+  curve->type = index;
+
+  if (curve->type == THROTTLE_CURVE_CUSTOM) {
+    cJSON *points = cJSON_GetObjectItem(parameters, "points");
+    if (!cJSON_IsArray(points) || cJSON_GetArraySize(points) != THROTTLE_CURVE_POINTS) {
+      return false;
+    }
+    for (int i = 0; i < THROTTLE_CURVE_POINTS; ++i) {
+      cJSON *point = cJSON_GetArrayItem(points, i);
+      if (!cJSON_IsNumber(point)) {
+        return false;
+      }
+      curve->points[i] = min(THROTTLE_POSITION_MAX, max(0, point->valueint));
+    }
+  }
+  throttle_curve_sanitize(curve);
+  return true;
+}
+#endif
+
+// Broadcast the driver profiles
+// {
+//   "profiles": [
+//     { "name": "kid", "max_forward": 60, "max_backward": 35, "acceleration": 5, "braking": 100, "allow_speed_caps": true }
+//   ],
+//   "active_profile": "kid"
+// }
+void broadcast_profiles() {
+  driver_profile_t profiles[DRIVER_PROFILES_MAX];
+  int active_index;
+  int count = driver_profile_list(profiles, &active_index);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON *list = cJSON_AddArrayToObject(root, "profiles");
+  for (int i = 0; i < count; ++i) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "name", profiles[i].name);
+    cJSON_AddNumberToObject(item, "max_forward", profiles[i].max_forward);
+    cJSON_AddNumberToObject(item, "max_backward", profiles[i].max_backward);
+    cJSON_AddNumberToObject(item, "acceleration", profiles[i].acceleration);
+    cJSON_AddNumberToObject(item, "braking", profiles[i].braking);
+    cJSON_AddBoolToObject(item, "allow_speed_caps", (profiles[i].permissions & DRIVER_PROFILE_ALLOW_SPEED_CAPS) != 0);
+    cJSON_AddItemToArray(list, item);
+  }
+  cJSON_AddStringToObject(root, "active_profile", profiles[active_index].name);
+  char *message = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+
+  ESP_LOGI(TAG, "Send %s", message);
+  broadcast_message(message);
+  free(message);
+}
+
+// Read a profile from the parameters of "create_profile"
+static bool parse_profile(cJSON *parameters, driver_profile_t *profile) {
+  cJSON *name = cJSON_GetObjectItem(parameters, "name");
+  cJSON *max_forward = cJSON_GetObjectItem(parameters, "max_forward");
+  cJSON *max_backward = cJSON_GetObjectItem(parameters, "max_backward");
+  cJSON *acceleration = cJSON_GetObjectItem(parameters, "acceleration");
+  cJSON *braking = cJSON_GetObjectItem(parameters, "braking");
+  cJSON *allow_speed_caps = cJSON_GetObjectItem(parameters, "allow_speed_caps");
+  if (!cJSON_IsString(name) || strlen(name->valuestring) >= DRIVER_PROFILE_NAME_LEN ||
+      !cJSON_IsNumber(max_forward) || !cJSON_IsNumber(max_backward) ||
+      !cJSON_IsNumber(acceleration) || !cJSON_IsNumber(braking)) {
+    return false;
+  }
+
+  memset(profile, 0, sizeof(driver_profile_t));
+  strlcpy(profile->name, name->valuestring, sizeof(profile->name));
+  profile->max_forward = min(100, max(0, max_forward->valueint));
+  profile->max_backward = min(100, max(0, max_backward->valueint));
+  profile->acceleration = min(UINT8_MAX, max(1, acceleration->valueint));
+  profile->braking = min(UINT8_MAX, max(DRIVER_PROFILE_BRAKING_MIN, braking->valueint));
+  profile->permissions = cJSON_IsTrue(allow_speed_caps) ? DRIVER_PROFILE_ALLOW_SPEED_CAPS : 0;
+  return true;
+}
+
 // Manage commands from web sockets
-// - Update max values
+// - Update max values of the active profile
+
 // { "command": "update_max", "parameters": { "max_forward": double, "max_backward": double } }
 // - Read all values
 // { "command": "read" }
 // - Enable/Disable emergency stop
 // { "command": "emergency_stop", "parameters": { "is_enabled": bool } }
+// - List the driver profiles
+// { "command": "list_profiles" }
+// - Create a driver profile, or replace the one with the same name
+// { "command": "create_profile", "parameters": { "name": string, "max_forward": int, "max_backward": int,
+//   "acceleration": int, "braking": int (100 to 255), "allow_speed_caps": bool } }
+// - Drive with another profile, from the next control tick
+// { "command": "select_profile", "parameters": { "name": string } }
+// - Read the parking and wake up statistics
+// { "command": "power" }
+// - Read the digital pedal statistics
+// { "command": "pedals" }
+// - Read the analog pedal calibration and response curve
+// { "command": "throttle" }
+// - Learn the analog pedal voltages: start with the pedals released, press them fully, then stop.
+//   The car doesn't drive meanwhile
+// { "command": "calibrate_throttle", "parameters": { "action": "start" | "stop" | "cancel" } }
+// - Change the analog pedal response, the custom points are the % at 0, 25, 50, 75 and 100% of the travel
+// { "command": "throttle_curve", "parameters": { "curve": "linear" | "progressive" | "custom", "points": [0, 10, 30, 60, 100] } }
 static void data_received(httpd_ws_frame_t* ws_pkt) {
   ESP_LOGI(TAG, "Received packet with message: %s", ws_pkt->payload);
 
   cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
-  char* command = cJSON_GetObjectItem(root, "command")->valuestring;
+  cJSON *command_node = cJSON_GetObjectItem(root, "command");
+  if (!cJSON_IsString(command_node)) {
+    goto end;
+  }
+  char* command = command_node->valuestring;
   ESP_LOGI(TAG, "Command: %s", command);
   if (strcmp("update_max", command) == 0) {
     cJSON* parameters = cJSON_GetObjectItem(root, "parameters");
@@ -132,13 +489,11 @@ static void data_received(httpd_ws_frame_t* ws_pkt) {
     if (!cJSON_IsNumber(max_forward_node) || !cJSON_IsNumber(max_backward_node)) {
       goto end;
     }
-    // Set values in memory for immediate use
-    max_forward = max_forward_node->valuedouble;
-    max_backward = max_backward_node->valuedouble;
-
-    // Save values in storage to survive restarts
-    writeFloat("max_forward", max_forward);
-    writeFloat("max_backward", max_backward);
+    // Used from the next control tick, and saved to survive restarts.
+    // Rejected if the active profile is locked, the broadcast resets the sliders
+    driver_profile_set_speed_caps(
+      min(100, max(0, max_forward_node->valueint)),
+      min(100, max(0, max_backward_node->valueint)));
 
     // Broadcast new values to all listeners
     broadcast_all_values();
@@ -151,24 +506,118 @@ static void data_received(httpd_ws_frame_t* ws_pkt) {
     }
     cJSON *is_enabled = cJSON_GetObjectItem(parameters, "is_enabled");
     if (!cJSON_IsBool(is_enabled)) {
-      return;
+      goto end;
     }
     // Set values in memory for immediate use, it doesn't survive restarts
     emergency_stop = cJSON_IsTrue(is_enabled);
 
     // Broadcast new values to all listeners
     broadcast_all_values();
+  } else if (strcmp("list_profiles", command) == 0) {
+    broadcast_profiles();
+  } else if (strcmp("create_profile", command) == 0) {
+    driver_profile_t profile;
+    cJSON* parameters = cJSON_GetObjectItem(root, "parameters");
+    if (parameters == NULL || !parse_profile(parameters, &profile)) {
+      goto end;
+    }
+    esp_err_t ret = driver_profile_save(&profile);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to save profile %s (%s)", profile.name, esp_err_to_name(ret));
+      goto end;
+    }
+
+    broadcast_profiles();
+    broadcast_all_values();
+  } else if (strcmp("select_profile", command) == 0) {
+    cJSON* parameters = cJSON_GetObjectItem(root, "parameters");
+    if (parameters == NULL) {
+      goto end;
+    }
+    cJSON *name = cJSON_GetObjectItem(parameters, "name");
+    if (!cJSON_IsString(name) || driver_profile_select(name->valuestring) != ESP_OK) {
+      goto end;
+    }
+
+    broadcast_profiles();
+    broadcast_all_values();
+  } else if (strcmp("power", command) == 0) {
+    broadcast_power_stats();
+  #if !WITH_ADC_THROTTLE
+  } else if (strcmp("pedals", command) == 0) {
+    broadcast_pedals();
+  #else
+  } else if (strcmp("throttle", command) == 0) {
+    broadcast_throttle();
+  } else if (strcmp("calibrate_throttle", command) == 0) {
+    cJSON* parameters = cJSON_GetObjectItem(root, "parameters");
+    cJSON *action = cJSON_GetObjectItem(parameters, "action");
+    if (!cJSON_IsString(action)) {
+      goto end;
+    }
+    calibrate_throttle(action->valuestring);
+
+    broadcast_throttle();
+  } else if (strcmp("throttle_curve", command) == 0) {
+    cJSON* parameters = cJSON_GetObjectItem(root, "parameters");
+    if (parameters == NULL) {
+      goto end;
+    }
+    settings_t settings;
+    settings_get(&settings);
+    if (!parse_throttle_curve(parameters, &settings.throttle.curve)) {
+      goto end;
+    }
+    // Used from the next control tick, and saved to survive restarts
+    settings_update(&settings);
+    load_throttle_settings();
+
+    broadcast_throttle();
+  #endif
+  }
 
 end:
-    cJSON_Delete(root);
+  cJSON_Delete(root);
+}
+
+// Current drawn from the battery in mA, -1 without sensor
+static int32_t get_supply_current(void) {
+  #if WITH_CURRENT_SENSE
+  uint32_t voltage = 0;
+  uint32_t sum = 0;
+  for (int i = 0; i < 5; ++i) {
+    esp_adc_cal_get_voltage(CURRENT_SENSE_PIN, &adc1_chars, &voltage);
+    sum += voltage;
   }
+  int32_t millivolts = sum / 5;
+  return max(0, (millivolts - CURRENT_SENSE_ZERO_MV) * 1000 / CURRENT_SENSE_MV_PER_A);
+  #else
+  return -1;
+  #endif
+}
+
+// Copy the current values, used by the other telemetry channels
+void get_vehicle_state(vehicle_state_t *state) {
+  driver_profile_t profile;
+  driver_profile_get_active(&profile);
+
+  state->current_speed = current_speed;
+  state->max_forward = profile.max_forward;
+  state->max_backward = profile.max_backward;
+  state->emergency_stop = emergency_stop;
+  state->supply_current_ma = get_supply_current();
+}
+
+void get_power_stats(power_stats_t *stats) {
+  // Only written by the drive task, a torn read just shows in one report
+  *stats = *(power_stats_t *)&power_stats;
 }
 
 // **********
 // **** SETUP
 // **********
 
-#if WITH_ADC_THROTTLE
+#if WITH_ADC_THROTTLE || WITH_CURRENT_SENSE
 static bool adc_calibration_init(void) {
   esp_err_t ret;
   bool adc_calibration_enabled = false;
@@ -191,9 +640,16 @@ static bool adc_calibration_init(void) {
 
 // Setup pin on the board
 void setup_pin() {
-  #if WITH_ADC_THROTTLE
+  #if WITH_ADC_THROTTLE || WITH_CURRENT_SENSE
   adc_calibration_enabled = adc_calibration_init();
   ESP_ERROR_CHECK(adc1_config_width(ADC_WIDTH_BIT_DEFAULT));
+  #endif
+
+  #if WITH_CURRENT_SENSE
+  ESP_ERROR_CHECK(adc1_config_channel_atten(CURRENT_SENSE_PIN, ADC_ATTEN_DB_11));
+  #endif
+
+  #if WITH_ADC_THROTTLE
   ESP_ERROR_CHECK(adc1_config_channel_atten(GAS_PEDAL_FORWARD_PIN, ADC_ATTEN_DB_11));
   ESP_ERROR_CHECK(adc1_config_channel_atten(GAS_PEDAL_BACKWARD_PIN, ADC_ATTEN_DB_11));
   #else
@@ -216,6 +672,93 @@ void setup_pin() {
   gpio_set_direction(STATUS_LED_PIN, GPIO_MODE_OUTPUT);
 }
 
+#if !WITH_ADC_THROTTLE
+// Record the pedal level on each edge and wake the drive task up
+static void pedal_isr_handler(void *arg) {
+  int index = (intptr_t)arg;
+  int64_t now = esp_timer_get_time();
+  bool pressed = !gpio_get_level(pedal_pins[index]);
+
+  portENTER_CRITICAL_ISR(&pedals_lock);
+  pedal_debounce_edge(&pedals[index], pressed, now);
+  portEXIT_CRITICAL_ISR(&pedals_lock);
+
+  #if WITH_PARKING
+  if (pedals_parked) {
+    // Level triggered, disabled until the drive task switches back to edges
+    pedals_parked = false;
+    gpio_intr_disable(GAS_PEDAL_FORWARD_PIN);
+    gpio_intr_disable(GAS_PEDAL_BACKWARD_PIN);
+    wake_time = now;
+  }
+  #endif
+
+  if (drive_task_handle) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(drive_task_handle, &higher_priority_task_woken);
+    if (higher_priority_task_woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+static void pedal_settled(void *arg) {
+  xTaskNotifyGive(drive_task_handle);
+}
+#endif
+
+// Edge interrupts on the digital pedals, debounced for the drive task
+void setup_pedals() {
+  #if !WITH_ADC_THROTTLE
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    pedal_debounce_init(&pedals[i], !gpio_get_level(pedal_pins[i]), now);
+  }
+
+  const esp_timer_create_args_t timer_args = {
+    .callback = pedal_settled,
+    .name = "pedal_settle"
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &pedal_settle_timer));
+
+  // Pin interrupts are routed to the core that enables them, the drive task runs on this one
+  ESP_ERROR_CHECK(gpio_install_isr_service(0));
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    ESP_ERROR_CHECK(gpio_set_intr_type(pedal_pins[i], GPIO_INTR_ANYEDGE));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(pedal_pins[i], pedal_isr_handler, (void *)(intptr_t)i));
+    ESP_ERROR_CHECK(gpio_intr_enable(pedal_pins[i]));
+  }
+  #endif
+}
+
+// Let the clock go down and the chip light sleep while parked
+void setup_power_management() {
+  #if WITH_POWER_MANAGEMENT
+  esp_pm_config_esp32_t pm_config = {
+    .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+    .min_freq_mhz = PM_MIN_FREQ_MHZ,
+    .light_sleep_enable = true
+  };
+  esp_err_t ret = esp_pm_configure(&pm_config);
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "Power management unavailable (%s), check CONFIG_PM_ENABLE", esp_err_to_name(ret));
+  }
+
+  // Taken before the drive task starts, so the first ticks run at full speed
+  ret = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "driving", &driving_lock);
+  if (ret == ESP_OK) {
+    esp_pm_lock_acquire(driving_lock);
+  } else {
+    driving_lock = NULL;
+  }
+  #endif
+
+  #if WITH_PARKING
+  // The pedals pull the pins low, which wakes the chip up from light sleep once parked
+  ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+  #endif
+}
+
 // Setup LED channel to be used to generate PWM
 void setup_pwm() {
   ledc_channel_config_t ledc_channel_forward = {0}, ledc_channel_backward = {0};
@@ -246,21 +789,32 @@ void setup_pwm() {
 }
 
 void setup_driving(void) {
-  // Retrieve max values from storage
-  readFloat("max_forward", &max_forward, DEFAULT_FORWARD_MAX_SPEED);
-  readFloat("max_backward", &max_backward, DEFAULT_BACKWARD_MAX_SPEED);
+  // Retrieve the active driver profile from the settings
+  setup_driver_profiles();
 
   // Setup pins
   setup_pin();
 
+  #if WITH_ADC_THROTTLE
+  // Pedal calibration and response curve
+  load_throttle_settings();
+  #endif
+
   // Setup PWM
   setup_pwm();
 
+  // Setup the pedal interrupts
+  setup_pedals();
+
+  // Setup clock scaling and the pedal wake up
+  setup_power_management();
+
   // Listen to Websocket events
   register_callback(data_received);
 
   // Create a task with the higher priority for the driving task
-  xTaskCreate(&drive_task, "drive_task", 2048, NULL, 20, NULL);
+  // Pinned with the pedal interrupts it enables
+  xTaskCreatePinnedToCore(&drive_task, "drive_task", 2048, NULL, 20, &drive_task_handle, xPortGetCoreID());
 
   // Create a task with a lower priority to broadcast the current speed
   xTaskCreate(&broadcast_speed_task, "broadcast_speed_task", 2048, NULL, 5, NULL);
@@ -301,36 +855,93 @@ void send_values_to_motor(int speed) {
 
 // Return the targeted speed based on the pedal status.
 // It is a percentage between -100 and 100 (backward and forward)
-int get_speed_target(uint8_t forward_position, uint8_t backward_position) {
+int get_speed_target(const driver_profile_t *profile, uint8_t forward_position, uint8_t backward_position) {
+  // Integer only, positions and caps are both in %
+  int max_forward = profile->max_forward;
+  int max_backward = profile->max_backward;
+
   if ((!forward_position && !backward_position) ||
       (forward_position && backward_position)) {
     return 0;
   }
   
   if (forward_position) {
-    return min(max_forward, max_forward * (forward_position / 100.0f));
+    return max_forward * min(forward_position, 100) / 100;
   } 
 
   // Backward is negative values
-  return max(-max_backward, -max_backward * (backward_position / 100.0f));
+  return -(max_backward * min(backward_position, 100) / 100);
 }
 
-uint8_t get_throttle_position(uint8_t gpio) {
-  #if WITH_ADC_THROTTLE
-  adc_average = 0;
+#if WITH_ADC_THROTTLE
+// Average of a few samples, in mV
+uint32_t get_throttle_voltage(adc1_channel_t channel) {
+  uint32_t sum = 0;
+  uint32_t voltage = 0;
 
   for (int i = 0; i < 5; ++i) {
-    esp_adc_cal_get_voltage(gpio, &adc1_chars, &adc_voltage);
-    adc_average += adc_voltage;
+    esp_adc_cal_get_voltage(channel, &adc1_chars, &voltage);
+    sum += voltage;
   }
 
-  adc_average = adc_average / 5;
+  return sum / 5;
+}
+#endif
 
-  // voltage is between 1000mv and 2600mv
-  // 16 = (2600 - 1000) / 100
-  return min(100, max(0, (int8_t)((adc_average - 1000) / 16.0f)));
+// Pedal positions for the next tick, returns true if one changed since the last call.
+// Digital pedals are debounced, the drive task is woken up when a pending edge settles
+static bool read_pedals(int *forward_position, int *backward_position) {
+  #if WITH_ADC_THROTTLE
+  uint32_t voltages[PEDAL_COUNT];
+  int positions[PEDAL_COUNT];
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    voltages[i] = get_throttle_voltage(throttle_channels[i]);
+  }
+
+  portENTER_CRITICAL(&throttle_lock);
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    throttle_mv[i] = voltages[i];
+    if (throttle_calibrating) {
+      throttle_learn_sample(&throttle_learning[i], voltages[i]);
+      positions[i] = 0;
+    } else {
+      positions[i] = throttle_map_position(&throttle_maps[i], voltages[i]);
+    }
+  }
+  portEXIT_CRITICAL(&throttle_lock);
+
+  *forward_position = positions[PEDAL_FORWARD];
+  *backward_position = positions[PEDAL_BACKWARD];
+  return false;
   #else
-  return !gpio_get_level(gpio) ? 100 : 0;
+  int64_t now = esp_timer_get_time();
+  int64_t settle_us = 0;
+  int64_t changed_at = 0;
+  int positions[PEDAL_COUNT];
+
+  portENTER_CRITICAL(&pedals_lock);
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    int64_t left_us = pedal_debounce_update(&pedals[i], now, PEDAL_DEBOUNCE_US);
+    if (left_us && (!settle_us || left_us < settle_us)) {
+      settle_us = left_us;
+    }
+    positions[i] = pedals[i].pressed ? 100 : 0;
+    changed_at = max(changed_at, pedals[i].changed_at_us);
+  }
+  portEXIT_CRITICAL(&pedals_lock);
+
+  if (settle_us) {
+    esp_timer_stop(pedal_settle_timer);
+    esp_timer_start_once(pedal_settle_timer, settle_us);
+  }
+
+  bool changed = positions[PEDAL_FORWARD] != *forward_position || positions[PEDAL_BACKWARD] != *backward_position;
+  if (changed) {
+    pedal_changed_at = changed_at;
+  }
+  *forward_position = positions[PEDAL_FORWARD];
+  *backward_position = positions[PEDAL_BACKWARD];
+  return changed;
   #endif
 }
 
@@ -345,7 +956,11 @@ void blink_led_running(int speed) {
 }
 
 // Calculate next step for a smooth transition from current speed to targeted speed
-float compute_next_speed(float current, float target, float delta) {    
+float compute_next_speed(const driver_profile_t *profile, float current, float target, float delta) {
+  float speed_increment = profile->acceleration / 10.0f; // % of increment per loop
+  // Never weaker than the default, whatever was stored by an older firmware
+  float braking = fmaxf(1.0f, profile->braking / 100.0f);
+
   if (current < target) {
     // Slow down backward or speed up forward
 
@@ -359,10 +974,10 @@ float compute_next_speed(float current, float target, float delta) {
       // Slow down more aggressively if the car is moving quicker than 50%
       float slowdown_rate = current > 50 ? 0.08 : 0.04;
       // Safety! Slowing down backward, we must stop the car within a time frame
-      return current + delta * slowdown_rate;
+      return current + delta * slowdown_rate * braking;
     } else {
       // Else we update speed incrementaly
-      return current + SPEED_INCREMENT;
+      return current + speed_increment;
     }
 
     // Check if we went too far
@@ -380,10 +995,10 @@ float compute_next_speed(float current, float target, float delta) {
       // Slow down more aggressively if the car is moving quicker than 50%
       float slowdown_rate = current > 50 ? 0.08 : 0.04;
       // Safety! Slowing down forward, we must stop the car within a time frame
-      return current - delta * slowdown_rate;
+      return current - delta * slowdown_rate * braking;
     } else {
       // Else we update speed incrementaly
-      return current - SPEED_INCREMENT;
+      return current - speed_increment;
     }
 
     // Check if we went too far
@@ -412,9 +1027,82 @@ static void broadcast_speed_task(void *pvParameter) {
   }
 }
 
+#if WITH_PARKING
+// Switch the pedal interrupts between the wake up level while parked, and the edges
+static void set_pedals_parked(bool parked) {
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    gpio_intr_disable(pedal_pins[i]);
+  }
+  pedals_parked = parked;
+  for (int i = 0; i < PEDAL_COUNT; ++i) {
+    if (parked) {
+      // Only levels wake the chip up from light sleep
+      gpio_wakeup_enable(pedal_pins[i], GPIO_INTR_LOW_LEVEL);
+    } else {
+      gpio_wakeup_disable(pedal_pins[i]);
+      gpio_set_intr_type(pedal_pins[i], GPIO_INTR_ANYEDGE);
+    }
+    gpio_intr_enable(pedal_pins[i]);
+  }
+
+  if (!parked) {
+    // Catch up with the edges missed while switching
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < PEDAL_COUNT; ++i) {
+      bool pressed = !gpio_get_level(pedal_pins[i]);
+      portENTER_CRITICAL(&pedals_lock);
+      if (pressed != pedals[i].raw) {
+        pedal_debounce_edge(&pedals[i], pressed, now);
+      }
+      portEXIT_CRITICAL(&pedals_lock);
+    }
+  }
+}
+
+// Block until a pedal is pressed, or PARKED_POLL_MS at most.
+// Returns true if woken up by a pedal
+static bool wait_for_pedal(void) {
+  if (!power_stats.parked) {
+    power_stats.parked = true;
+    power_stats.parks++;
+    ESP_LOGI(TAG, "Parked, waiting for a pedal");
+  }
+
+  // Drop a notification left by a previous wake up
+  ulTaskNotifyTake(pdTRUE, 0);
+  wake_time = 0;
+  set_pedals_parked(true);
+
+  #if WITH_POWER_MANAGEMENT
+  if (driving_lock) {
+    esp_pm_lock_release(driving_lock);
+  }
+  #endif
+
+  bool woken = ulTaskNotifyTake(pdTRUE, PARKED_POLL_MS / portTICK_PERIOD_MS) > 0 && wake_time != 0;
+
+  // Full clock again before the next duty update
+  #if WITH_POWER_MANAGEMENT
+  if (driving_lock) {
+    esp_pm_lock_acquire(driving_lock);
+  }
+  #endif
+  set_pedals_parked(false);
+
+  if (woken) {
+    power_stats.wakes++;
+  }
+  return woken;
+}
+#endif
+
 // Task that drives the car
 static void drive_task(void *pvParameter) {
   int64_t last_update = esp_timer_get_time();
+  #if WITH_PARKING
+  int64_t last_activity = last_update;
+  #endif
+  TickType_t next_tick = xTaskGetTickCount();
   float delta;
 
   int forward_position = 0;
@@ -422,6 +1110,8 @@ static void drive_task(void *pvParameter) {
 
   int target = 0;
 
+  driver_profile_t profile;
+
   while (true) {
     // Manage emergency stop
     if (emergency_stop) {
@@ -437,29 +1127,76 @@ static void drive_task(void *pvParameter) {
       continue;
     }
 
-    // Update pedal & direction status
-    forward_position = get_throttle_position(GAS_PEDAL_FORWARD_PIN);
-    backward_position = get_throttle_position(GAS_PEDAL_BACKWARD_PIN);
+    // Update pedal & direction status. Pedal edges wake the task up early,
+    // a change is applied right away and the next ticks follow from there
+    bool pedal_changed = read_pedals(&forward_position, &backward_position);
+    TickType_t ticks_left = next_tick - xTaskGetTickCount();
+    if (!pedal_changed && (int32_t)ticks_left > 0) {
+      ulTaskNotifyTake(pdTRUE, ticks_left);
+      continue;
+    }
+
+    // Profile switches apply from the next tick
+    driver_profile_get_active(&profile);
 
     // Update targeted speed accordingly
-    target = get_speed_target(forward_position, backward_position);
+    target = get_speed_target(&profile, forward_position, backward_position);
 
     // Take into account a loop could take more than expected
     // This is used to slow down within a fixed timeframe, regardless of the loop duration
     delta = (esp_timer_get_time() - last_update) / 1000;
 
     // Compute next speed based on current speed and targeted speed
-    current_speed = compute_next_speed(current_speed, target, delta);
+    current_speed = compute_next_speed(&profile, current_speed, target, delta);
 
     // Send value to the motor
     send_values_to_motor(current_speed);
 
     last_update = esp_timer_get_time();
 
+    #if WITH_PARKING
+    // First duty update of the pedal change that woke the car up, once debounced.
+    // A bounce that woke it up and settled back isn't counted
+    if (wake_time && pedal_changed) {
+      if (pedal_changed_at <= wake_time) {
+        int64_t latency = last_update - wake_time;
+        power_stats.last_wake_latency_us = latency;
+        power_stats.max_wake_latency_us = max(power_stats.max_wake_latency_us, latency);
+        ESP_LOGD(TAG, "Woken up in %lld us", latency);
+      }
+      wake_time = 0;
+    }
+    #endif
+
+    #if !WITH_ADC_THROTTLE
+    if (pedal_changed) {
+      last_pedal_response_us = last_update - pedal_changed_at;
+      max_pedal_response_us = max(max_pedal_response_us, last_pedal_response_us);
+    }
+    #endif
+
     // Blink embedded led to have some visible status of the speed
     blink_led_running(current_speed);
 
-    vTaskDelay(20 / portTICK_PERIOD_MS);
+    #if WITH_PARKING
+    if (forward_position || backward_position || current_speed != 0) {
+      last_activity = last_update;
+      power_stats.parked = false;
+    }
+
+    if (last_update - last_activity >= PARKED_DELAY_MS * 1000LL) {
+      if (wait_for_pedal()) {
+        last_activity = esp_timer_get_time();
+      }
+      // The parked time isn't a slow loop. The pedal is read right away, and
+      // its change applied once debounced, when the settle timer fires
+      last_update = esp_timer_get_time();
+      next_tick = xTaskGetTickCount() + DRIVE_LOOP_MS / portTICK_PERIOD_MS;
+      continue;
+    }
+    #endif
+
+    next_tick = xTaskGetTickCount() + DRIVE_LOOP_MS / portTICK_PERIOD_MS;
   }
 }
 
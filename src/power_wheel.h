@@ -1,6 +1,31 @@
 #ifndef POWER_WEEL_H
 #define POWER_WEEL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// Snapshot of the vehicle state, shared with the telemetry publishers
+typedef struct {
+  float current_speed;
+  float max_forward;
+  float max_backward;
+  bool emergency_stop;
+  int32_t supply_current_ma; // -1 without current sensor
+} vehicle_state_t;
+
+// Time spent waking up from the pedals once parked
+typedef struct {
+  bool parked;
+  uint32_t parks;
+  uint32_t wakes;
+  int64_t last_wake_latency_us; // From the pedal interrupt to the duty update applying the debounced press
+  int64_t max_wake_latency_us;
+} power_stats_t;
+
 void setup_driving(void);
 
+void get_vehicle_state(vehicle_state_t *state);
+
+void get_power_stats(power_stats_t *stats);
+
 #endif
@@ -0,0 +1,158 @@
+#include "radio_profile.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "power_wheel.h"
+#include "websocket.h"
+#include "cJSON.h"
+
+static const char *TAG = "radio";
+
+#define RADIO_PROFILE_INTERVAL_MS 500
+// Standing still for this long means parked, moving switches back at once
+#define RADIO_PARKED_DELAY_MS (30*1000)
+
+typedef struct {
+  const char *name;
+  wifi_ps_type_t power_save;
+  int8_t tx_power; // In 0.25 dBm, from 8 (2 dBm) to 84 (21 dBm)
+} radio_settings_t;
+
+// Power save only affects the station interface, used by the channel scans;
+// the access point itself is tuned through its TX power
+static const radio_settings_t profiles[RADIO_PROFILE_COUNT] = {
+  [RADIO_PROFILE_DRIVING] = { "driving", WIFI_PS_NONE, 78 }, // 19.5 dBm
+  [RADIO_PROFILE_PARKED] = { "parked", WIFI_PS_MAX_MODEM, 34 }, // 8.5 dBm, a phone next to the car
+};
+
+// Variables in memory
+
+static radio_status_t status = { .profile = RADIO_PROFILE_DRIVING, .automatic = true };
+// Forced profile, applied by the task
+static volatile radio_profile_t requested_profile = RADIO_PROFILE_DRIVING;
+static volatile bool requested_automatic = true;
+
+// Implementations
+
+const char* radio_profile_name(radio_profile_t profile) {
+  return profile < RADIO_PROFILE_COUNT ? profiles[profile].name : "unknown";
+}
+
+static void apply_profile(radio_profile_t profile) {
+  const radio_settings_t *settings = &profiles[profile];
+
+  esp_err_t ret = esp_wifi_set_ps(settings->power_save);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set power save (%s)", esp_err_to_name(ret));
+  }
+  ret = esp_wifi_set_max_tx_power(settings->tx_power);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set TX power (%s)", esp_err_to_name(ret));
+  }
+
+  // The driver rounds to the supported levels
+  int8_t tx_power = settings->tx_power;
+  esp_wifi_get_max_tx_power(&tx_power);
+
+  status.profile = profile;
+  status.tx_power = tx_power;
+  status.switches++;
+  ESP_LOGI(TAG, "Radio profile %s, TX power %.2f dBm", settings->name, tx_power / 4.0f);
+}
+
+void radio_profile_get_status(radio_status_t *result) {
+  *result = status;
+}
+
+// Broadcast the radio profile
+// {
+//   "radio_profile": { "profile": "parked", "automatic": true, "tx_power_dbm": 8.5, "switches": 3 }
+// }
+static void broadcast_status(void) {
+  char message[128];
+  snprintf(message, sizeof(message),
+    "{\"radio_profile\":{\"profile\":\"%s\",\"automatic\":%s,\"tx_power_dbm\":%.2f,\"switches\":%u}}",
+    radio_profile_name(status.profile), status.automatic ? "true" : "false", status.tx_power / 4.0f, status.switches);
+  broadcast_message(message);
+}
+
+// Manage commands from web sockets
+// - Read the radio profile, or force one, "auto" follows the vehicle state
+// { "command": "radio_profile", "parameters": { "profile": "auto" | "driving" | "parked" } }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return;
+  }
+
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (!cJSON_IsString(command) || strcmp("radio_profile", command->valuestring) != 0) {
+    goto end;
+  }
+
+  cJSON *parameters = cJSON_GetObjectItem(root, "parameters");
+  cJSON *profile = parameters ? cJSON_GetObjectItem(parameters, "profile") : NULL;
+  if (cJSON_IsString(profile)) {
+    if (strcmp("auto", profile->valuestring) == 0) {
+      requested_automatic = true;
+    } else {
+      for (int i = 0; i < RADIO_PROFILE_COUNT; ++i) {
+        if (strcmp(profiles[i].name, profile->valuestring) == 0) {
+          requested_profile = i;
+          requested_automatic = false;
+        }
+      }
+    }
+  }
+
+  broadcast_status();
+
+end:
+  cJSON_Delete(root);
+}
+
+// Low priority task following the vehicle state
+static void radio_profile_task(void *pvParameter) {
+  int64_t last_moving = esp_timer_get_time();
+
+  while (true) {
+    vehicle_state_t state;
+    get_vehicle_state(&state);
+
+    int64_t now = esp_timer_get_time();
+    if (state.current_speed != 0) {
+      last_moving = now;
+    }
+
+    radio_profile_t profile;
+    status.automatic = requested_automatic;
+    if (status.automatic) {
+      profile = now - last_moving >= RADIO_PARKED_DELAY_MS * 1000LL ? RADIO_PROFILE_PARKED : RADIO_PROFILE_DRIVING;
+    } else {
+      profile = requested_profile;
+    }
+
+    if (profile != status.profile) {
+      apply_profile(profile);
+      broadcast_status();
+    }
+
+    vTaskDelay(RADIO_PROFILE_INTERVAL_MS / portTICK_PERIOD_MS);
+  }
+}
+
+void setup_radio_profiles(void) {
+  // Boots ready to drive
+  apply_profile(RADIO_PROFILE_DRIVING);
+  status.switches = 0;
+
+  register_callback(data_received);
+
+  xTaskCreate(&radio_profile_task, "radio_profile_task", 2560, NULL, 1, NULL);
+}
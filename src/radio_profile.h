@@ -0,0 +1,30 @@
+#ifndef RADIO_PROFILE_H
+#define RADIO_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Radio settings following the vehicle state: full power while driving for
+// the lowest latency, reduced when parked to save the battery
+
+typedef enum {
+  RADIO_PROFILE_DRIVING,
+  RADIO_PROFILE_PARKED,
+  RADIO_PROFILE_COUNT
+} radio_profile_t;
+
+typedef struct {
+  radio_profile_t profile;
+  // False when forced from the dashboard
+  bool automatic;
+  int8_t tx_power; // Applied, in 0.25 dBm
+  uint32_t switches;
+} radio_status_t;
+
+void setup_radio_profiles(void);
+
+void radio_profile_get_status(radio_status_t *status);
+
+const char* radio_profile_name(radio_profile_t profile);
+
+#endif
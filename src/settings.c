@@ -0,0 +1,318 @@
+#include "settings.h"
+
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+
+#include "storage.h"
+#include "websocket.h"
+#include "cJSON.h"
+#include "utils.h"
+
+static const char *TAG = "settings";
+
+#define SETTINGS_NAMESPACE "settings"
+#define SETTINGS_KEY "settings"
+
+// Changes are written once stable for SETTINGS_DEBOUNCE_MS, a slider being
+// dragged commits once, but never later than SETTINGS_MAX_DELAY_MS
+#define SETTINGS_DEBOUNCE_MS 1000
+#define SETTINGS_MAX_DELAY_MS 5000
+
+// Record stored in NVS, the CRC always ends the blob
+typedef struct __attribute__((__packed__)) {
+  uint16_t version;
+  uint16_t size; // Of the settings
+  settings_t settings;
+  // Of the fields above
+  uint32_t crc;
+} settings_record_t;
+#define RECORD_OVERHEAD (sizeof(settings_record_t) - sizeof(settings_t))
+
+// Settings of version 1, before the driver profiles
+typedef struct {
+  float max_forward;
+  float max_backward;
+} settings_v1_t;
+
+// Variables in memory
+
+static settings_t current;
+static bool dirty = false;
+static settings_stats_t stats;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Serialize the writes of the task and of the shutdown handler
+static SemaphoreHandle_t flush_lock = NULL;
+static TaskHandle_t settings_task_handle = NULL;
+static nvs_handle_t handle;
+
+// Implementations
+
+static uint32_t record_crc(const settings_record_t *record) {
+  return esp_rom_crc32_le(0, (const uint8_t*)record, offsetof(settings_record_t, crc));
+}
+
+// Speed caps of the old firmwares go to the active profile
+static void migrate_speed_caps(settings_t *settings, float max_forward, float max_backward) {
+  driver_profile_t *profile = &settings->profiles[settings->active_profile];
+  profile->max_forward = min(100, max(0, lroundf(max_forward)));
+  profile->max_backward = min(100, max(0, lroundf(max_backward)));
+}
+
+static bool is_valid(const settings_t *settings) {
+  return settings->profile_count > 0 && settings->profile_count <= DRIVER_PROFILES_MAX &&
+    settings->active_profile < settings->profile_count;
+}
+
+// outdated is set when the record has to be written again in the current version
+static bool load_record(settings_t *settings, bool *outdated) {
+  uint8_t blob[sizeof(settings_record_t)];
+  size_t size = sizeof(blob);
+
+  // Records larger than the current version are reported as an invalid length
+  if (nvs_get_blob(handle, SETTINGS_KEY, blob, &size) != ESP_OK || size < RECORD_OVERHEAD) {
+    return false;
+  }
+
+  uint16_t version, payload_size;
+  uint32_t crc;
+  memcpy(&version, blob + offsetof(settings_record_t, version), sizeof(version));
+  memcpy(&payload_size, blob + offsetof(settings_record_t, size), sizeof(payload_size));
+  memcpy(&crc, blob + size - sizeof(crc), sizeof(crc));
+  if (payload_size != size - RECORD_OVERHEAD || crc != esp_rom_crc32_le(0, blob, size - sizeof(crc))) {
+    ESP_LOGE(TAG, "Corrupted settings");
+    return false;
+  }
+
+  const uint8_t *payload = blob + offsetof(settings_record_t, settings);
+  if (version >= 2 && version <= SETTINGS_VERSION && payload_size <= sizeof(settings_t)) {
+    // Appended fields keep their default
+    settings_t loaded = *settings;
+    memcpy(&loaded, payload, payload_size);
+    if (!is_valid(&loaded)) {
+      ESP_LOGE(TAG, "Invalid settings");
+      return false;
+    }
+    *settings = loaded;
+    *outdated = version != SETTINGS_VERSION || payload_size != sizeof(settings_t);
+    return true;
+  }
+  if (version == 1 && payload_size == sizeof(settings_v1_t)) {
+    settings_v1_t loaded;
+    memcpy(&loaded, payload, sizeof(loaded));
+    migrate_speed_caps(settings, loaded.max_forward, loaded.max_backward);
+    *outdated = true;
+    return true;
+  }
+
+  ESP_LOGW(TAG, "Dropped settings of version %d", version);
+  return false;
+}
+
+esp_err_t settings_flush(void) {
+  if (flush_lock == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  xSemaphoreTake(flush_lock, portMAX_DELAY);
+
+  settings_record_t record = {
+    .version = SETTINGS_VERSION,
+    .size = sizeof(settings_t),
+  };
+
+  portENTER_CRITICAL(&lock);
+  bool has_changes = dirty;
+  record.settings = current;
+  dirty = false;
+  stats.pending = false;
+  portEXIT_CRITICAL(&lock);
+
+  esp_err_t ret = ESP_OK;
+  if (has_changes) {
+    record.crc = record_crc(&record);
+
+    int64_t start = esp_timer_get_time();
+    ret = nvs_set_blob(handle, SETTINGS_KEY, &record, sizeof(record));
+    if (ret == ESP_OK) {
+      ret = nvs_commit(handle);
+    }
+    uint32_t duration = esp_timer_get_time() - start;
+
+    portENTER_CRITICAL(&lock);
+    if (ret == ESP_OK) {
+      stats.commits++;
+      stats.last_flush_us = duration;
+      stats.max_flush_us = duration > stats.max_flush_us ? duration : stats.max_flush_us;
+    } else {
+      // Kept for the next flush
+      stats.failures++;
+      dirty = true;
+      stats.pending = true;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (ret == ESP_OK) {
+      ESP_LOGI(TAG, "Settings written in %d µs", duration);
+    } else {
+      ESP_LOGE(TAG, "Failed to write settings (%s)", esp_err_to_name(ret));
+    }
+  }
+
+  xSemaphoreGive(flush_lock);
+  return ret;
+}
+
+void settings_get(settings_t *settings) {
+  portENTER_CRITICAL(&lock);
+  *settings = current;
+  portEXIT_CRITICAL(&lock);
+}
+
+// Called under the lock
+static void mark_dirty(void) {
+  dirty = true;
+  stats.pending = true;
+  stats.updates++;
+}
+
+static void notify_change(void) {
+  if (settings_task_handle != NULL) {
+    xTaskNotifyGive(settings_task_handle);
+  }
+}
+
+void settings_update(const settings_t *settings) {
+  portENTER_CRITICAL(&lock);
+  settings_t updated = *settings;
+  updated.wifi_channel = current.wifi_channel;
+  bool changed = memcmp(&current, &updated, sizeof(settings_t)) != 0;
+  if (changed) {
+    current = updated;
+    mark_dirty();
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (changed) {
+    notify_change();
+  }
+}
+
+void settings_set_wifi_channel(uint8_t channel) {
+  portENTER_CRITICAL(&lock);
+  bool changed = current.wifi_channel != channel;
+  if (changed) {
+    current.wifi_channel = channel;
+    mark_dirty();
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (changed) {
+    notify_change();
+  }
+}
+
+void settings_get_stats(settings_stats_t *result) {
+  portENTER_CRITICAL(&lock);
+  *result = stats;
+  portEXIT_CRITICAL(&lock);
+}
+
+// Broadcast flash activity
+// {
+//   "settings_stats": { "updates": 12, "commits": 2, "failures": 0, "last_flush_us": 8000, "max_flush_us": 12000, "pending": false }
+// }
+static void broadcast_stats(void) {
+  settings_stats_t current_stats;
+  settings_get_stats(&current_stats);
+
+  char *message;
+  asprintf(&message, "{\"settings_stats\":{\"updates\":%u,\"commits\":%u,\"failures\":%u,\"last_flush_us\":%u,\"max_flush_us\":%u,\"pending\":%s}}",
+    current_stats.updates, current_stats.commits, current_stats.failures,
+    current_stats.last_flush_us, current_stats.max_flush_us, current_stats.pending ? "true" : "false");
+  broadcast_message(message);
+  free(message);
+}
+
+// Manage commands from web sockets
+// - Read flash activity
+// { "command": "settings_stats" }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return;
+  }
+
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (cJSON_IsString(command) && strcmp("settings_stats", command->valuestring) == 0) {
+    broadcast_stats();
+  }
+
+  cJSON_Delete(root);
+}
+
+// Task writing the settings once they stop changing
+static void settings_task(void *pvParameter) {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Coalesce the following changes
+    int64_t first_change = esp_timer_get_time();
+    while (ulTaskNotifyTake(pdTRUE, SETTINGS_DEBOUNCE_MS / portTICK_PERIOD_MS) != 0 &&
+           esp_timer_get_time() - first_change < SETTINGS_MAX_DELAY_MS * 1000LL) {
+    }
+
+    settings_flush();
+  }
+}
+
+// Pending changes are written before restarting, like after an OTA update
+static void shutdown_handler(void) {
+  settings_flush();
+}
+
+void setup_settings(void) {
+  driver_profile_t default_profiles[] = DRIVER_PROFILE_DEFAULTS;
+  memcpy(current.profiles, default_profiles, sizeof(default_profiles));
+  current.profile_count = DRIVER_PROFILE_DEFAULTS_COUNT;
+  current.active_profile = 0;
+  current.wifi_channel = 0;
+  current.throttle = (throttle_settings_t)THROTTLE_SETTINGS_DEFAULTS;
+
+  esp_err_t ret = nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &handle);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle, settings won't be saved", esp_err_to_name(ret));
+    return;
+  }
+
+  bool migrate = false;
+  if (!load_record(&current, &migrate)) {
+    // Values stored by the first firmwares, one blob per key
+    float max_forward, max_backward;
+    if (readFloat("max_forward", &max_forward, 0) == ESP_OK && readFloat("max_backward", &max_backward, 0) == ESP_OK) {
+      migrate_speed_caps(&current, max_forward, max_backward);
+    }
+    migrate = true;
+  }
+
+  flush_lock = xSemaphoreCreateMutex();
+  xTaskCreate(&settings_task, "settings_task", 2048, NULL, 2, &settings_task_handle);
+
+  if (migrate) {
+    // Stored as a record from now on
+    dirty = true;
+    stats.pending = true;
+    xTaskNotifyGive(settings_task_handle);
+  }
+  esp_register_shutdown_handler(shutdown_handler);
+
+  register_callback(data_received);
+}
@@ -0,0 +1,54 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "driver_profile.h"
+#include "throttle_curve.h"
+
+// Bump when the layout of settings_t changes. Fields are only appended since
+// version 2, the missing ones of older settings keep their default
+#define SETTINGS_VERSION 4
+
+// Settings surviving restarts, stored as a single CRC protected record in NVS
+typedef struct {
+  driver_profile_t profiles[DRIVER_PROFILES_MAX];
+  uint8_t profile_count;
+  uint8_t active_profile;
+  // softAP channel, 0 until a scan picked one
+  uint8_t wifi_channel;
+  // Analog pedal calibration and response curve
+  throttle_settings_t throttle;
+} settings_t;
+
+// Flash activity since boot
+typedef struct {
+  uint32_t updates;
+  uint32_t commits;
+  uint32_t failures;
+  // Duration of the NVS write and commit, in µs
+  uint32_t last_flush_us;
+  uint32_t max_flush_us;
+  bool pending;
+} settings_stats_t;
+
+// Load the settings, defaults are used if missing or invalid
+void setup_settings(void);
+
+void settings_get(settings_t *settings);
+
+// Change the settings in RAM, they are written once unchanged for a while.
+// The Wi-Fi channel is left alone: the scan task sets it while the httpd task
+// changes the rest, the copy read before may already be outdated
+void settings_update(const settings_t *settings);
+
+void settings_set_wifi_channel(uint8_t channel);
+
+// Write pending changes now
+esp_err_t settings_flush(void);
+
+void settings_get_stats(settings_stats_t *stats);
+
+#endif
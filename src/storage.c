@@ -23,16 +23,9 @@ void setup_storage(void) {
   }
 }
 
+// Values of the firmwares before settings.c, read once to migrate them
 esp_err_t readFloat(char* key, float *value, float defaultValue) {
   *value = defaultValue;
   size_t required_size = 4;
   return nvs_get_blob(storage, key, value, &required_size);
 }
-
-esp_err_t writeFloat(char* key, float value) {
-  ESP_LOGI("Storage", "Store value %f for key %s", value, key);
-  esp_err_t ret = nvs_set_blob(storage, key, &value, sizeof(float));
-  if (ret != ESP_OK) return ret;
-
-  return nvs_commit(storage);
-}
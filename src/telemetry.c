@@ -0,0 +1,168 @@
+#include "telemetry.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+
+#include "websocket.h"
+#include "power_wheel.h"
+#include "radio_profile.h"
+#include "cJSON.h"
+#include "utils.h"
+
+static const char *TAG = "telemetry";
+
+// Optional UDP stream of the vehicle state, next to the websocket broadcast.
+// Datagrams are independent, a lost one never delays the next one.
+
+#define UDP_TELEMETRY_PORT 4210
+#define DEFAULT_UDP_TELEMETRY_RATE_HZ 20
+#define MAX_UDP_TELEMETRY_RATE_HZ 50 // Bounded by the FreeRTOS tick (100Hz)
+
+// Variables in memory
+
+static bool telemetry_enabled = false;
+// 0 means broadcast on the AP subnet
+static uint32_t telemetry_destination = 0;
+static int telemetry_rate_hz = DEFAULT_UDP_TELEMETRY_RATE_HZ;
+static uint32_t telemetry_sequence = 0;
+
+// Broadcast address of the softAP subnet, in network order
+static uint32_t get_ap_broadcast_address(void) {
+  esp_netif_ip_info_t ip_info;
+  if (esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey("WIFI_AP_DEF"), &ip_info) != ESP_OK) {
+    return htonl(INADDR_BROADCAST);
+  }
+  return ip_info.ip.addr | ~ip_info.netmask.addr;
+}
+
+// Worst RTT of the dashboards, the link quality as felt by the driver
+static uint16_t get_worst_rtt(void) {
+  websocket_client_stats_t clients[4];
+  int count = websocket_get_client_stats(clients, 4);
+
+  uint32_t worst = 0;
+  for (int i = 0; i < count; ++i) {
+    worst = max(worst, clients[i].rtt_ms);
+  }
+  return min(worst, (uint32_t)UINT16_MAX);
+}
+
+static void fill_datagram(telemetry_datagram_t *datagram) {
+  vehicle_state_t state;
+  get_vehicle_state(&state);
+
+  radio_status_t radio;
+  radio_profile_get_status(&radio);
+
+  datagram->magic = TELEMETRY_MAGIC;
+  datagram->version = TELEMETRY_VERSION;
+  datagram->flags = state.emergency_stop ? TELEMETRY_FLAG_EMERGENCY_STOP : 0;
+  datagram->sequence = telemetry_sequence++;
+  datagram->timestamp_us = esp_timer_get_time();
+  datagram->current_speed = state.current_speed;
+  datagram->max_forward = state.max_forward;
+  datagram->max_backward = state.max_backward;
+  datagram->radio_profile = radio.profile;
+  datagram->tx_power = radio.tx_power;
+  datagram->rtt_ms = get_worst_rtt();
+  datagram->supply_current_ma = state.supply_current_ma;
+}
+
+// Manage commands from web sockets
+// - Configure the UDP stream, address and rate_hz are optional
+// { "command": "udp_telemetry", "parameters": { "enabled": bool, "address": "192.168.4.2", "rate_hz": 20 } }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return;
+  }
+
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (!cJSON_IsString(command) || strcmp("udp_telemetry", command->valuestring) != 0) {
+    goto end;
+  }
+
+  cJSON *parameters = cJSON_GetObjectItem(root, "parameters");
+  if (parameters == NULL) {
+    goto end;
+  }
+
+  cJSON *enabled = cJSON_GetObjectItem(parameters, "enabled");
+  cJSON *address = cJSON_GetObjectItem(parameters, "address");
+  cJSON *rate_hz = cJSON_GetObjectItem(parameters, "rate_hz");
+  if (!cJSON_IsBool(enabled)) {
+    goto end;
+  }
+
+  if (cJSON_IsString(address)) {
+    struct in_addr destination;
+    if (inet_aton(address->valuestring, &destination) == 0) {
+      ESP_LOGE(TAG, "Invalid address %s", address->valuestring);
+      goto end;
+    }
+    telemetry_destination = destination.s_addr;
+  } else {
+    telemetry_destination = 0;
+  }
+
+  if (cJSON_IsNumber(rate_hz)) {
+    telemetry_rate_hz = min(MAX_UDP_TELEMETRY_RATE_HZ, max(1, rate_hz->valueint));
+  }
+
+  telemetry_enabled = cJSON_IsTrue(enabled);
+  ESP_LOGI(TAG, "UDP telemetry %s at %d Hz", telemetry_enabled ? "enabled" : "disabled", telemetry_rate_hz);
+
+end:
+  cJSON_Delete(root);
+}
+
+// Task to send the vehicle state over UDP at a fixed rate
+static void udp_telemetry_task(void *pvParameter) {
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+  if (sock < 0) {
+    ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  int broadcast = 1;
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
+  struct sockaddr_in dest_addr = {0};
+  dest_addr.sin_family = AF_INET;
+  dest_addr.sin_port = htons(UDP_TELEMETRY_PORT);
+
+  telemetry_datagram_t datagram;
+
+  while (true) {
+    if (telemetry_enabled) {
+      dest_addr.sin_addr.s_addr = telemetry_destination ? telemetry_destination : get_ap_broadcast_address();
+
+      fill_datagram(&datagram);
+
+      // Best effort, a dropped datagram is accounted on the receiver side
+      if (sendto(sock, &datagram, sizeof(datagram), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) < 0) {
+        ESP_LOGD(TAG, "sendto failed: errno %d", errno);
+      }
+    }
+
+    vTaskDelay((1000 / telemetry_rate_hz) / portTICK_PERIOD_MS);
+  }
+}
+
+void setup_telemetry(void) {
+  // Listen to Websocket events
+  register_callback(data_received);
+
+  // Same priority as the websocket speed broadcast
+  xTaskCreate(&udp_telemetry_task, "udp_telemetry_task", 2560, NULL, 5, NULL);
+}
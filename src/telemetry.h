@@ -0,0 +1,30 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+// Binary vehicle state datagram sent over UDP, little endian
+// Decoded by tools/telemetry_listener.py, keep both in sync
+#define TELEMETRY_MAGIC 0x4A50 // "PJ"
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_FLAG_EMERGENCY_STOP (1 << 0)
+
+typedef struct __attribute__((__packed__)) {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint32_t sequence;
+  uint64_t timestamp_us;
+  float current_speed;
+  float max_forward;
+  float max_backward;
+  // Since version 2
+  uint8_t radio_profile; // radio_profile_t
+  int8_t tx_power; // 0.25 dBm
+  uint16_t rtt_ms; // Worst websocket RTT reported by the dashboards, 0 if none
+  int32_t supply_current_ma; // -1 without current sensor
+} telemetry_datagram_t;
+
+void setup_telemetry(void);
+
+#endif
@@ -0,0 +1,120 @@
+#include "throttle_curve.h"
+
+#include <stdlib.h>
+
+// Released pedals still read a bit above their rest voltage, and some never
+// quite reach the end of their travel: the learnt range is narrowed by these
+#define IDLE_DEADBAND_PERCENT 5
+#define FULL_MARGIN_PERCENT 3
+// What is left of the shortest travel accepted, once narrowed
+#define MIN_CALIBRATED_SPAN_MV (THROTTLE_MIN_SPAN_MV * (100 - IDLE_DEADBAND_PERCENT - FULL_MARGIN_PERCENT) / 100)
+
+// Implementations
+
+bool throttle_calibration_valid(const throttle_calibration_t *calibration) {
+  return calibration->idle_mv <= THROTTLE_MAX_MV && calibration->full_mv <= THROTTLE_MAX_MV &&
+    abs((int32_t)calibration->full_mv - calibration->idle_mv) >= MIN_CALIBRATED_SPAN_MV;
+}
+
+void throttle_curve_sanitize(throttle_curve_t *curve) {
+  if (curve->type > THROTTLE_CURVE_CUSTOM) {
+    curve->type = THROTTLE_CURVE_LINEAR;
+  }
+  uint8_t previous = 0;
+  for (int i = 0; i < THROTTLE_CURVE_POINTS; ++i) {
+    if (curve->points[i] > THROTTLE_POSITION_MAX) {
+      curve->points[i] = THROTTLE_POSITION_MAX;
+    }
+    if (curve->points[i] < previous) {
+      curve->points[i] = previous;
+    }
+    previous = curve->points[i];
+  }
+}
+
+// Position for a travel between 0 and THROTTLE_LUT_STEPS, rounded
+static uint8_t curve_position(const throttle_curve_t *curve, int32_t travel) {
+  switch (curve->type) {
+    case THROTTLE_CURVE_PROGRESSIVE: {
+      int32_t square = travel * travel * THROTTLE_POSITION_MAX;
+      int32_t steps_square = THROTTLE_LUT_STEPS * THROTTLE_LUT_STEPS;
+      return (square + steps_square / 2) / steps_square;
+    }
+    case THROTTLE_CURVE_CUSTOM: {
+      // Linear between the points
+      int32_t segment_steps = THROTTLE_LUT_STEPS / (THROTTLE_CURVE_POINTS - 1);
+      int32_t segment = travel / segment_steps;
+      if (segment >= THROTTLE_CURVE_POINTS - 1) {
+        return curve->points[THROTTLE_CURVE_POINTS - 1];
+      }
+      int32_t from = curve->points[segment];
+      int32_t to = curve->points[segment + 1];
+      int32_t offset = travel - segment * segment_steps;
+      return from + ((to - from) * offset + segment_steps / 2) / segment_steps;
+    }
+    case THROTTLE_CURVE_LINEAR:
+    default:
+      return (travel * THROTTLE_POSITION_MAX + THROTTLE_LUT_STEPS / 2) / THROTTLE_LUT_STEPS;
+  }
+}
+
+void throttle_map_build(throttle_map_t *map, const throttle_calibration_t *calibration, const throttle_curve_t *curve) {
+  throttle_settings_t defaults = THROTTLE_SETTINGS_DEFAULTS;
+  if (!throttle_calibration_valid(calibration)) {
+    calibration = &defaults.forward;
+  }
+
+  map->idle_mv = calibration->idle_mv;
+  map->span_mv = (int32_t)calibration->full_mv - calibration->idle_mv;
+  for (int32_t travel = 0; travel <= THROTTLE_LUT_STEPS; ++travel) {
+    map->lut[travel] = curve_position(curve, travel);
+  }
+}
+
+uint8_t throttle_map_position(const throttle_map_t *map, uint32_t millivolts) {
+  // Signed, so that readings below the idle voltage don't wrap
+  int32_t travel = ((int32_t)millivolts - map->idle_mv) * THROTTLE_LUT_STEPS / map->span_mv;
+  if (travel < 0) {
+    travel = 0;
+  } else if (travel > THROTTLE_LUT_STEPS) {
+    travel = THROTTLE_LUT_STEPS;
+  }
+  return map->lut[travel];
+}
+
+void throttle_learn_start(throttle_learn_t *learn, uint32_t millivolts) {
+  learn->rest_mv = millivolts;
+  learn->min_mv = millivolts;
+  learn->max_mv = millivolts;
+}
+
+void throttle_learn_sample(throttle_learn_t *learn, uint32_t millivolts) {
+  if (millivolts < learn->min_mv) {
+    learn->min_mv = millivolts;
+  }
+  if (millivolts > learn->max_mv) {
+    learn->max_mv = millivolts;
+  }
+}
+
+bool throttle_learn_finish(const throttle_learn_t *learn, throttle_calibration_t *calibration) {
+  // The end the pedal rested at is the idle one, whichever way the voltage goes
+  bool inverted = learn->rest_mv - learn->min_mv > learn->max_mv - learn->rest_mv;
+  int32_t idle = inverted ? learn->max_mv : learn->min_mv;
+  int32_t full = inverted ? learn->min_mv : learn->max_mv;
+  int32_t span = full - idle;
+  // On the raw travel, before it is narrowed
+  if (abs(span) < THROTTLE_MIN_SPAN_MV) {
+    return false;
+  }
+
+  throttle_calibration_t learnt = {
+    .idle_mv = idle + span * IDLE_DEADBAND_PERCENT / 100,
+    .full_mv = full - span * FULL_MARGIN_PERCENT / 100,
+  };
+  if (!throttle_calibration_valid(&learnt)) {
+    return false;
+  }
+  *calibration = learnt;
+  return true;
+}
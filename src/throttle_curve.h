@@ -0,0 +1,84 @@
+#ifndef THROTTLE_CURVE_H
+#define THROTTLE_CURVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Mapping of an analog pedal voltage to a throttle position, through its
+// calibration and a response curve precomputed into a lookup table. No
+// ESP-IDF dependency, so that the curves can be checked on a host.
+
+#define THROTTLE_POSITION_MAX 100 // %
+// Resolution of the pedal travel in the lookup table
+#define THROTTLE_LUT_STEPS 128
+// Custom curves give the position at evenly spaced travels, from released to fully pressed
+#define THROTTLE_CURVE_POINTS 5
+// A calibration must see at least this much between released and fully pressed,
+// before the learnt range is narrowed by the deadbands
+#define THROTTLE_MIN_SPAN_MV 300
+#define THROTTLE_MAX_MV 3300
+
+typedef enum {
+  THROTTLE_CURVE_LINEAR = 0,
+  THROTTLE_CURVE_PROGRESSIVE, // Finer at low speed, position grows with the square of the travel
+  THROTTLE_CURVE_CUSTOM,
+} throttle_curve_type_t;
+
+// Voltages at both ends of the travel, full_mv is lower than idle_mv on inverted pedals
+typedef struct {
+  uint16_t idle_mv;
+  uint16_t full_mv;
+} throttle_calibration_t;
+
+typedef struct {
+  uint8_t type; // throttle_curve_type_t
+  uint8_t points[THROTTLE_CURVE_POINTS]; // Custom curve only, non decreasing %
+} throttle_curve_t;
+
+// Stored as is in the settings
+typedef struct {
+  throttle_calibration_t forward;
+  throttle_calibration_t backward;
+  throttle_curve_t curve;
+} throttle_settings_t;
+
+// Range of the first analog pedals, mapped linearly
+#define THROTTLE_SETTINGS_DEFAULTS { \
+  .forward = { 1000, 2600 }, \
+  .backward = { 1000, 2600 }, \
+  .curve = { THROTTLE_CURVE_LINEAR, { 0, 25, 50, 75, 100 } }, \
+}
+
+typedef struct {
+  int32_t idle_mv;
+  int32_t span_mv; // Negative on inverted pedals
+  uint8_t lut[THROTTLE_LUT_STEPS + 1];
+} throttle_map_t;
+
+// Extremes seen while the driver presses the pedal during a calibration
+typedef struct {
+  uint16_t rest_mv;
+  uint16_t min_mv;
+  uint16_t max_mv;
+} throttle_learn_t;
+
+bool throttle_calibration_valid(const throttle_calibration_t *calibration);
+
+// Custom points are made non decreasing and capped to THROTTLE_POSITION_MAX
+void throttle_curve_sanitize(throttle_curve_t *curve);
+
+// Only done when the settings change, the lookups are integer only
+void throttle_map_build(throttle_map_t *map, const throttle_calibration_t *calibration, const throttle_curve_t *curve);
+
+// Position between 0 and THROTTLE_POSITION_MAX, readings beyond the calibration are clamped
+uint8_t throttle_map_position(const throttle_map_t *map, uint32_t millivolts);
+
+// Start with the pedal released
+void throttle_learn_start(throttle_learn_t *learn, uint32_t millivolts);
+
+void throttle_learn_sample(throttle_learn_t *learn, uint32_t millivolts);
+
+// Returns false if the pedal didn't travel enough
+bool throttle_learn_finish(const throttle_learn_t *learn, throttle_calibration_t *calibration);
+
+#endif
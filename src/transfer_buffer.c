@@ -0,0 +1,45 @@
+#include "transfer_buffer.h"
+
+#include <stdbool.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "transfer_buffer";
+
+// Local variables
+
+static char buffers[TRANSFER_BUFFERS][TRANSFER_BUFSIZE];
+static bool in_use[TRANSFER_BUFFERS];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Implementations
+
+char* transfer_buffer_acquire(void) {
+  char *buffer = NULL;
+
+  portENTER_CRITICAL(&lock);
+  for (int i = 0; i < TRANSFER_BUFFERS; ++i) {
+    if (!in_use[i]) {
+      in_use[i] = true;
+      buffer = buffers[i];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+
+  return buffer;
+}
+
+void transfer_buffer_release(char *buffer) {
+  portENTER_CRITICAL(&lock);
+  for (int i = 0; i < TRANSFER_BUFFERS; ++i) {
+    if (buffers[i] == buffer) {
+      in_use[i] = false;
+      portEXIT_CRITICAL(&lock);
+      return;
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+
+  ESP_LOGE(TAG, "Released an unknown buffer %p", buffer);
+}
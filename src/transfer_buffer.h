@@ -0,0 +1,16 @@
+#ifndef TRANSFER_BUFFER_H
+#define TRANSFER_BUFFER_H
+
+#include "webserver.h"
+
+// Buffers leased by the file server for the duration of a request,
+// one per request the http server can process at the same time.
+
+#define TRANSFER_BUFSIZE 8192
+#define TRANSFER_BUFFERS HTTPD_WORKERS
+
+// NULL when every buffer is in use, never waits
+char* transfer_buffer_acquire(void);
+void transfer_buffer_release(char *buffer);
+
+#endif
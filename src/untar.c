@@ -0,0 +1,317 @@
+#include "untar.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX ustar header
+#define TAR_BLOCK_SIZE 512
+#define TAR_NAME_OFFSET 0
+#define TAR_NAME_SIZE 100
+#define TAR_SIZE_OFFSET 124
+#define TAR_SIZE_SIZE 12
+#define TAR_CHECKSUM_OFFSET 148
+#define TAR_CHECKSUM_SIZE 8
+#define TAR_TYPE_OFFSET 156
+#define TAR_MAGIC_OFFSET 257
+#define TAR_PREFIX_OFFSET 345
+#define TAR_PREFIX_SIZE 155
+
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_FILE_OLD '\0'
+// Long names are stored in an extra entry before the file
+#define TAR_TYPE_GNU_LONG_NAME 'L'
+#define TAR_TYPE_PAX_HEADER 'x'
+
+#define UNTAR_NAME_MAX (TAR_PREFIX_SIZE + 1 + TAR_NAME_SIZE + 1)
+
+typedef enum {
+  ENTRY_SKIPPED,
+  ENTRY_FILE,
+  ENTRY_EXTENDED
+} untar_entry_t;
+
+typedef enum {
+  STATE_HEADER,
+  STATE_DATA,
+  STATE_PADDING,
+  STATE_END,
+  STATE_ERROR
+} untar_state_t;
+
+struct untar {
+  untar_state_t state;
+  untar_status_t error;
+  untar_callbacks_t callbacks;
+  void *ctx;
+
+  // Headers are gathered here across chunks
+  uint8_t block[TAR_BLOCK_SIZE];
+  size_t block_len;
+  // Two empty blocks mark the end of the archive
+  int empty_blocks;
+
+  // Current entry
+  untar_entry_t entry;
+  char type;
+  size_t remaining;
+  size_t padding;
+  char name[UNTAR_NAME_MAX];
+
+  // Extended header data, giving the name of the next entry
+  char extended[TAR_BLOCK_SIZE + 1];
+  size_t extended_len;
+  char long_name[UNTAR_NAME_MAX];
+};
+
+// Implementations
+
+untar_t* untar_create(const untar_callbacks_t *callbacks, void *ctx) {
+  untar_t *tar = calloc(1, sizeof(untar_t));
+  if (tar == NULL) {
+    return NULL;
+  }
+
+  tar->state = STATE_HEADER;
+  tar->callbacks = *callbacks;
+  tar->ctx = ctx;
+  return tar;
+}
+
+void untar_destroy(untar_t *tar) {
+  free(tar);
+}
+
+// Octal numbers are padded with spaces or NULs, returns false if invalid
+static bool parse_octal(const uint8_t *field, size_t size, size_t *value) {
+  size_t i = 0;
+  *value = 0;
+
+  while (i < size && field[i] == ' ') {
+    ++i;
+  }
+  for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+    *value = (*value << 3) | (field[i] - '0');
+  }
+  // Large sizes use a binary encoding, never expected here
+  return i == size || field[i] == ' ' || field[i] == '\0';
+}
+
+static bool is_empty_block(const uint8_t *block) {
+  for (int i = 0; i < TAR_BLOCK_SIZE; ++i) {
+    if (block[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The checksum field counts as spaces
+static bool is_checksum_valid(const uint8_t *block) {
+  size_t expected;
+  if (!parse_octal(block + TAR_CHECKSUM_OFFSET, TAR_CHECKSUM_SIZE, &expected)) {
+    return false;
+  }
+
+  size_t sum = 0;
+  for (int i = 0; i < TAR_BLOCK_SIZE; ++i) {
+    bool is_checksum = i >= TAR_CHECKSUM_OFFSET && i < TAR_CHECKSUM_OFFSET + TAR_CHECKSUM_SIZE;
+    sum += is_checksum ? ' ' : block[i];
+  }
+  return sum == expected;
+}
+
+// Full name from the ustar prefix and name fields, unless an extended header gave it
+static void read_name(untar_t *tar) {
+  const char *block = (const char*)tar->block;
+  size_t len = 0;
+
+  if (tar->long_name[0] != '\0') {
+    strcpy(tar->name, tar->long_name);
+    tar->long_name[0] = '\0';
+  } else {
+    if (memcmp(block + TAR_MAGIC_OFFSET, "ustar", 5) == 0 && block[TAR_PREFIX_OFFSET] != '\0') {
+      len = strnlen(block + TAR_PREFIX_OFFSET, TAR_PREFIX_SIZE);
+      memcpy(tar->name, block + TAR_PREFIX_OFFSET, len);
+      tar->name[len++] = '/';
+    }
+    size_t name_len = strnlen(block + TAR_NAME_OFFSET, TAR_NAME_SIZE);
+    memcpy(tar->name + len, block + TAR_NAME_OFFSET, name_len);
+    tar->name[len + name_len] = '\0';
+  }
+
+  // Archives made from "." name everything "./file"
+  while (strncmp(tar->name, "./", 2) == 0) {
+    memmove(tar->name, tar->name + 2, strlen(tar->name + 2) + 1);
+  }
+}
+
+// Keep the path of a GNU long name or of a pax "<len> path=<name>\n" record
+static void read_long_name(untar_t *tar) {
+  const char *name = NULL;
+  size_t len = 0;
+
+  tar->extended[tar->extended_len] = '\0';
+  if (tar->type == TAR_TYPE_GNU_LONG_NAME) {
+    name = tar->extended;
+    len = strlen(name);
+  } else {
+    for (char *record = tar->extended; *record != '\0'; ) {
+      size_t record_len = strtoul(record, NULL, 10);
+      char *key = strchr(record, ' ');
+      if (record_len == 0 || record + record_len > tar->extended + tar->extended_len ||
+          key == NULL || key + 1 >= record + record_len) {
+        break;
+      }
+      if (record + record_len - key > 6 && strncmp(key + 1, "path=", 5) == 0) {
+        name = key + 6;
+        len = record + record_len - 1 - name;
+      }
+      record += record_len;
+    }
+  }
+
+  if (name != NULL && len < UNTAR_NAME_MAX) {
+    memcpy(tar->long_name, name, len);
+    tar->long_name[len] = '\0';
+  }
+}
+
+// Names come from the archive, they must stay below the directory it is unpacked to
+static bool is_path_safe(const char *name) {
+  if (name[0] == '/') {
+    return false;
+  }
+  for (const char *part = name; part != NULL; part = strchr(part, '/')) {
+    part += *part == '/';
+    if (strncmp(part, "..", 2) == 0 && (part[2] == '/' || part[2] == '\0')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static untar_status_t end_entry(untar_t *tar) {
+  tar->state = tar->padding > 0 ? STATE_PADDING : STATE_HEADER;
+  if (tar->entry == ENTRY_EXTENDED) {
+    read_long_name(tar);
+  } else if (tar->entry == ENTRY_FILE && !tar->callbacks.file_end(tar->ctx)) {
+    return UNTAR_ERR_CALLBACK;
+  }
+  return UNTAR_OK;
+}
+
+static untar_status_t parse_header(untar_t *tar) {
+  if (is_empty_block(tar->block)) {
+    if (++tar->empty_blocks == 2) {
+      tar->state = STATE_END;
+    }
+    return UNTAR_OK;
+  }
+  if (tar->empty_blocks > 0 || !is_checksum_valid(tar->block)) {
+    return UNTAR_ERR_FORMAT;
+  }
+
+  size_t size;
+  if (!parse_octal(tar->block + TAR_SIZE_OFFSET, TAR_SIZE_SIZE, &size)) {
+    return UNTAR_ERR_FORMAT;
+  }
+
+  tar->type = tar->block[TAR_TYPE_OFFSET];
+  tar->remaining = size;
+  tar->padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+  tar->state = STATE_DATA;
+
+  if (tar->type == TAR_TYPE_GNU_LONG_NAME || tar->type == TAR_TYPE_PAX_HEADER) {
+    // Too long to be kept, the entry keeps the name of its header
+    tar->entry = size <= TAR_BLOCK_SIZE ? ENTRY_EXTENDED : ENTRY_SKIPPED;
+    tar->extended_len = 0;
+  } else {
+    read_name(tar);
+    bool is_file = (tar->type == TAR_TYPE_FILE || tar->type == TAR_TYPE_FILE_OLD) && tar->name[0] != '\0';
+    tar->entry = is_file ? ENTRY_FILE : ENTRY_SKIPPED;
+  }
+
+  // Directories, links and global headers are skipped
+  if (tar->entry == ENTRY_FILE) {
+    if (!is_path_safe(tar->name)) {
+      return UNTAR_ERR_PATH;
+    }
+    untar_status_t ret = tar->callbacks.file_begin(tar->name, size, tar->ctx);
+    if (ret == UNTAR_SKIP) {
+      tar->entry = ENTRY_SKIPPED;
+    } else if (ret != UNTAR_OK) {
+      return ret;
+    }
+  }
+
+  if (tar->remaining == 0) {
+    return end_entry(tar);
+  }
+  return UNTAR_OK;
+}
+
+untar_status_t untar_feed(untar_t *tar, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t count = 0;
+
+    switch (tar->state) {
+      case STATE_HEADER:
+        count = len < TAR_BLOCK_SIZE - tar->block_len ? len : TAR_BLOCK_SIZE - tar->block_len;
+        memcpy(tar->block + tar->block_len, data, count);
+        tar->block_len += count;
+        if (tar->block_len == TAR_BLOCK_SIZE) {
+          tar->block_len = 0;
+          if ((tar->error = parse_header(tar)) != UNTAR_OK) {
+            tar->state = STATE_ERROR;
+          }
+        }
+        break;
+      case STATE_DATA:
+        count = len < tar->remaining ? len : tar->remaining;
+        if (tar->entry == ENTRY_FILE && !tar->callbacks.file_data(data, count, tar->ctx)) {
+          tar->error = UNTAR_ERR_CALLBACK;
+          tar->state = STATE_ERROR;
+          break;
+        }
+        if (tar->entry == ENTRY_EXTENDED) {
+          memcpy(tar->extended + tar->extended_len, data, count);
+          tar->extended_len += count;
+        }
+        tar->remaining -= count;
+        if (tar->remaining == 0 && (tar->error = end_entry(tar)) != UNTAR_OK) {
+          tar->state = STATE_ERROR;
+        }
+        break;
+      case STATE_PADDING:
+        count = len < tar->padding ? len : tar->padding;
+        tar->padding -= count;
+        if (tar->padding == 0) {
+          tar->state = STATE_HEADER;
+        }
+        break;
+      case STATE_END:
+        // Archives are padded to a whole record
+        count = len;
+        break;
+      case STATE_ERROR:
+        return tar->error;
+    }
+
+    data += count;
+    len -= count;
+  }
+
+  return tar->state == STATE_ERROR ? tar->error : UNTAR_OK;
+}
+
+untar_status_t untar_finish(untar_t *tar) {
+  if (tar->state == STATE_ERROR) {
+    return tar->error;
+  }
+  // Some archivers only write one of the two empty blocks
+  if (tar->state == STATE_END || (tar->state == STATE_HEADER && tar->block_len == 0 && tar->empty_blocks > 0)) {
+    return UNTAR_OK;
+  }
+  return UNTAR_ERR_TRUNCATED;
+}
@@ -0,0 +1,41 @@
+#ifndef UNTAR_H
+#define UNTAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming tar (ustar) reader keeping a single 512 bytes block in RAM.
+// Input can be fed in chunks of any size, regular files are handed over
+// while they are read and every other entry is skipped.
+// No ESP-IDF dependency, so that it is tested on a host.
+
+typedef enum {
+  UNTAR_OK = 0,
+  UNTAR_SKIP, // From file_begin, to skip the file
+  UNTAR_ERR_FORMAT, // Invalid header
+  UNTAR_ERR_PATH, // Absolute name or going up with ".."
+  UNTAR_ERR_CALLBACK, // Rejected by a callback
+  UNTAR_ERR_TRUNCATED,
+} untar_status_t;
+
+typedef struct untar untar_t;
+
+typedef struct {
+  // A regular file starts, name is relative without leading "./" nor "..".
+  // Return UNTAR_SKIP to skip the file, any other error stops unpacking.
+  untar_status_t (*file_begin)(const char *name, size_t size, void *ctx);
+  bool (*file_data)(const uint8_t *data, size_t len, void *ctx);
+  bool (*file_end)(void *ctx);
+} untar_callbacks_t;
+
+// NULL if out of memory
+untar_t* untar_create(const untar_callbacks_t *callbacks, void *ctx);
+void untar_destroy(untar_t *tar);
+
+untar_status_t untar_feed(untar_t *tar, const uint8_t *data, size_t len);
+
+// UNTAR_OK once the end of archive was reached
+untar_status_t untar_finish(untar_t *tar);
+
+#endif
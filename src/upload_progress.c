@@ -0,0 +1,99 @@
+#include "upload_progress.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "websocket.h"
+
+static const char *TAG = "upload_progress";
+
+// Send an event when either one is reached, completion is always sent
+#define PROGRESS_INTERVAL_MS 500
+#define PROGRESS_STEP_PERCENT 10
+
+// Local variables
+
+typedef struct {
+  size_t loaded;
+  size_t total;
+  int64_t start_time;
+  int64_t update_time;
+} progress_t;
+
+// Latest values, written by the upload and read by the progress task
+static progress_t progress;
+static portMUX_TYPE progress_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Last values sent, only used by the upload side
+static size_t published_loaded = 0;
+static int64_t published_time = 0;
+
+static TaskHandle_t progress_task_handle = NULL;
+
+// Implementations
+
+// Broadcast the latest progress
+// {
+//   "loaded": 8192,
+//   "total": 65536,
+//   "rate": 51200, // bytes per second
+//   "eta": 2 // seconds
+// }
+static void progress_task(void *pvParameter) {
+  static char message[96];
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    portENTER_CRITICAL(&progress_lock);
+    progress_t snapshot = progress;
+    portEXIT_CRITICAL(&progress_lock);
+
+    int64_t elapsed_us = snapshot.update_time - snapshot.start_time;
+    uint32_t rate = elapsed_us > 0 ? (uint64_t)snapshot.loaded * 1000000 / elapsed_us : 0;
+    uint32_t eta = rate > 0 ? (snapshot.total - snapshot.loaded) / rate : 0;
+
+    snprintf(message, sizeof(message), "{\"loaded\":%u,\"total\":%u,\"rate\":%u,\"eta\":%u}",
+             snapshot.loaded, snapshot.total, rate, eta);
+    ESP_LOGD(TAG, "%s", message);
+    broadcast_message(message);
+  }
+}
+
+void upload_progress_update(size_t loaded, size_t total) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&progress_lock);
+  if (loaded == 0 || loaded < progress.loaded || total != progress.total) {
+    progress.start_time = now;
+  }
+  progress.loaded = loaded;
+  progress.total = total;
+  progress.update_time = now;
+  portEXIT_CRITICAL(&progress_lock);
+
+  if (loaded == 0 || loaded < published_loaded) {
+    published_loaded = 0;
+    published_time = 0;
+  }
+
+  bool is_complete = loaded == total;
+  bool is_interval_elapsed = now - published_time >= PROGRESS_INTERVAL_MS * 1000;
+  bool is_step_reached = total > 0 && (loaded - published_loaded) * 100 / total >= PROGRESS_STEP_PERCENT;
+
+  if ((is_complete || is_interval_elapsed || is_step_reached) && progress_task_handle != NULL) {
+    published_loaded = loaded;
+    published_time = now;
+    // Never waits, a pending event simply sends the latest values
+    xTaskNotifyGive(progress_task_handle);
+  }
+}
+
+void setup_upload_progress(void) {
+  // Lower priority than the http server, events never slow down the transfer
+  xTaskCreate(&progress_task, "upload_progress_task", 2560, NULL, 4, &progress_task_handle);
+}
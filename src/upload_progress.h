@@ -0,0 +1,14 @@
+#ifndef UPLOAD_PROGRESS_H
+#define UPLOAD_PROGRESS_H
+
+#include <stddef.h>
+
+// Upload progress events for the websocket listeners. Updates never block
+// nor allocate, they are coalesced and sent by a low priority task.
+
+void setup_upload_progress(void);
+
+// Report the bytes received so far, loaded == 0 starts a new upload
+void upload_progress_update(size_t loaded, size_t total);
+
+#endif
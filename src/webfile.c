@@ -4,30 +4,57 @@
 #include <sys/unistd.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
-#include "esp_ota_ops.h"
-#include "esp_spiffs.h"
+#include "esp_system.h"
 #include "esp_vfs.h"
+#include "mbedtls/sha256.h"
 
 #include "websocket.h"
 #include "utils.h"
-#include "spiffs.h"
+#include "filesystem.h"
+#include "filecache.h"
+#include "embedded_assets.h"
+#include "captive_probe.h"
+#include "ota_writer.h"
+#include "gunzip.h"
+#include "untar.h"
+#include "upload_progress.h"
+#include "transfer_buffer.h"
 
 // Local variables
 
 static const char *TAG = "webfile";
 
-#define SCRATCH_BUFSIZE  8192
 // Max length a file path can have on storage
-#define FILE_PATH_MAX (ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN)
+#define FILE_PATH_MAX (ESP_VFS_PATH_MAX + FILESYSTEM_OBJ_NAME_LEN)
 // Max size of an individual file. Make sure this
 // value is same as that set in upload_script.html */
 #define MAX_FILE_SIZE   (200*1024) // 200 KB
 #define MAX_FILE_SIZE_STR "200KB"
 
-static esp_ota_handle_t ota_handle;
-
-// Buffer for temporary storage during file transfer
-static char scratch_buffer[SCRATCH_BUFSIZE];
+// Serve hot files from RAM with ETag revalidation
+#define WITH_FILE_CACHE 1
+// Browsers may keep files but must revalidate, uploads are visible right away
+#define CACHE_CONTROL "no-cache"
+#define IF_NONE_MATCH_MAX 160
+
+// Precompressed files are stored next to the original one, as index.html.gz
+#define GZIP_EXTENSION ".gz"
+#define ACCEPT_ENCODING_MAX 128
+
+// Advised delay before retrying when all transfer buffers are in use
+#define RETRY_AFTER_SEC "1"
+
+// Uploads are written aside, and replace the file only once complete and verified
+#define UPLOAD_TMP_EXTENSION ".tmp"
+// Upload sessions write files aside until they are committed
+#define SESSION_PART_EXTENSION ".part"
+// Max number of files of a bundle upload
+#define BUNDLE_MAX_FILES 32
+// Files replaced by a bundle are kept aside until the whole bundle is in place
+#define BUNDLE_BACKUP_EXTENSION ".old"
+// Optional SHA-256 of the upload in hex, checked before the file is replaced
+#define DIGEST_HEADER "X-Content-SHA256"
+#define DIGEST_HEX_MAX (2 * FILECACHE_SHA256_SIZE + 1)
 
 // Implementations
 
@@ -40,10 +67,22 @@ static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filena
     return httpd_resp_set_type(req, "application/pdf");
   } else if (IS_FILE_EXTENSION(filename, ".html")) {
     return httpd_resp_set_type(req, "text/html");
-  } else if (IS_FILE_EXTENSION(filename, ".jpeg")) {
+  } else if (IS_FILE_EXTENSION(filename, ".css")) {
+    return httpd_resp_set_type(req, "text/css");
+  } else if (IS_FILE_EXTENSION(filename, ".js")) {
+    return httpd_resp_set_type(req, "application/javascript");
+  } else if (IS_FILE_EXTENSION(filename, ".json")) {
+    return httpd_resp_set_type(req, "application/json");
+  } else if (IS_FILE_EXTENSION(filename, ".svg")) {
+    return httpd_resp_set_type(req, "image/svg+xml");
+  } else if (IS_FILE_EXTENSION(filename, ".png")) {
+    return httpd_resp_set_type(req, "image/png");
+  } else if (IS_FILE_EXTENSION(filename, ".jpeg") || IS_FILE_EXTENSION(filename, ".jpg")) {
     return httpd_resp_set_type(req, "image/jpeg");
   } else if (IS_FILE_EXTENSION(filename, ".ico")) {
     return httpd_resp_set_type(req, "image/x-icon");
+  } else if (IS_FILE_EXTENSION(filename, GZIP_EXTENSION)) {
+    return httpd_resp_set_type(req, "application/gzip");
   }
   // For any other type always set as plain text
   return httpd_resp_set_type(req, "text/plain");
@@ -86,6 +125,18 @@ static const char* get_path_from_uri(char *dest, const char *base_path, const ch
   return dest + base_pathlen;
 }
 
+// Lease a transfer buffer for the request, or answer 503 when all of them are in use
+static char* acquire_transfer_buffer(httpd_req_t *req) {
+  char *buffer = transfer_buffer_acquire();
+  if (buffer == NULL) {
+    ESP_LOGW(TAG, "No transfer buffer available for %s", req->uri);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SEC);
+    httpd_resp_sendstr(req, "Server busy, retry later");
+  }
+  return buffer;
+}
+
 // Delayed restart by 1s
 static void restart_task(void *pvParameter) {
   vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -93,61 +144,121 @@ static void restart_task(void *pvParameter) {
   esp_restart();
 }
 
-static void broadcast_upload_progress(int loaded, int total) {
-  char *message;
-  char *format = "{\"loaded\":\"%d\",\"total\":\"%d\"}";
-  asprintf(&message, format, loaded, total);
-  ESP_LOGI(TAG, "%s", message);
-  broadcast_message(message);
+
+#if WITH_FILE_CACHE || WITH_EMBEDDED_ASSETS
+// Check if the client already has this version of the file
+static bool is_etag_matching(httpd_req_t *req, const char *etag) {
+  char if_none_match[IF_NONE_MATCH_MAX];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) != ESP_OK) {
+    return false;
+  }
+  return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
 }
+#endif
+
+#if WITH_FILE_CACHE
+// Send a file from RAM in a single response, or a 304 if the client is up to date
+static esp_err_t send_cached_file(httpd_req_t *req, const char *filename, const filecache_entry_t *entry) {
+  httpd_resp_set_hdr(req, "ETag", entry->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", CACHE_CONTROL);
+
+  if (is_etag_matching(req, entry->etag)) {
+    ESP_LOGI(TAG, "File not modified: %s", filename);
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
 
-// Handler to download a file from the server
-static esp_err_t download_get_handler(httpd_req_t *req) {
-  ESP_LOGE(TAG, "Request received for %s", req->uri);
+  ESP_LOGI(TAG, "Sending cached file: %s (%d bytes)...", filename, entry->size);
+  set_content_type_from_file(req, filename);
+  return httpd_resp_send(req, entry->data, entry->size);
+}
+#endif
+
+// Check if the client can decode a gzip response
+static bool is_gzip_accepted(httpd_req_t *req) {
+  char accept_encoding[ACCEPT_ENCODING_MAX];
+  esp_err_t ret = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+  // A truncated value is still worth looking at
+  if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+    return false;
+  }
+  return strstr(accept_encoding, "gzip") != NULL;
+}
 
-  char filepath[FILE_PATH_MAX];
+#if WITH_EMBEDDED_ASSETS
+// Send a gzipped asset from the firmware in a single response, or a 304 if the client is up to date
+static esp_err_t send_embedded_asset(httpd_req_t *req, const embedded_asset_t *asset) {
+  httpd_resp_set_hdr(req, "ETag", asset->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", CACHE_CONTROL);
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  if (is_etag_matching(req, asset->etag)) {
+    ESP_LOGI(TAG, "File not modified: %s", asset->path);
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  ESP_LOGI(TAG, "Sending embedded file: %s (%d bytes)...", asset->path, asset->size);
+  httpd_resp_set_type(req, asset->content_type);
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char*)asset->data, asset->size);
+}
+#endif
+
+// Send a file from storage, from RAM when it is cached.
+// Returns ESP_ERR_NOT_FOUND, without responding, if the file doesn't exist.
+static esp_err_t send_file(httpd_req_t *req, const char *filepath, const char *filename, bool is_gzipped) {
   FILE *fd = NULL;
   struct stat file_stat;
 
-  const char *filename = get_path_from_uri(filepath, SPIFFS_BASE_PATH, req->uri, sizeof(filepath));
-  if (!filename) {
-    ESP_LOGE(TAG, "Filename is too long");
-    // Respond with 500 Internal Server Error
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
-    return ESP_FAIL;
+  #if WITH_FILE_CACHE
+  const filecache_entry_t *entry = filecache_acquire(filepath);
+  if (entry) {
+    if (is_gzipped) {
+      httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    esp_err_t ret = send_cached_file(req, filename, entry);
+    filecache_release(entry);
+    return ret;
   }
+  #endif
 
-  if (strcmp(filename, "/") == 0 || strcmp(filename, "/hotspot-detect.html") == 0) {
-    strcpy(filepath, "/spiffs/index.html");
-    filename = "/index.html";
+  if (stat(filepath, &file_stat) == -1) {
+    return ESP_ERR_NOT_FOUND;
   }
 
-  if (stat(filepath, &file_stat) == -1) {
-      ESP_LOGE(TAG, "Failed to stat file: %s", filepath);
-      // If file not present on SPIFFS, redirect to root
-      return redirect_root(req);
+  char *buffer = acquire_transfer_buffer(req);
+  if (buffer == NULL) {
+    return ESP_FAIL;
   }
 
   fd = fopen(filepath, "r");
   if (!fd) {
+    transfer_buffer_release(buffer);
     ESP_LOGE(TAG, "Failed to read existing file: %s", filepath);
     // Respond with 500 Internal Server Error
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
     return ESP_FAIL;
   }
 
-  ESP_LOGI(TAG, "Sending file: %s (%ld bytes)...", filename, file_stat.st_size);
+  ESP_LOGI(TAG, "Sending file: %s%s (%ld bytes)...", filename, is_gzipped ? GZIP_EXTENSION : "", file_stat.st_size);
   set_content_type_from_file(req, filename);
+  if (is_gzipped) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  }
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
 
   size_t chunksize;
   do {
-    // Read file in chunks into the scratch buffer
-    chunksize = fread(scratch_buffer, 1, SCRATCH_BUFSIZE, fd);
+    // Read file in chunks into the transfer buffer
+    chunksize = fread(buffer, 1, TRANSFER_BUFSIZE, fd);
 
     if (chunksize > 0) {
       // Send the buffer contents as HTTP response chunk
-      if (httpd_resp_send_chunk(req, scratch_buffer, chunksize) != ESP_OK) {
+      if (httpd_resp_send_chunk(req, buffer, chunksize) != ESP_OK) {
         fclose(fd);
+        transfer_buffer_release(buffer);
         ESP_LOGE(TAG, "File sending failed!");
         // Abort sending file
         httpd_resp_sendstr_chunk(req, NULL);
@@ -162,6 +273,7 @@ static esp_err_t download_get_handler(httpd_req_t *req) {
 
   // Close file after sending complete
   fclose(fd);
+  transfer_buffer_release(buffer);
   ESP_LOGI(TAG, "File sending complete");
 
   // Respond with an empty chunk to signal HTTP response completion
@@ -169,68 +281,277 @@ static esp_err_t download_get_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
-// Handler to upload a new binary onto the chip
-static esp_err_t upload_ota_handler(httpd_req_t *req) {
-  int received;
+// Handler to download a file from the server
+static esp_err_t download_get_handler(httpd_req_t *req) {
+  // Connectivity checks come in bursts when a device joins, answer them first
+  esp_err_t probe_ret = captive_probe_handler(req);
+  if (probe_ret != ESP_ERR_NOT_FOUND) {
+    return probe_ret;
+  }
 
-  esp_err_t ret = esp_ota_begin(esp_ota_get_next_update_partition(NULL), OTA_SIZE_UNKNOWN, &ota_handle);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to begin OTAs");
+  ESP_LOGE(TAG, "Request received for %s", req->uri);
+
+  char filepath[FILE_PATH_MAX];
+  char gzip_filepath[FILE_PATH_MAX];
+
+  const char *filename = get_path_from_uri(filepath, FILESYSTEM_BASE_PATH, req->uri, sizeof(filepath));
+  if (!filename) {
+    ESP_LOGE(TAG, "Filename is too long");
     // Respond with 500 Internal Server Error
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to begin OTA");
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
     return ESP_FAIL;
   }
 
+  if (strcmp(filename, "/") == 0) {
+    strcpy(filepath, FILESYSTEM_BASE_PATH "/index.html");
+    filename = "/index.html";
+  }
+
+  #if WITH_EMBEDDED_ASSETS
+  // Files uploaded to storage replace the embedded ones
+  const embedded_asset_t *asset = embedded_asset_find(filename);
+  if (asset && is_gzip_accepted(req)) {
+    return send_embedded_asset(req, asset);
+  }
+  #endif
+
+  // Prefer the precompressed sibling, served with the content type of the original file
+  if (is_gzip_accepted(req) &&
+      snprintf(gzip_filepath, sizeof(gzip_filepath), "%s" GZIP_EXTENSION, filepath) < sizeof(gzip_filepath)) {
+    esp_err_t ret = send_file(req, gzip_filepath, filename, true);
+    if (ret != ESP_ERR_NOT_FOUND) {
+      return ret;
+    }
+  }
+
+  esp_err_t ret = send_file(req, filepath, filename, false);
+  if (ret == ESP_ERR_NOT_FOUND) {
+    ESP_LOGE(TAG, "Failed to stat file: %s", filepath);
+    // If file not present on storage, redirect to root
+    return redirect_root(req);
+  }
+  return ret;
+}
+
+// Share how the update went, to compare network and flash speed
+static void broadcast_ota_stats(const ota_writer_stats_t *stats) {
+  char *message;
+  char *format = "{\"ota\":{\"bytes\":%d,\"duration_ms\":%lld,\"receive_stall_ms\":%lld,\"write_stall_ms\":%lld,\"flash_ms\":%lld}}";
+  asprintf(&message, format, stats->bytes_written, stats->duration_us / 1000,
+           stats->receive_stall_us / 1000, stats->write_stall_us / 1000, stats->write_time_us / 1000);
+  broadcast_message(message);
+  free(message);
+}
+
+// Abort the update and respond with 500 Internal Server Error
+static esp_err_t fail_ota(httpd_req_t *req, const char *message) {
+  ota_writer_abort();
+
+  ESP_LOGE(TAG, "%s", message);
+  httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, message);
+  return ESP_FAIL;
+}
+
+// Receive a raw firmware straight into the OTA writer buffers
+static esp_err_t receive_ota(httpd_req_t *req) {
+  int received;
+  char *buffer = NULL;
+  size_t filled = 0;
+
   // Content length of the request gives the size of the file being uploaded
   int remaining = req->content_len;
 
+  upload_progress_update(0, req->content_len);
+
   while (remaining > 0) {
-    broadcast_upload_progress(req->content_len - remaining, req->content_len);
+    // Wait for a free buffer, blocks while the flash is behind
+    if (buffer == NULL) {
+      buffer = ota_writer_acquire_buffer();
+      filled = 0;
 
-    // Receive the file part by part into a buffer
-    if ((received = httpd_req_recv(req, scratch_buffer, min(remaining, SCRATCH_BUFSIZE))) <= 0) {
+      if (buffer == NULL) {
+        return fail_ota(req, "Failed to write file to OTA");
+      }
+    }
+
+    // Receive the file part by part into the buffer
+    if ((received = httpd_req_recv(req, buffer + filled, min(remaining, OTA_WRITER_BUFSIZE - filled))) <= 0) {
       if (received == HTTPD_SOCK_ERR_TIMEOUT) {
         // Retry if timeout occurred
         continue;
       }
 
-      // In case of unrecoverable error, close and delete the unfinished file
-      esp_ota_end(ota_handle);
+      // In case of unrecoverable error, drop the unfinished update
+      return fail_ota(req, "Failed to receive file");
+    }
 
-      ESP_LOGE(TAG, "File reception failed!");
-      // Respond with 500 Internal Server Error
-      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive file");
-      return ESP_FAIL;
+    filled += received;
+    // Keep track of remaining size of the file left to be uploaded
+    remaining -= received;
+
+    // Hand over full buffers to the writer and keep receiving
+    if (filled == OTA_WRITER_BUFSIZE || remaining == 0) {
+      esp_err_t ret = ota_writer_submit(buffer, filled);
+      buffer = NULL;
+
+      if (ret != ESP_OK) {
+        return fail_ota(req, "Failed to write file to OTA");
+      }
+
+      upload_progress_update(req->content_len - remaining, req->content_len);
     }
+  }
 
-    // Write buffer content to file on storage
-    if (received && esp_ota_write(ota_handle, scratch_buffer, received) != ESP_OK) {
-      // Couldn't write everything to file!
-      esp_ota_end(ota_handle);
+  return ESP_OK;
+}
 
-      ESP_LOGE(TAG, "OTA write failed!");
-      // Respond with 500 Internal Server Error
-      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write file to OTA");
-      return ESP_FAIL;
+// Decompressed data waiting to be flashed
+typedef struct {
+  char *buffer;
+  size_t filled;
+} ota_output_t;
+
+// Copy decompressed data into the OTA writer buffers, submitting them once full
+static esp_err_t write_ota_output(const uint8_t *data, size_t len, void *ctx) {
+  ota_output_t *output = (ota_output_t*)ctx;
+
+  while (len > 0) {
+    if (output->buffer == NULL) {
+      output->buffer = ota_writer_acquire_buffer();
+      output->filled = 0;
+
+      if (output->buffer == NULL) {
+        return ESP_FAIL;
+      }
+    }
+
+    size_t count = min(len, OTA_WRITER_BUFSIZE - output->filled);
+    memcpy(output->buffer + output->filled, data, count);
+    output->filled += count;
+    data += count;
+    len -= count;
+
+    if (output->filled == OTA_WRITER_BUFSIZE) {
+      esp_err_t ret = ota_writer_submit(output->buffer, output->filled);
+      output->buffer = NULL;
+
+      if (ret != ESP_OK) {
+        return ret;
+      }
+    }
+  }
+
+  return ESP_OK;
+}
+
+static bool write_gunzip_output(const uint8_t *data, size_t len, void *ctx) {
+  return write_ota_output(data, len, ctx) == ESP_OK;
+}
+
+// Receive a gzip compressed firmware, decompressed on the fly into the OTA writer buffers
+static esp_err_t receive_gzipped_ota(httpd_req_t *req, char *buffer) {
+  int received;
+  ota_output_t output = { .buffer = NULL, .filled = 0 };
+
+  gunzip_t *gz = gunzip_create();
+  if (gz == NULL) {
+    return fail_ota(req, "Not enough memory to decompress");
+  }
+
+  // Content length of the request gives the size of the file being uploaded
+  int remaining = req->content_len;
+
+  upload_progress_update(0, req->content_len);
+
+  while (remaining > 0) {
+    // Receive the compressed file part by part into a buffer
+    if ((received = httpd_req_recv(req, buffer, min(remaining, TRANSFER_BUFSIZE))) <= 0) {
+      if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+        // Retry if timeout occurred
+        continue;
+      }
+
+      gunzip_destroy(gz);
+      return fail_ota(req, "Failed to receive file");
+    }
+
+    gunzip_status_t status = gunzip_feed(gz, (uint8_t*)buffer, received, write_gunzip_output, &output);
+    if (status != GUNZIP_OK) {
+      ESP_LOGE(TAG, "Decompression failed (%d)", status);
+      gunzip_destroy(gz);
+      return fail_ota(req, "Failed to decompress file to OTA");
     }
 
     // Keep track of remaining size of the file left to be uploaded
     remaining -= received;
+
+    upload_progress_update(req->content_len - remaining, req->content_len);
+  }
+
+  // The image must be complete and match its checksum before it can be booted
+  gunzip_status_t status = gunzip_finish(gz);
+  ESP_LOGI(TAG, "Decompressed %d bytes into %d bytes", req->content_len, gunzip_output_size(gz));
+  gunzip_destroy(gz);
+  if (status != GUNZIP_OK) {
+    ESP_LOGE(TAG, "Integrity check failed (%d)", status);
+    return fail_ota(req, "Corrupted compressed file");
+  }
+
+  // Flash the last partial buffer
+  if (output.buffer != NULL && ota_writer_submit(output.buffer, output.filled) != ESP_OK) {
+    return fail_ota(req, "Failed to write file to OTA");
+  }
+
+  return ESP_OK;
+}
+
+// Defined with the upload sessions below
+static void abort_ota_session(void);
+
+// Handler to upload a new binary onto the chip, raw or gzip compressed.
+// The flash is written by the OTA writer task while the next part is received.
+static esp_err_t upload_ota_handler(httpd_req_t *req, bool is_gzipped) {
+  // Compressed data is received aside before being decompressed into the writer buffers
+  char *buffer = NULL;
+  if (is_gzipped && (buffer = acquire_transfer_buffer(req)) == NULL) {
+    return ESP_FAIL;
   }
 
-  broadcast_upload_progress(req->content_len, req->content_len);
+  // Like a new session, the upload replaces an abandoned one holding the OTA writer
+  abort_ota_session();
 
-  // End OTA upon upload completion
-  esp_ota_end(ota_handle);
-  // Set new boot partition
-  ret = esp_ota_set_boot_partition(esp_ota_get_next_update_partition(NULL));
+  esp_err_t ret = ota_writer_begin();
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Set new boot partition failed!");
+    if (buffer) {
+      transfer_buffer_release(buffer);
+    }
+    ESP_LOGE(TAG, "Failed to begin OTA (%s)", esp_err_to_name(ret));
     // Respond with 500 Internal Server Error
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set new boot partition");
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to begin OTA");
     return ESP_FAIL;
   }
 
+  ret = is_gzipped ? receive_gzipped_ota(req, buffer) : receive_ota(req);
+  if (buffer) {
+    transfer_buffer_release(buffer);
+  }
+  if (ret != ESP_OK) {
+    // Already aborted and answered
+    return ret;
+  }
+
+  // Flush the last buffers, validate the image and set the new boot partition
+  ota_writer_stats_t stats;
+  ret = ota_writer_finish(&stats);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "OTA update failed (%s)", esp_err_to_name(ret));
+    // Respond with 500 Internal Server Error
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to finish OTA");
+    return ESP_FAIL;
+  }
+
+  broadcast_ota_stats(&stats);
+
   ESP_LOGI(TAG, "File reception complete");
 
   // Redirect onto root
@@ -242,9 +563,73 @@ static esp_err_t upload_ota_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
+// A plain upload replaces the precompressed version, which would be served first otherwise
+static void remove_gzip_sibling(const char *filepath) {
+  char gzip_filepath[FILE_PATH_MAX];
+  if (snprintf(gzip_filepath, sizeof(gzip_filepath), "%s" GZIP_EXTENSION, filepath) >= sizeof(gzip_filepath)) {
+    return;
+  }
+
+  if (unlink(gzip_filepath) == 0) {
+    ESP_LOGI(TAG, "Removed outdated %s", gzip_filepath);
+  }
+  filecache_invalidate(gzip_filepath);
+  #if WITH_EMBEDDED_ASSETS
+  embedded_assets_update_override(gzip_filepath);
+  #endif
+}
+
+// Compare a digest with the hex one given by the client, if any
+static bool is_digest_matching(const uint8_t *sha256, const char *expected) {
+  if (expected == NULL || expected[0] == '\0') {
+    return true;
+  }
+
+  char hex[DIGEST_HEX_MAX];
+  for (int i = 0; i < FILECACHE_SHA256_SIZE; ++i) {
+    sprintf(&hex[2 * i], "%02x", sha256[i]);
+  }
+  return strcasecmp(hex, expected) == 0;
+}
+
+// Move a fully received file into place and refresh its cache entry
+static esp_err_t install_file(const char *tmp_filepath, const char *filepath, const uint8_t *sha256) {
+  #if !FILESYSTEM_HAS_ATOMIC_RENAME
+  // SPIFFS can't rename over an existing file, the old one is only missing between unlink and rename
+  unlink(filepath);
+  #endif
+  if (rename(tmp_filepath, filepath) != 0) {
+    ESP_LOGE(TAG, "Failed to rename %s", tmp_filepath);
+    unlink(tmp_filepath);
+    filecache_invalidate(filepath);
+    return ESP_FAIL;
+  }
+
+  // Next download picks the new content, with the digest as ETag
+  filecache_update(filepath, sha256);
+  #if WITH_EMBEDDED_ASSETS
+  embedded_assets_update_override(filepath);
+  #endif
+  if (!IS_FILE_EXTENSION(filepath, GZIP_EXTENSION)) {
+    remove_gzip_sibling(filepath);
+  }
+  return ESP_OK;
+}
+
+// Drop an incomplete upload, the live file is left untouched
+static void discard_upload(FILE *fd, const char *tmp_filepath, mbedtls_sha256_context *sha256) {
+  fclose(fd);
+  unlink(tmp_filepath);
+  mbedtls_sha256_free(sha256);
+}
+
 // Handler to upload a file onto the filesystem
-static esp_err_t upload_file_handler(httpd_req_t *req, const char *filepath, const char *filename) {
+static esp_err_t upload_file_handler(httpd_req_t *req, const char *filepath, const char *filename, char *buffer) {
   FILE *fd = NULL;
+  char tmp_filepath[FILE_PATH_MAX];
+  char expected_digest[DIGEST_HEX_MAX] = "";
+  mbedtls_sha256_context sha256_ctx;
+  uint8_t sha256[FILECACHE_SHA256_SIZE];
 
   // File cannot be larger than a limit
   if (req->content_len > MAX_FILE_SIZE) {
@@ -254,34 +639,49 @@ static esp_err_t upload_file_handler(httpd_req_t *req, const char *filepath, con
     return ESP_FAIL;
   }
 
-  fd = fopen(filepath, "w");
+  if (snprintf(tmp_filepath, sizeof(tmp_filepath), "%s" UPLOAD_TMP_EXTENSION, filepath) >= sizeof(tmp_filepath)) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
+    return ESP_FAIL;
+  }
+
+  if (httpd_req_get_hdr_value_len(req, DIGEST_HEADER) > 0 &&
+      httpd_req_get_hdr_value_str(req, DIGEST_HEADER, expected_digest, sizeof(expected_digest)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid " DIGEST_HEADER);
+    return ESP_FAIL;
+  }
+
+  // The live file keeps being served until the new one is complete
+  fd = fopen(tmp_filepath, "w");
   if (!fd) {
-    ESP_LOGE(TAG, "Failed to create file : %s", filepath);
+    ESP_LOGE(TAG, "Failed to create file : %s", tmp_filepath);
     // Respond with 500 Internal Server Error
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
     return ESP_FAIL;
   }
 
+  mbedtls_sha256_init(&sha256_ctx);
+  mbedtls_sha256_starts_ret(&sha256_ctx, 0);
+
   ESP_LOGI(TAG, "Receiving file : %s...", filename);
 
   int received;
+  bool is_gzipped = IS_FILE_EXTENSION(filename, GZIP_EXTENSION);
 
   // Content length of the request gives the size of the file being uploaded
   int remaining = req->content_len;
 
   while (remaining > 0) {
-    broadcast_upload_progress(req->content_len - remaining, req->content_len);
+    upload_progress_update(req->content_len - remaining, req->content_len);
 
     // Receive the file part by part into a buffer
-    if ((received = httpd_req_recv(req, scratch_buffer, min(remaining, SCRATCH_BUFSIZE))) <= 0) {
+    if ((received = httpd_req_recv(req, buffer, min(remaining, TRANSFER_BUFSIZE))) <= 0) {
       if (received == HTTPD_SOCK_ERR_TIMEOUT) {
         // Retry if timeout occurred
         continue;
       }
 
       // In case of unrecoverable error, close and delete the unfinished file
-      fclose(fd);
-      unlink(filepath);
+      discard_upload(fd, tmp_filepath, &sha256_ctx);
 
       ESP_LOGE(TAG, "File reception failed!");
       // Respond with 500 Internal Server Error
@@ -289,12 +689,21 @@ static esp_err_t upload_file_handler(httpd_req_t *req, const char *filepath, con
       return ESP_FAIL;
     }
 
+    // Precompressed files must start with the gzip magic bytes
+    if (!gunzip_upload_part_valid(is_gzipped, (uint8_t*)buffer, received, req->content_len - remaining, req->content_len)) {
+      discard_upload(fd, tmp_filepath, &sha256_ctx);
+
+      ESP_LOGE(TAG, "Not a gzip file : %s", filename);
+      // Respond with 400 Bad Request
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid gzip file");
+      return ESP_FAIL;
+    }
+
     // Write buffer content to file on storage
-    if (received && (received != fwrite(scratch_buffer, 1, received, fd))) {
+    if (received && (received != fwrite(buffer, 1, received, fd))) {
       // Couldn't write everything to file!
       // Storage may be full?
-      fclose(fd);
-      unlink(filepath);
+      discard_upload(fd, tmp_filepath, &sha256_ctx);
 
       ESP_LOGE(TAG, "File write failed!");
       // Respond with 500 Internal Server Error
@@ -302,17 +711,40 @@ static esp_err_t upload_file_handler(httpd_req_t *req, const char *filepath, con
       return ESP_FAIL;
     }
 
+    mbedtls_sha256_update_ret(&sha256_ctx, (uint8_t*)buffer, received);
+
     // Keep track of remaining size of the file left to be uploaded
     remaining -= received;
   }
 
-  broadcast_upload_progress(req->content_len, req->content_len);
+  upload_progress_update(req->content_len, req->content_len);
+
+  mbedtls_sha256_finish_ret(&sha256_ctx, sha256);
+  if (!is_digest_matching(sha256, expected_digest)) {
+    discard_upload(fd, tmp_filepath, &sha256_ctx);
+
+    ESP_LOGE(TAG, "SHA-256 mismatch : %s", filename);
+    // Respond with 400 Bad Request
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "SHA-256 mismatch");
+    return ESP_FAIL;
+  }
 
   // Close file upon upload completion
   fclose(fd);
+  mbedtls_sha256_free(&sha256_ctx);
+
+  if (install_file(tmp_filepath, filepath, sha256) != ESP_OK) {
+    // Respond with 500 Internal Server Error
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write file to storage");
+    return ESP_FAIL;
+  }
 
   ESP_LOGI(TAG, "File reception complete");
 
+  char etag[FILECACHE_ETAG_MAX];
+  filecache_format_etag(etag, sha256);
+  httpd_resp_set_hdr(req, "ETag", etag);
+
   // Redirect onto root
   httpd_resp_set_status(req, "303 See Other");
   httpd_resp_set_hdr(req, "Location", "/");
@@ -326,7 +758,7 @@ static esp_err_t upload_post_handler(httpd_req_t *req) {
 
   // Skip leading "/upload" from URI to get filename
   // Note sizeof() counts NULL termination hence the -1
-  const char *filename = get_path_from_uri(filepath, SPIFFS_BASE_PATH, req->uri + sizeof("/upload") - 1, sizeof(filepath));
+  const char *filename = get_path_from_uri(filepath, FILESYSTEM_BASE_PATH, req->uri + sizeof("/upload") - 1, sizeof(filepath));
   if (!filename) {
     // Respond with 500 Internal Server Error
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
@@ -341,15 +773,755 @@ static esp_err_t upload_post_handler(httpd_req_t *req) {
   }
 
   if (IS_FILE_EXTENSION(filename, ".bin")) {
-    return upload_ota_handler(req);
+    return upload_ota_handler(req, false);
+  } else if (IS_FILE_EXTENSION(filename, ".bin" GZIP_EXTENSION)) {
+    return upload_ota_handler(req, true);
+  }
+
+  char *buffer = acquire_transfer_buffer(req);
+  if (buffer == NULL) {
+    return ESP_FAIL;
+  }
+  esp_err_t ret = upload_file_handler(req, filepath, filename, buffer);
+  transfer_buffer_release(buffer);
+  return ret;
+}
+
+// *******************
+// **** UPLOAD SESSIONS
+// *******************
+
+// Resumable uploads, sent in chunks at explicit offsets. A dropped connection
+// only loses the chunk in flight, the client asks for the offset and resumes.
+// - Create, replacing any previous session: POST /upload-session/<name>?size=<bytes>
+// - Send a chunk: PUT /upload-session/<name> with Content-Range: bytes <first>-<last>/<size>
+// - Query progress: GET /upload-session/<name>
+// - Commit once complete: POST /upload-session/<name>?commit=1, optionally &sha256=<hex> to verify the content
+// - Cancel: DELETE /upload-session/<name>
+// All of them answer { "name": "index.html", "size": 1234, "offset": 1024 }
+
+typedef enum {
+  SESSION_FILE,
+  SESSION_OTA,
+  SESSION_GZIPPED_OTA
+} upload_session_type_t;
+
+typedef struct {
+  bool active;
+  upload_session_type_t type;
+  char filepath[FILE_PATH_MAX];
+  // Files are received next to the final one, and renamed on commit
+  char part_filepath[FILE_PATH_MAX];
+  size_t size;
+  // Bytes received and handed to storage so far
+  size_t offset;
+  gunzip_t *gz;
+  ota_output_t output;
+  // Digest of the received bytes, as sent by the client
+  mbedtls_sha256_context sha256;
+} upload_session_t;
+
+static upload_session_t session;
+
+static void close_session(void) {
+  mbedtls_sha256_free(&session.sha256);
+  memset(&session, 0, sizeof(session));
+}
+
+static void abort_session(void) {
+  if (!session.active) {
+    return;
+  }
+
+  ESP_LOGI(TAG, "Abort upload session %s at %d/%d", session.filepath, session.offset, session.size);
+
+  if (session.type == SESSION_FILE) {
+    unlink(session.part_filepath);
   } else {
-    return upload_file_handler(req, filepath, filename);
+    ota_writer_abort();
   }
+  if (session.gz) {
+    gunzip_destroy(session.gz);
+  }
+
+  close_session();
+}
+
+static void abort_ota_session(void) {
+  if (session.active && session.type != SESSION_FILE) {
+    abort_session();
+  }
+}
+
+static esp_err_t send_session_status(httpd_req_t *req, const char *status) {
+  char message[FILE_PATH_MAX + 64];
+  snprintf(message, sizeof(message), "{\"name\":\"%s\",\"size\":%d,\"offset\":%d}",
+           session.filepath + strlen(FILESYSTEM_BASE_PATH) + 1, session.size, session.offset);
+
+  httpd_resp_set_status(req, status);
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, message);
+}
+
+// Resolve the file path of a session URI, NULL if invalid
+static const char* get_session_filepath(httpd_req_t *req, char *filepath) {
+  const char *filename = get_path_from_uri(filepath, FILESYSTEM_BASE_PATH, req->uri + sizeof("/upload-session") - 1, FILE_PATH_MAX);
+  if (!filename || strlen(filename) < 2 || filename[strlen(filename) - 1] == '/') {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid filename");
+    return NULL;
+  }
+  return filename;
+}
+
+// Check the request targets the current session
+static bool is_session_request(httpd_req_t *req) {
+  char filepath[FILE_PATH_MAX];
+  if (!get_session_filepath(req, filepath)) {
+    return false;
+  }
+
+  if (!session.active || strcmp(filepath, session.filepath) != 0) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No upload session for this file");
+    return false;
+  }
+  return true;
+}
+
+static esp_err_t create_session(httpd_req_t *req, size_t size) {
+  char filepath[FILE_PATH_MAX];
+  const char *filename = get_session_filepath(req, filepath);
+  if (!filename) {
+    return ESP_FAIL;
+  }
+
+  // Only one session at a time, a new one replaces an abandoned one
+  abort_session();
+
+  if (IS_FILE_EXTENSION(filename, ".bin")) {
+    session.type = SESSION_OTA;
+  } else if (IS_FILE_EXTENSION(filename, ".bin" GZIP_EXTENSION)) {
+    session.type = SESSION_GZIPPED_OTA;
+  } else {
+    session.type = SESSION_FILE;
+  }
+
+  if (session.type == SESSION_FILE) {
+    if (size > MAX_FILE_SIZE) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "File size must be less than " MAX_FILE_SIZE_STR "!");
+      return ESP_FAIL;
+    }
+
+    if (snprintf(session.part_filepath, FILE_PATH_MAX, "%s" SESSION_PART_EXTENSION, filepath) >= FILE_PATH_MAX) {
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
+      return ESP_FAIL;
+    }
+
+    FILE *fd = fopen(session.part_filepath, "w");
+    if (!fd) {
+      ESP_LOGE(TAG, "Failed to create file : %s", session.part_filepath);
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create file");
+      return ESP_FAIL;
+    }
+    fclose(fd);
+  } else {
+    esp_err_t ret = ota_writer_begin();
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to begin OTA (%s)", esp_err_to_name(ret));
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to begin OTA");
+      return ESP_FAIL;
+    }
+
+    if (session.type == SESSION_GZIPPED_OTA && (session.gz = gunzip_create()) == NULL) {
+      ota_writer_abort();
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not enough memory to decompress");
+      return ESP_FAIL;
+    }
+  }
+
+  mbedtls_sha256_init(&session.sha256);
+  mbedtls_sha256_starts_ret(&session.sha256, 0);
+
+  strlcpy(session.filepath, filepath, sizeof(session.filepath));
+  session.size = size;
+  session.offset = 0;
+  session.active = true;
+
+  ESP_LOGI(TAG, "Upload session created for %s (%d bytes)", filename, size);
+  upload_progress_update(0, size);
+  return send_session_status(req, "201 Created");
+}
+
+static esp_err_t commit_session(httpd_req_t *req, const char *expected_digest) {
+  if (session.offset != session.size) {
+    return send_session_status(req, "409 Conflict");
+  }
+
+  esp_err_t ret = ESP_OK;
+
+  uint8_t sha256[FILECACHE_SHA256_SIZE];
+  mbedtls_sha256_finish_ret(&session.sha256, sha256);
+  if (!is_digest_matching(sha256, expected_digest)) {
+    ESP_LOGE(TAG, "SHA-256 mismatch : %s", session.filepath);
+    abort_session();
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "SHA-256 mismatch");
+    return ESP_FAIL;
+  }
+
+  if (session.type == SESSION_FILE) {
+    // Replace the file only once it was fully received
+    if (install_file(session.part_filepath, session.filepath, sha256) != ESP_OK) {
+      abort_session();
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write file to storage");
+      return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Upload session committed %s", session.filepath);
+    char etag[FILECACHE_ETAG_MAX];
+    filecache_format_etag(etag, sha256);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    send_session_status(req, "200 OK");
+    close_session();
+    return ESP_OK;
+  }
+
+  // The image must be complete and match its checksum before it can be booted
+  if (session.gz) {
+    ret = gunzip_finish(session.gz) == GUNZIP_OK ? ESP_OK : ESP_ERR_INVALID_CRC;
+    gunzip_destroy(session.gz);
+    session.gz = NULL;
+  }
+  // Flash the last partial buffer
+  if (ret == ESP_OK && session.output.buffer != NULL) {
+    ret = ota_writer_submit(session.output.buffer, session.output.filled);
+    session.output.buffer = NULL;
+  }
+  if (ret != ESP_OK) {
+    abort_session();
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Corrupted file");
+    return ESP_FAIL;
+  }
+
+  ota_writer_stats_t stats;
+  ret = ota_writer_finish(&stats);
+  close_session();
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "OTA update failed (%s)", esp_err_to_name(ret));
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to finish OTA");
+    return ESP_FAIL;
+  }
+
+  broadcast_ota_stats(&stats);
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_sendstr(req, "{\"committed\":true}");
+
+  xTaskCreate(&restart_task, "restart_task", 2048, NULL, 10, NULL);
+  return ESP_OK;
+}
+
+// Write received bytes at the session offset
+static esp_err_t write_session(FILE *fd, const char *data, size_t len) {
+  esp_err_t ret = ESP_OK;
+
+  switch (session.type) {
+    case SESSION_FILE:
+      ret = fwrite(data, 1, len, fd) == len ? ESP_OK : ESP_FAIL;
+      break;
+    case SESSION_OTA:
+      ret = write_ota_output((const uint8_t*)data, len, &session.output);
+      break;
+    case SESSION_GZIPPED_OTA:
+      ret = gunzip_feed(session.gz, (const uint8_t*)data, len, write_gunzip_output, &session.output) == GUNZIP_OK ?
+        ESP_OK : ESP_FAIL;
+      break;
+  }
+
+  if (ret == ESP_OK) {
+    mbedtls_sha256_update_ret(&session.sha256, (const uint8_t*)data, len);
+    session.offset += len;
+  }
+  return ret;
+}
+
+// Handler to create or commit an upload session
+static esp_err_t session_post_handler(httpd_req_t *req) {
+  char query[32 + DIGEST_HEX_MAX];
+  char value[16];
+  char expected_digest[DIGEST_HEX_MAX] = "";
+
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing size or commit");
+    return ESP_FAIL;
+  }
+
+  if (httpd_query_key_value(query, "commit", value, sizeof(value)) == ESP_OK) {
+    httpd_query_key_value(query, "sha256", expected_digest, sizeof(expected_digest));
+    return is_session_request(req) ? commit_session(req, expected_digest) : ESP_FAIL;
+  }
+
+  if (httpd_query_key_value(query, "size", value, sizeof(value)) == ESP_OK) {
+    return create_session(req, strtoul(value, NULL, 10));
+  }
+
+  httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing size or commit");
+  return ESP_FAIL;
+}
+
+// Receive the body of a chunk starting at first, skipping what is already stored
+static esp_err_t receive_session_chunk(httpd_req_t *req, size_t first, char *buffer) {
+  FILE *fd = NULL;
+  if (session.type == SESSION_FILE && (fd = fopen(session.part_filepath, "a")) == NULL) {
+    ESP_LOGE(TAG, "Failed to open file : %s", session.part_filepath);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open file");
+    return ESP_FAIL;
+  }
+
+  // Bytes resent by the client that are already stored
+  size_t skip = session.offset - first;
+  int remaining = req->content_len;
+  int received;
+
+  while (remaining > 0) {
+    // Receive the chunk part by part into a buffer
+    if ((received = httpd_req_recv(req, buffer, min(remaining, TRANSFER_BUFSIZE))) <= 0) {
+      if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+        // Retry if timeout occurred
+        continue;
+      }
+
+      // Keep what was received, the client resumes from the session offset
+      if (fd) {
+        fclose(fd);
+      }
+      ESP_LOGW(TAG, "Chunk reception interrupted at %d/%d", session.offset, session.size);
+      return ESP_FAIL;
+    }
+    remaining -= received;
+
+    size_t skipped = min(skip, (size_t)received);
+    skip -= skipped;
+
+    if (received > skipped && write_session(fd, buffer + skipped, received - skipped) != ESP_OK) {
+      if (fd) {
+        fclose(fd);
+      }
+      abort_session();
+
+      ESP_LOGE(TAG, "Upload session write failed!");
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write file");
+      return ESP_FAIL;
+    }
+  }
+
+  if (fd) {
+    fclose(fd);
+  }
+
+  upload_progress_update(session.offset, session.size);
+
+  return send_session_status(req, "200 OK");
+}
+
+// Handler to receive a chunk of an upload session
+static esp_err_t session_put_handler(httpd_req_t *req) {
+  if (!is_session_request(req)) {
+    return ESP_FAIL;
+  }
+
+  char content_range[64];
+  unsigned int first, last, total;
+  if (httpd_req_get_hdr_value_str(req, "Content-Range", content_range, sizeof(content_range)) != ESP_OK ||
+      sscanf(content_range, "bytes %u-%u/%u", &first, &last, &total) != 3 ||
+      last < first || last - first + 1 != req->content_len || total != session.size || last >= total) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Content-Range");
+    return ESP_FAIL;
+  }
+
+  // Chunks must be contiguous, tell the client where to resume
+  if (first > session.offset) {
+    return send_session_status(req, "409 Conflict");
+  }
+
+  char *buffer = acquire_transfer_buffer(req);
+  if (buffer == NULL) {
+    return ESP_FAIL;
+  }
+  esp_err_t ret = receive_session_chunk(req, first, buffer);
+  transfer_buffer_release(buffer);
+  return ret;
+}
+
+// Handler to query the progress of an upload session
+static esp_err_t session_get_handler(httpd_req_t *req) {
+  if (!is_session_request(req)) {
+    return ESP_FAIL;
+  }
+  return send_session_status(req, "200 OK");
+}
+
+// Handler to cancel an upload session
+static esp_err_t session_delete_handler(httpd_req_t *req) {
+  if (!is_session_request(req)) {
+    return ESP_FAIL;
+  }
+  send_session_status(req, "200 OK");
+  abort_session();
+  return ESP_OK;
+}
+
+// *******************
+// **** UPLOAD BUNDLE
+// *******************
+
+// The whole web UI in a single request: POST /upload-bundle with a tar archive,
+// optionally gzipped, as made by tools/make_bundle.py. Files are unpacked aside
+// while received, and only replace the current ones once the archive is complete.
+
+typedef struct {
+  char filepath[FILE_PATH_MAX];
+  uint8_t sha256[FILECACHE_SHA256_SIZE];
+  // The replaced file is kept until the whole bundle is installed
+  bool has_backup;
+} bundle_file_t;
+
+typedef struct {
+  bundle_file_t files[BUNDLE_MAX_FILES];
+  size_t count;
+  // File being unpacked
+  FILE *fd;
+  char tmp_filepath[FILE_PATH_MAX];
+  mbedtls_sha256_context sha256;
+} bundle_t;
+
+static untar_status_t bundle_file_begin(const char *name, size_t size, void *ctx) {
+  bundle_t *bundle = ctx;
+
+  // Nothing to do with macOS metadata
+  const char *basename = strrchr(name, '/');
+  if (strncmp(basename ? basename + 1 : name, "._", 2) == 0) {
+    return UNTAR_SKIP;
+  }
+
+  if (bundle->count == BUNDLE_MAX_FILES) {
+    ESP_LOGE(TAG, "Too many files in bundle");
+    return UNTAR_ERR_CALLBACK;
+  }
+
+  bundle_file_t *file = &bundle->files[bundle->count];
+  if (snprintf(file->filepath, FILE_PATH_MAX, FILESYSTEM_BASE_PATH "/%s", name) >= FILE_PATH_MAX ||
+      snprintf(bundle->tmp_filepath, FILE_PATH_MAX, "%s" UPLOAD_TMP_EXTENSION, file->filepath) >= FILE_PATH_MAX) {
+    ESP_LOGE(TAG, "Filename too long in bundle : %s", name);
+    return UNTAR_ERR_CALLBACK;
+  }
+
+  // Firmwares are only updated through OTA, untar already rejected ".." paths
+  if (IS_FILE_EXTENSION(file->filepath, ".bin") || IS_FILE_EXTENSION(file->filepath, ".bin" GZIP_EXTENSION)) {
+    ESP_LOGE(TAG, "Invalid file in bundle : %s", name);
+    return UNTAR_ERR_CALLBACK;
+  }
+  if (size > MAX_FILE_SIZE) {
+    ESP_LOGE(TAG, "File too large in bundle : %s (%d bytes)", name, size);
+    return UNTAR_ERR_CALLBACK;
+  }
+
+  bundle->fd = fopen(bundle->tmp_filepath, "w");
+  if (!bundle->fd) {
+    ESP_LOGE(TAG, "Failed to create file : %s", bundle->tmp_filepath);
+    return UNTAR_ERR_CALLBACK;
+  }
+
+  ESP_LOGI(TAG, "Unpacking %s (%d bytes)...", name, size);
+  mbedtls_sha256_init(&bundle->sha256);
+  mbedtls_sha256_starts_ret(&bundle->sha256, 0);
+  return UNTAR_OK;
+}
+
+static bool bundle_file_data(const uint8_t *data, size_t len, void *ctx) {
+  bundle_t *bundle = ctx;
+
+  if (fwrite(data, 1, len, bundle->fd) != len) {
+    ESP_LOGE(TAG, "File write failed!");
+    return false;
+  }
+  mbedtls_sha256_update_ret(&bundle->sha256, data, len);
+  return true;
+}
+
+static bool bundle_file_end(void *ctx) {
+  bundle_t *bundle = ctx;
+
+  fclose(bundle->fd);
+  bundle->fd = NULL;
+  mbedtls_sha256_finish_ret(&bundle->sha256, bundle->files[bundle->count].sha256);
+  mbedtls_sha256_free(&bundle->sha256);
+  bundle->count++;
+  return true;
+}
+
+static esp_err_t feed_tar(untar_t *tar, const uint8_t *data, size_t len) {
+  untar_status_t status = untar_feed(tar, data, len);
+  if (status != UNTAR_OK) {
+    ESP_LOGE(TAG, "Invalid tar archive (%d)", status);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+static bool feed_untar(const uint8_t *data, size_t len, void *ctx) {
+  return feed_tar((untar_t*)ctx, data, len) == ESP_OK;
+}
+
+// A gzipped archive is decompressed on the fly
+static esp_err_t feed_bundle(gunzip_t *gz, untar_t *tar, const uint8_t *data, size_t len) {
+  if (gz == NULL) {
+    return feed_tar(tar, data, len);
+  }
+
+  gunzip_status_t status = gunzip_feed(gz, data, len, feed_untar, tar);
+  if (status != GUNZIP_OK && status != GUNZIP_ERR_OUTPUT) {
+    ESP_LOGE(TAG, "Decompression failed (%d)", status);
+  }
+  return status == GUNZIP_OK ? ESP_OK : ESP_FAIL;
+}
+
+static const char* get_tmp_filepath(const bundle_file_t *file, char *tmp_filepath) {
+  snprintf(tmp_filepath, FILE_PATH_MAX, "%s" UPLOAD_TMP_EXTENSION, file->filepath);
+  return tmp_filepath;
+}
+
+static const char* get_backup_filepath(const bundle_file_t *file, char *backup_filepath) {
+  snprintf(backup_filepath, FILE_PATH_MAX, "%s" BUNDLE_BACKUP_EXTENSION, file->filepath);
+  return backup_filepath;
+}
+
+static bool is_in_bundle(const bundle_t *bundle, const char *filepath) {
+  for (int i = 0; i < bundle->count; ++i) {
+    if (strcmp(bundle->files[i].filepath, filepath) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Remove everything unpacked so far, current files are left untouched
+static void discard_bundle(bundle_t *bundle) {
+  char tmp_filepath[FILE_PATH_MAX];
+
+  if (bundle->fd) {
+    fclose(bundle->fd);
+    unlink(bundle->tmp_filepath);
+    mbedtls_sha256_free(&bundle->sha256);
+  }
+  for (int i = 0; i < bundle->count; ++i) {
+    unlink(get_tmp_filepath(&bundle->files[i], tmp_filepath));
+  }
+}
+
+// Put back the files replaced so far, when the whole set couldn't be swapped in
+static void restore_bundle(bundle_t *bundle, int installed) {
+  char backup_filepath[FILE_PATH_MAX];
+
+  for (int i = installed - 1; i >= 0; --i) {
+    bundle_file_t *file = &bundle->files[i];
+    unlink(file->filepath);
+    if (file->has_backup && rename(get_backup_filepath(file, backup_filepath), file->filepath) != 0) {
+      ESP_LOGE(TAG, "Failed to restore %s", file->filepath);
+    }
+    filecache_invalidate(file->filepath);
+  }
+}
+
+// Swap the whole set in: every file is staged aside, and each live one is kept
+// as a backup until all the renames succeeded, so that a failure puts the
+// previous set back. Only a power loss in between leaves a mix of both.
+static esp_err_t install_bundle(bundle_t *bundle) {
+  char tmp_filepath[FILE_PATH_MAX];
+  char backup_filepath[FILE_PATH_MAX];
+  int installed;
+
+  for (installed = 0; installed < bundle->count; ++installed) {
+    bundle_file_t *file = &bundle->files[installed];
+    get_backup_filepath(file, backup_filepath);
+    unlink(backup_filepath);
+    file->has_backup = rename(file->filepath, backup_filepath) == 0;
+    if (rename(get_tmp_filepath(file, tmp_filepath), file->filepath) != 0) {
+      ESP_LOGE(TAG, "Failed to rename %s", tmp_filepath);
+      if (file->has_backup) {
+        rename(backup_filepath, file->filepath);
+      }
+      break;
+    }
+  }
+
+  if (installed < bundle->count) {
+    restore_bundle(bundle, installed);
+    discard_bundle(bundle);
+    return ESP_FAIL;
+  }
+
+  // Next downloads pick the new content, with the digests as ETag
+  for (int i = 0; i < bundle->count; ++i) {
+    bundle_file_t *file = &bundle->files[i];
+    if (file->has_backup) {
+      unlink(get_backup_filepath(file, backup_filepath));
+    }
+    filecache_update(file->filepath, file->sha256);
+    #if WITH_EMBEDDED_ASSETS
+    embedded_assets_update_override(file->filepath);
+    #endif
+
+    // Unless the bundle brings the precompressed version along
+    if (!IS_FILE_EXTENSION(file->filepath, GZIP_EXTENSION) &&
+        (snprintf(tmp_filepath, FILE_PATH_MAX, "%s" GZIP_EXTENSION, file->filepath) >= FILE_PATH_MAX ||
+         !is_in_bundle(bundle, tmp_filepath))) {
+      remove_gzip_sibling(file->filepath);
+    }
+  }
+  return ESP_OK;
+}
+
+static esp_err_t receive_bundle(httpd_req_t *req, bundle_t *bundle, untar_t *tar, char *buffer) {
+  int received;
+  gunzip_t *gz = NULL;
+  esp_err_t ret = ESP_OK;
+  // The gzip magic bytes tell how to read the archive, they can come in separate parts
+  uint8_t magic[2];
+  size_t magic_len = 0;
+
+  // Content length of the request gives the size of the archive being uploaded
+  int remaining = req->content_len;
+
+  while (remaining > 0 && ret == ESP_OK) {
+    upload_progress_update(req->content_len - remaining, req->content_len);
+
+    // Receive the archive part by part into a buffer
+    if ((received = httpd_req_recv(req, buffer, min(remaining, TRANSFER_BUFSIZE))) <= 0) {
+      if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+        // Retry if timeout occurred
+        continue;
+      }
+      ret = ESP_FAIL;
+      break;
+    }
+
+    // Keep track of remaining size of the archive left to be uploaded
+    remaining -= received;
+
+    const uint8_t *data = (uint8_t*)buffer;
+    size_t len = received;
+    if (magic_len < sizeof(magic)) {
+      size_t count = min(len, sizeof(magic) - magic_len);
+      memcpy(magic + magic_len, data, count);
+      magic_len += count;
+      data += count;
+      len -= count;
+      if (magic_len < sizeof(magic) && remaining > 0) {
+        continue;
+      }
+
+      if (magic_len == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b && (gz = gunzip_create()) == NULL) {
+        ret = ESP_ERR_NO_MEM;
+        break;
+      }
+      ret = feed_bundle(gz, tar, magic, magic_len);
+    }
+    if (ret == ESP_OK && len > 0) {
+      ret = feed_bundle(gz, tar, data, len);
+    }
+  }
+
+  if (ret == ESP_OK && gz) {
+    gunzip_status_t status = gunzip_finish(gz);
+    if (status != GUNZIP_OK) {
+      ESP_LOGE(TAG, "Integrity check failed (%d)", status);
+      ret = ESP_ERR_INVALID_CRC;
+    }
+    ESP_LOGI(TAG, "Decompressed %d bytes into %d bytes", req->content_len, gunzip_output_size(gz));
+  }
+  if (gz) {
+    gunzip_destroy(gz);
+  }
+  if (ret == ESP_OK) {
+    untar_status_t status = untar_finish(tar);
+    if (status != UNTAR_OK) {
+      ESP_LOGE(TAG, "Invalid tar archive (%d)", status);
+      ret = ESP_FAIL;
+    }
+  }
+
+  upload_progress_update(req->content_len, req->content_len);
+  return ret;
+}
+
+// Handler to upload a tar archive of files onto the filesystem
+static esp_err_t upload_bundle_handler(httpd_req_t *req) {
+  untar_callbacks_t callbacks = {
+    .file_begin = bundle_file_begin,
+    .file_data = bundle_file_data,
+    .file_end = bundle_file_end
+  };
+
+  bundle_t *bundle = calloc(1, sizeof(bundle_t));
+  untar_t *tar = bundle ? untar_create(&callbacks, bundle) : NULL;
+  if (tar == NULL) {
+    free(bundle);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not enough memory to unpack");
+    return ESP_FAIL;
+  }
+
+  char *buffer = acquire_transfer_buffer(req);
+  if (buffer == NULL) {
+    untar_destroy(tar);
+    free(bundle);
+    return ESP_FAIL;
+  }
+
+  ESP_LOGI(TAG, "Receiving bundle (%d bytes)...", req->content_len);
+  esp_err_t ret = receive_bundle(req, bundle, tar, buffer);
+  transfer_buffer_release(buffer);
+  untar_destroy(tar);
+
+  if (ret != ESP_OK) {
+    discard_bundle(bundle);
+    free(bundle);
+
+    ESP_LOGE(TAG, "Bundle reception failed!");
+    // Respond with 400 Bad Request
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid or incomplete bundle");
+    return ESP_FAIL;
+  }
+
+  ret = install_bundle(bundle);
+  ESP_LOGI(TAG, "Bundle of %d files installed", bundle->count);
+  free(bundle);
+
+  if (ret != ESP_OK) {
+    // Respond with 500 Internal Server Error
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write files to storage");
+    return ESP_FAIL;
+  }
+
+  // Redirect onto root
+  httpd_resp_set_status(req, "303 See Other");
+  httpd_resp_set_hdr(req, "Location", "/");
+  httpd_resp_sendstr(req, "Bundle uploaded successfully");
+  return ESP_OK;
 }
 
 void start_web_file(httpd_handle_t server) {
   ESP_LOGI(TAG, "Start web file");
 
+  // URI handlers for resumable uploads, registered first as "/*" matches them too
+  httpd_uri_t session_handlers[] = {
+    { .uri = "/upload-session/*", .method = HTTP_POST, .handler = session_post_handler, .user_ctx = NULL },
+    { .uri = "/upload-session/*", .method = HTTP_PUT, .handler = session_put_handler, .user_ctx = NULL },
+    { .uri = "/upload-session/*", .method = HTTP_GET, .handler = session_get_handler, .user_ctx = NULL },
+    { .uri = "/upload-session/*", .method = HTTP_DELETE, .handler = session_delete_handler, .user_ctx = NULL }
+  };
+  for (int i = 0; i < sizeof(session_handlers) / sizeof(session_handlers[0]); ++i) {
+    httpd_register_uri_handler(server, &session_handlers[i]);
+  }
+
   // URI handler for accessing files from server
   httpd_uri_t file_download = {
     .uri       = "/*",  // Match all URIs of type /path/to/file
@@ -367,4 +1539,13 @@ void start_web_file(httpd_handle_t server) {
     .user_ctx  = NULL
   };
   httpd_register_uri_handler(server, &file_upload);
+
+  // URI handler for uploading the whole web UI at once
+  httpd_uri_t bundle_upload = {
+    .uri       = "/upload-bundle",
+    .method    = HTTP_POST,
+    .handler   = upload_bundle_handler,
+    .user_ctx  = NULL
+  };
+  httpd_register_uri_handler(server, &bundle_upload);
 }
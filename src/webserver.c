@@ -10,6 +10,7 @@
 
 #include "websocket.h"
 #include "webfile.h"
+#include "link_stats.h"
 
 // Local variables
 
@@ -30,6 +31,8 @@ static httpd_handle_t start_webserver(void) {
   config.close_fn = on_client_disconnected;
   config.uri_match_fn = httpd_uri_match_wildcard;
   config.lru_purge_enable = true;
+  // Websocket, files, upload sessions and diagnostics
+  config.max_uri_handlers = 16;
 
   ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
   esp_err_t ret = httpd_start(&server, &config);
@@ -41,6 +44,8 @@ static httpd_handle_t start_webserver(void) {
   ESP_LOGI(TAG, "Registering URI handlers");
   
   start_websocket(server);
+  start_link_stats(server);
+  // Last, it matches every path
   start_web_file(server);
 
   return server;
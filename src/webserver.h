@@ -3,6 +3,10 @@
 
 #include <esp_http_server.h>
 
+// Requests processed at the same time. esp_http_server runs every handler
+// from its single task, raise it along with asynchronous request handling.
+#define HTTPD_WORKERS 1
+
 void setup_server(void);
 
 #endif
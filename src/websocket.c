@@ -4,6 +4,10 @@
 #include <sys/unistd.h>
 #include <esp_log.h>
 #include <esp_http_server.h>
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "cJSON.h"
+#include "utils.h"
 
 // Local variables
 
@@ -11,8 +15,11 @@ static const char *TAG = "websocket";
 
 #define MAX_CLIENTS 4
 static int clients_fd[MAX_CLIENTS];
+static websocket_client_stats_t clients_stats[MAX_CLIENTS];
 
-#define MAX_CALLBACKS 4
+// Modules set up before the server register too (settings, Wi-Fi channel):
+// starting or restarting the websocket must keep these
+#define MAX_CALLBACKS 8
 static wsserver_receive_callback receive_callbacks[MAX_CALLBACKS];
 
 static httpd_handle_t server = NULL;
@@ -26,6 +33,35 @@ struct async_resp_arg {
 
 // Manage clients
 
+static websocket_client_stats_t* find_client_stats(int sockfd) {
+  for (int i = 0; i < MAX_CLIENTS; ++i) {
+    if (clients_fd[i] == sockfd) {
+      return &clients_stats[i];
+    }
+  }
+  return NULL;
+}
+
+// IPv4 address of the client, the server socket is dual stack
+static uint32_t get_peer_address(int sockfd) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) != 0) {
+    return 0;
+  }
+
+  if (addr.ss_family == AF_INET) {
+    return ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+  }
+  if (addr.ss_family == AF_INET6) {
+    // IPv4-mapped address, ::ffff:a.b.c.d
+    uint32_t mapped;
+    memcpy(&mapped, &((struct sockaddr_in6 *)&addr)->sin6_addr.s6_addr[12], sizeof(mapped));
+    return mapped;
+  }
+  return 0;
+}
+
 static esp_err_t on_client_connected(httpd_handle_t hd, int sockfd) {
   ESP_LOGI(TAG, "WS Client Connected %i", sockfd);
   int available_index = -1;
@@ -45,6 +81,9 @@ static esp_err_t on_client_connected(httpd_handle_t hd, int sockfd) {
   }
 
   clients_fd[available_index] = sockfd;
+  memset(&clients_stats[available_index], 0, sizeof(websocket_client_stats_t));
+  clients_stats[available_index].fd = sockfd;
+  clients_stats[available_index].address = get_peer_address(sockfd);
 
   return ESP_OK;
 }
@@ -86,8 +125,16 @@ esp_err_t broadcast_message(char* msg) {
     ws_pkt.type = HTTPD_WS_TYPE_TEXT;
 
     ESP_LOGI(TAG, "Send message to %i", clients_fd[i]);
+    int64_t start = esp_timer_get_time();
     ret = httpd_ws_send_frame_async(server, clients_fd[i], &ws_pkt);
+    uint32_t duration = esp_timer_get_time() - start;
+
+    websocket_client_stats_t *stats = &clients_stats[i];
+    stats->frames_sent++;
+    stats->last_send_us = duration;
+    stats->max_send_us = max(stats->max_send_us, duration);
     if (ret != ESP_OK) {
+      stats->send_failures++;
       on_ws_client_disconnected(clients_fd[i]);
     }
   }
@@ -95,6 +142,62 @@ esp_err_t broadcast_message(char* msg) {
   return ESP_OK;
 }
 
+// Answer clock sync requests directly to the sender, they are not forwarded to the listeners.
+// The client estimates the RTT and its offset to the device clock from the exchange,
+// and reports its average RTT (ms) with the next pings for the diagnostics.
+// { "command": "ping", "parameters": { "client_time": double, "rtt": double } }
+// { "pong": { "client_time": double, "device_time": int64 } }
+static bool handle_ping(httpd_req_t *req, httpd_ws_frame_t *ws_pkt) {
+  // Cheap check before parsing, most frames are not pings
+  if (strstr((char*)ws_pkt->payload, "\"ping\"") == NULL) {
+    return false;
+  }
+
+  cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+  if (root == NULL) {
+    return false;
+  }
+
+  bool handled = false;
+  cJSON *command = cJSON_GetObjectItem(root, "command");
+  if (!cJSON_IsString(command) || strcmp("ping", command->valuestring) != 0) {
+    goto end;
+  }
+
+  double client_time = 0;
+  cJSON *parameters = cJSON_GetObjectItem(root, "parameters");
+  cJSON *client_time_node = parameters ? cJSON_GetObjectItem(parameters, "client_time") : NULL;
+  if (cJSON_IsNumber(client_time_node)) {
+    client_time = client_time_node->valuedouble;
+  }
+
+  cJSON *rtt_node = parameters ? cJSON_GetObjectItem(parameters, "rtt") : NULL;
+  websocket_client_stats_t *stats = find_client_stats(httpd_req_to_sockfd(req));
+  if (cJSON_IsNumber(rtt_node) && stats != NULL) {
+    stats->rtt_ms = max(0, rtt_node->valueint);
+  }
+
+  char message[96];
+  // Device time is taken as late as possible to keep it centered in the round trip
+  snprintf(message, sizeof(message), "{\"pong\":{\"client_time\":%.3f,\"device_time\":%lld}}",
+           client_time, esp_timer_get_time());
+
+  httpd_ws_frame_t pong;
+  memset(&pong, 0, sizeof(httpd_ws_frame_t));
+  pong.payload = (uint8_t*)message;
+  pong.len = strlen(message);
+  pong.type = HTTPD_WS_TYPE_TEXT;
+
+  if (httpd_ws_send_frame(req, &pong) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to send pong to %i", httpd_req_to_sockfd(req));
+  }
+  handled = true;
+
+end:
+  cJSON_Delete(root);
+  return handled;
+}
+
 // Handle received messages and forward to listener meaningful messages
 esp_err_t receive_message(httpd_req_t *req) {
   // Check for handshake
@@ -133,13 +236,20 @@ esp_err_t receive_message(httpd_req_t *req) {
       free(buffer);
       return ret;
     }
-    
+
+    if (handle_ping(req, &ws_pkt)) {
+      free(buffer);
+      return ESP_OK;
+    }
+
     // Broacast received message
     for (int i = 0; i < MAX_CALLBACKS; ++i) {
       if (receive_callbacks[i] != NULL) {
         receive_callbacks[i](&ws_pkt);
       }
     }
+
+    free(buffer);
   }
 
   ESP_LOGI(TAG, "Packet type: %d", ws_pkt.type);
@@ -165,7 +275,7 @@ void register_callback(wsserver_receive_callback callback) {
     ESP_LOGI(TAG, "Register callback in the first available place");
     receive_callbacks[available_index] = callback;
   } else {
-    ESP_LOGI(TAG, "Register callback has no available place");
+    ESP_LOGE(TAG, "Register callback has no available place");
   }
 }
 
@@ -189,11 +299,6 @@ void start_websocket(httpd_handle_t new_server) {
     clients_fd[i] = -1;
   }
 
-  // Init callbacks
-  for (int i = 0; i < MAX_CALLBACKS; ++i) {
-    receive_callbacks[i] = NULL;
-  }
-
   // URI handler for websockets to server
   static const httpd_uri_t ws = {
     .uri        = "/ws",
@@ -205,6 +310,16 @@ void start_websocket(httpd_handle_t new_server) {
   httpd_register_uri_handler(server, &ws);
 }
 
+int websocket_get_client_stats(websocket_client_stats_t *stats, int max_count) {
+  int count = 0;
+  for (int i = 0; i < MAX_CLIENTS && count < max_count; ++i) {
+    if (clients_fd[i] != -1) {
+      stats[count++] = clients_stats[i];
+    }
+  }
+  return count;
+}
+
 void stop_websocket(void) {
   server = NULL;
 }
\ No newline at end of file
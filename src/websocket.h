@@ -5,6 +5,18 @@
 
 typedef void (*wsserver_receive_callback)(httpd_ws_frame_t* ws_pkt);
 
+// Link figures of a connected client, for the diagnostics
+typedef struct {
+  int fd;
+  uint32_t address; // IPv4 of the client in network order, 0 if unknown
+  uint32_t rtt_ms; // Average reported by the dashboard with its pings, 0 if none
+  uint32_t frames_sent;
+  uint32_t send_failures;
+  // A send blocks while the socket buffer is full, long sends mean a congested link
+  uint32_t last_send_us;
+  uint32_t max_send_us;
+} websocket_client_stats_t;
+
 void start_websocket(httpd_handle_t server);
 void stop_websocket(void);
 
@@ -19,4 +31,8 @@ esp_err_t broadcast_message(char* msg);
 void register_callback(wsserver_receive_callback callback);
 void unregister_callback(wsserver_receive_callback callback);
 
+// Diagnostics
+
+int websocket_get_client_stats(websocket_client_stats_t *stats, int max_count);
+
 #endif
@@ -7,17 +7,37 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
+#include "channel_score.h"
+#include "settings.h"
+#include "websocket.h"
+#include "cJSON.h"
+
 #define WIFI_SSID      "PowerJeep"
 #define WIFI_PASS      "Rubicon!"
-#define WIFI_CHANNEL   10
+#define WIFI_CHANNEL   10 // Without scan, or if it fails
 #define MAX_STA_CONN   2
 
+// Pick the least congested channel at startup, from a scan of the neighbours
+#define WITH_CHANNEL_SCAN 1
+// Scan again when no station is connected, 0 to disable
+#define CHANNEL_RESCAN_INTERVAL_MS 0 // ex: (30*60*1000)
+#define CHANNEL_SCAN_TIME_MS 120 // Per channel
+#define CHANNEL_SCAN_MAX_APS 32
+
 static const char *TAG = "wifi";
 
+// Variables in memory
+
+static uint8_t wifi_channel = WIFI_CHANNEL;
+static channel_scores_t channel_scores;
+// esp_timer time of the last scan, 0 if none
+static int64_t channel_scanned_at = 0;
+
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                     int32_t event_id, void* event_data) {
     if (event_id == WIFI_EVENT_AP_STACONNECTED) {
@@ -31,6 +51,138 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     }
 }
 
+#if WITH_CHANNEL_SCAN
+// Blocking scan of all channels, needs the station interface to be started
+static esp_err_t scan_channels(channel_scores_t *scores) {
+    wifi_scan_config_t scan_config = {
+        .show_hidden = true,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = { .min = CHANNEL_SCAN_TIME_MS, .max = CHANNEL_SCAN_TIME_MS },
+    };
+    esp_err_t ret = esp_wifi_scan_start(&scan_config, true);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint16_t count = CHANNEL_SCAN_MAX_APS;
+    wifi_ap_record_t *records = malloc(count * sizeof(wifi_ap_record_t));
+    if (records == NULL) {
+        // Frees the results
+        count = 0;
+        esp_wifi_scan_get_ap_records(&count, NULL);
+        return ESP_ERR_NO_MEM;
+    }
+    ret = esp_wifi_scan_get_ap_records(&count, records);
+
+    channel_scan_entry_t entries[CHANNEL_SCAN_MAX_APS];
+    for (int i = 0; ret == ESP_OK && i < count; ++i) {
+        entries[i].channel = records[i].primary;
+        entries[i].rssi = records[i].rssi;
+    }
+    free(records);
+
+    if (ret == ESP_OK) {
+        channel_score(entries, count, scores);
+        ESP_LOGI(TAG, "Scanned %d access points", count);
+    }
+    return ret;
+}
+
+// Keep the scan for the diagnostics and persist the chosen channel
+static void select_channel(const channel_scores_t *scores) {
+    uint8_t channel = channel_select(scores, wifi_channel);
+
+    channel_scores = *scores;
+    channel_scanned_at = esp_timer_get_time();
+
+    for (int i = CHANNEL_MIN; i <= CHANNEL_MAX; ++i) {
+        ESP_LOGD(TAG, "Channel %d: %d access points, score %d", i, scores->ap_count[i], scores->score[i]);
+    }
+    ESP_LOGI(TAG, "Channel %d selected, score %d", channel, scores->score[channel]);
+
+    wifi_channel = channel;
+
+    settings_set_wifi_channel(channel);
+}
+
+#if CHANNEL_RESCAN_INTERVAL_MS > 0
+// Scan again while nobody is connected, so that nobody notices the channel change
+static void channel_scan_task(void *pvParameter) {
+    while (true) {
+        vTaskDelay(CHANNEL_RESCAN_INTERVAL_MS / portTICK_PERIOD_MS);
+
+        wifi_sta_list_t stations;
+        if (esp_wifi_ap_get_sta_list(&stations) != ESP_OK || stations.num > 0) {
+            continue;
+        }
+
+        channel_scores_t scores;
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+        esp_err_t ret = scan_channels(&scores);
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Channel scan failed (%s)", esp_err_to_name(ret));
+            continue;
+        }
+
+        uint8_t previous_channel = wifi_channel;
+        select_channel(&scores);
+        if (wifi_channel != previous_channel) {
+            wifi_config_t wifi_config;
+            ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_AP, &wifi_config));
+            wifi_config.ap.channel = wifi_channel;
+            ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &wifi_config));
+        }
+    }
+}
+#endif
+#endif
+
+// Broadcast the channel and the last scan
+// {
+//   "wifi_channel": {
+//     "channel": 6,
+//     "ap_count": [2, 0, 1, 0, 0, 3, 0, 0, 1, 0, 1], // Channels 1 to 11
+//     "score": [610, 635, 660, 645, 660, 675, 630, 585, 605, 565, 525], // Lower is better
+//     "scan_age_ms": 12000 // -1 without scan
+//   }
+// }
+static void broadcast_channel(void) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON *diagnostics = cJSON_AddObjectToObject(root, "wifi_channel");
+    cJSON_AddNumberToObject(diagnostics, "channel", wifi_channel);
+    cJSON *ap_count = cJSON_AddArrayToObject(diagnostics, "ap_count");
+    cJSON *score = cJSON_AddArrayToObject(diagnostics, "score");
+    for (int i = CHANNEL_MIN; i <= CHANNEL_MAX; ++i) {
+        cJSON_AddItemToArray(ap_count, cJSON_CreateNumber(channel_scores.ap_count[i]));
+        cJSON_AddItemToArray(score, cJSON_CreateNumber(channel_scores.score[i]));
+    }
+    cJSON_AddNumberToObject(diagnostics, "scan_age_ms",
+        channel_scanned_at ? (esp_timer_get_time() - channel_scanned_at) / 1000 : -1);
+
+    char *message = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    broadcast_message(message);
+    free(message);
+}
+
+// Manage commands from web sockets
+// - Read the channel diagnostics
+// { "command": "wifi_channel" }
+static void data_received(httpd_ws_frame_t* ws_pkt) {
+    cJSON *root = cJSON_Parse((char*)ws_pkt->payload);
+    if (root == NULL) {
+        return;
+    }
+
+    cJSON *command = cJSON_GetObjectItem(root, "command");
+    if (cJSON_IsString(command) && strcmp("wifi_channel", command->valuestring) == 0) {
+        broadcast_channel();
+    }
+
+    cJSON_Delete(root);
+}
+
 void setup_softap(void) {
     esp_netif_create_default_wifi_ap();
 
@@ -39,11 +191,32 @@ void setup_softap(void) {
 
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
 
+    // Last chosen channel, kept unless the scan finds a clearly better one
+    settings_t settings;
+    settings_get(&settings);
+    if (settings.wifi_channel >= CHANNEL_MIN && settings.wifi_channel <= CHANNEL_MAX) {
+        wifi_channel = settings.wifi_channel;
+    }
+
+#if WITH_CHANNEL_SCAN
+    // Scan before the access point starts, on the station interface
+    channel_scores_t scores;
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    esp_err_t ret = scan_channels(&scores);
+    ESP_ERROR_CHECK(esp_wifi_stop());
+    if (ret == ESP_OK) {
+        select_channel(&scores);
+    } else {
+        ESP_LOGE(TAG, "Channel scan failed (%s), using channel %d", esp_err_to_name(ret), wifi_channel);
+    }
+#endif
+
     wifi_config_t wifi_config = {
         .ap = {
             .ssid = WIFI_SSID,
             .ssid_len = strlen(WIFI_SSID),
-            .channel = WIFI_CHANNEL,
+            .channel = wifi_channel,
             .password = WIFI_PASS,
             .max_connection = MAX_STA_CONN,
             .authmode = WIFI_AUTH_WPA_WPA2_PSK
@@ -57,5 +230,11 @@ void setup_softap(void) {
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    ESP_LOGI(TAG, "wifi_init_softap finished. SSID:%s password:%s channel:%d", WIFI_SSID, WIFI_PASS, WIFI_CHANNEL);
+    ESP_LOGI(TAG, "wifi_init_softap finished. SSID:%s password:%s channel:%d", WIFI_SSID, WIFI_PASS, wifi_channel);
+
+#if WITH_CHANNEL_SCAN && CHANNEL_RESCAN_INTERVAL_MS > 0
+    xTaskCreate(&channel_scan_task, "channel_scan_task", 3072, NULL, 1, NULL);
+#endif
+
+    register_callback(data_received);
 }
@@ -0,0 +1,115 @@
+// Channel scores of synthetic scans, and the choice made from them
+
+#include "test.h"
+#include "channel_score.h"
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+// Cost of an access point on its own channel, 5 times its interference
+#define FULL_OVERLAP(rssi) (5 * (10 + (rssi) + 95))
+
+static void test_overlap_weighting(void) {
+  channel_scores_t scores;
+
+  // Weight 5 on the channel, down to 1 four channels away
+  const channel_scan_entry_t one[] = { { 6, -50 } };
+  const uint32_t expected[CHANNEL_MAX + 1] = { 0, 0, 55, 110, 165, 220, 275, 220, 165, 110, 55, 0 };
+  channel_score(one, COUNT(one), &scores);
+  for (int channel = CHANNEL_MIN; channel <= CHANNEL_MAX; ++channel) {
+    CHECK_EQ(scores.score[channel], expected[channel]);
+    CHECK_EQ(scores.ap_count[channel], channel == 6 ? 1 : 0);
+  }
+
+  // Interference grows with the signal, from the noise floor to a strong neighbour
+  const channel_scan_entry_t weak[] = { { 1, -100 } };
+  channel_score(weak, COUNT(weak), &scores);
+  CHECK_EQ(scores.score[1], 5 * 10);
+  const channel_scan_entry_t strong[] = { { 1, -10 } };
+  channel_score(strong, COUNT(strong), &scores);
+  CHECK_EQ(scores.score[1], FULL_OVERLAP(-30));
+
+  // Access points add up
+  const channel_scan_entry_t two[] = { { 6, -50 }, { 6, -70 } };
+  channel_score(two, COUNT(two), &scores);
+  CHECK_EQ(scores.score[6], FULL_OVERLAP(-50) + FULL_OVERLAP(-70));
+  CHECK_EQ(scores.ap_count[6], 2);
+
+  // Channels 12 to 14 can't be used but interfere with the upper ones
+  const channel_scan_entry_t upper[] = { { 13, -60 }, { 14, -60 } };
+  channel_score(upper, COUNT(upper), &scores);
+  CHECK_EQ(scores.score[11], (3 + 2) * 45);
+  CHECK_EQ(scores.score[10], (2 + 1) * 45);
+  CHECK_EQ(scores.score[9], 1 * 45);
+  CHECK_EQ(scores.score[8], 0);
+  for (int channel = CHANNEL_MIN; channel <= CHANNEL_MAX; ++channel) {
+    CHECK_EQ(scores.ap_count[channel], 0);
+  }
+}
+
+static void test_tie_break(void) {
+  channel_scores_t scores;
+
+  // Nothing around: the first of 1, 6 and 11
+  channel_score(NULL, 0, &scores);
+  CHECK_EQ(channel_select(&scores, 0), 1);
+
+  // 5 and 6 tie, 6 doesn't overlap the neighbours on 1 and 11
+  const channel_scan_entry_t around[] = { { 1, -60 }, { 10, -60 } };
+  channel_score(around, COUNT(around), &scores);
+  CHECK_EQ(scores.score[5], scores.score[6]);
+  CHECK_EQ(channel_select(&scores, 0), 6);
+
+  // 1 and 11 tie, the lower one
+  const channel_scan_entry_t middle[] = { { 6, -40 } };
+  channel_score(middle, COUNT(middle), &scores);
+  CHECK_EQ(channel_select(&scores, 0), 1);
+
+  // Only ties are broken, a lower score wins over 1, 6 and 11
+  for (int channel = CHANNEL_MIN; channel <= CHANNEL_MAX; ++channel) {
+    scores.score[channel] = 100;
+  }
+  scores.score[1] = scores.score[6] = scores.score[11] = 11;
+  scores.score[3] = 10;
+  CHECK_EQ(channel_select(&scores, 0), 3);
+}
+
+static void test_switch_margin(void) {
+  channel_scores_t scores = { 0 };
+  for (int channel = CHANNEL_MIN; channel <= CHANNEL_MAX; ++channel) {
+    scores.score[channel] = 1000;
+  }
+
+  // Exactly 25% better keeps the current channel, more switches
+  scores.score[6] = 400;
+  scores.score[1] = 300;
+  CHECK_EQ(channel_select(&scores, 6), 6);
+  scores.score[1] = 299;
+  CHECK_EQ(channel_select(&scores, 6), 1);
+
+  // Without a valid current channel, the best one
+  scores.score[1] = 300;
+  CHECK_EQ(channel_select(&scores, 0), 1);
+  CHECK_EQ(channel_select(&scores, 12), 1);
+
+  // A current channel with no interference is never left
+  scores.score[6] = 0;
+  scores.score[1] = 0;
+  CHECK_EQ(channel_select(&scores, 6), 6);
+
+  // Busy scan: 11 is the best, but only 22% better than 6 which is kept
+  const channel_scan_entry_t scan[] = { { 1, -40 }, { 1, -60 }, { 6, -50 }, { 6, -70 }, { 6, -80 },
+                                        { 11, -45 }, { 3, -85 }, { 9, -75 }, { 13, -60 } };
+  channel_score(scan, COUNT(scan), &scores);
+  CHECK_EQ(scores.score[6], 675);
+  CHECK_EQ(scores.score[11], 525);
+  CHECK_EQ(channel_select(&scores, 0), 11);
+  CHECK_EQ(channel_select(&scores, 6), 6);
+  CHECK_EQ(channel_select(&scores, 11), 11);
+}
+
+int main(void) {
+  test_overlap_weighting();
+  test_tie_break();
+  test_switch_margin();
+  return test_report("channel_score_test");
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Generate the seed corpus of test/dns_parser_fuzz.c, run from this directory.
+
+The outputs are committed, this is only needed to change them. The queries
+follow what phones and laptops send when they join the access point: the
+connectivity check hosts of each OS, with their query types, flags and EDNS
+record. A few malformed packets cover the rejection paths.
+"""
+
+import os
+import struct
+
+TYPES = {"A": 1, "AAAA": 28, "HTTPS": 65, "PTR": 12}
+RD = 0x0100
+
+
+def name(host):
+    return b"".join(bytes([len(label)]) + label.encode() for label in host.split(".") if label) + b"\0"
+
+
+def question(host, query_type):
+    return name(host) + struct.pack(">HH", TYPES[query_type], 1)
+
+
+def edns(payload_size):
+    # Root name, OPT type, UDP payload size as class, no extended flags
+    return b"\0" + struct.pack(">HHIH", 41, payload_size, 0, 0)
+
+
+def query(query_id, questions, flags=RD, additional=b"", ar_count=0):
+    header = struct.pack(">HHHHHH", query_id, flags, len(questions), 0, 0, ar_count)
+    return header + b"".join(questions) + additional
+
+
+def main():
+    os.makedirs("corpus", exist_ok=True)
+    packets = {}
+
+    # iOS and macOS: A, AAAA and HTTPS for each host, without EDNS
+    for label, host in [("captive", "captive.apple.com"), ("www", "www.apple.com")]:
+        for query_type in ("A", "AAAA", "HTTPS"):
+            packets["ios-{}-{}".format(label, query_type.lower())] = \
+                query(0x1a00 + len(packets), [question(host, query_type)])
+
+    # Android: A and AAAA with an EDNS record
+    for host in ["connectivitycheck.gstatic.com", "www.google.com"]:
+        for query_type in ("A", "AAAA"):
+            packets["android-{}-{}".format(host.split(".")[0], query_type.lower())] = \
+                query(0x5c00 + len(packets), [question(host, query_type)], additional=edns(1232), ar_count=1)
+
+    # Windows: A and AAAA, including the IPv6 probe host
+    for host, query_type in [("www.msftconnecttest.com", "A"), ("www.msftconnecttest.com", "AAAA"),
+                             ("dns.msftncsi.com", "A"), ("ipv6.msftconnecttest.com", "AAAA")]:
+        packets["windows-{}-{}".format(host.split(".")[0], query_type.lower())] = \
+            query(0x7e00 + len(packets), [question(host, query_type)])
+
+    # Resolvers randomizing the case of names, and reverse lookups of the gateway
+    packets["mixed-case"] = query(0x2020, [question("CaPtIvE.aPpLe.CoM", "A")])
+    packets["ptr-gateway"] = query(0x3030, [question("1.4.168.192.in-addr.arpa", "PTR")])
+    packets["two-questions"] = query(0x4040, [question("captive.apple.com", "A"), question("www.apple.com", "A")])
+    packets["longest-name"] = query(0x5050, [question(".".join(["a" * 63] * 3 + ["b" * 61]), "A")])
+
+    # Rejected or answered with NOTIMP
+    packets["reject-response"] = query(0x6060, [question("captive.apple.com", "A")], flags=0x8180)
+    packets["reject-status-opcode"] = query(0x7070, [], flags=2 << 11)
+    packets["reject-no-question"] = query(0x8080, [])
+    packets["reject-pointer"] = query(0x9090, [b"\xc0\x0c" + struct.pack(">HH", 1, 1)])
+    packets["reject-truncated"] = query(0xa0a0, [question("connectivitycheck.gstatic.com", "A")])[:30]
+    packets["reject-label-past-end"] = query(0xb0b0, [b"\x3fabc"])
+    packets["reject-header-only"] = bytes(8)
+
+    for key, packet in packets.items():
+        with open(os.path.join("corpus", key + ".bin"), "wb") as f:
+            f.write(packet)
+
+
+if __name__ == "__main__":
+    main()
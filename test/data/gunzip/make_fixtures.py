@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Generate the gzip streams fed to test/gunzip_test.c, run from this directory.
+
+The outputs are committed, this is only needed to change them.
+"""
+
+import gzip
+import struct
+import zlib
+
+FTEXT, FHCRC, FEXTRA, FNAME, FCOMMENT = 1, 2, 4, 8, 16
+
+
+def lorem():
+    words = ("car pedal speed brake wifi softap dashboard firmware throttle profile "
+             "battery motor telemetry gzip stream window").split()
+    lines = []
+    state = 1
+    for i in range(160):
+        line = []
+        for _ in range(8 + i % 5):
+            state = (state * 1103515245 + 12345) & 0x7FFFFFFF
+            line.append(words[(state >> 16) % len(words)])
+        lines.append(" ".join(line))
+    return ("\n".join(lines) + "\n").encode()
+
+
+def raw_deflate(data):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+    return compressor.compress(data) + compressor.flush()
+
+
+def trailer(data):
+    return struct.pack("<II", zlib.crc32(data), len(data) & 0xFFFFFFFF)
+
+
+def with_all_headers(data):
+    header = bytes([0x1F, 0x8B, 8, FEXTRA | FNAME | FCOMMENT | FHCRC]) + struct.pack("<I", 0) + bytes([2, 3])
+    extra = b"PJ\x04\x00abcd"
+    header += struct.pack("<H", len(extra)) + extra + b"lorem.txt\x00" + b"a comment\x00"
+    header += struct.pack("<H", zlib.crc32(header) & 0xFFFF)
+    return header + raw_deflate(data) + trailer(data)
+
+
+def write(name, content):
+    with open(name, "wb") as f:
+        f.write(content)
+
+
+def main():
+    data = lorem()
+    write("lorem.txt", data)
+
+    with open("lorem.txt.gz", "wb") as raw:
+        with gzip.GzipFile(filename="lorem.txt", mode="wb", compresslevel=9, fileobj=raw, mtime=0) as f:
+            f.write(data)
+    stream = open("lorem.txt.gz", "rb").read()
+
+    write("headers.gz", with_all_headers(data))
+    write("empty.gz", gzip.compress(b"", mtime=0))
+
+    bad_crc = bytearray(stream)
+    bad_crc[-8] ^= 0x01
+    write("bad-crc.gz", bytes(bad_crc))
+
+    bad_size = bytearray(stream)
+    bad_size[-4] ^= 0x01
+    write("bad-size.gz", bytes(bad_size))
+
+    write("truncated.gz", stream[:-20])
+
+    # Reserved block type
+    write("corrupted.gz", stream[:10] + b"\x07" + b"\x00" * 32)
+
+    write("not-gzip.gz", b"PK\x03\x04" + b"\x00" * 26)
+
+
+if __name__ == "__main__":
+    main()
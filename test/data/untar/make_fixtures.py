@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Generate the tar archives fed to test/untar_test.c, run from this directory.
+
+The outputs are committed, this is only needed to change them. The content of
+every file repeats its name, so that the test checks it without a listing.
+"""
+
+import io
+import tarfile
+
+LONG_DIR = "assets/" + "d" * 120
+LONG_NAME = "assets/" + "n" * 190 + ".js"
+PAX_NAME = "assets/" + "p" * 240 + ".css"
+
+
+def content(name, size):
+    return (name.encode() * (size // len(name) + 1))[:size]
+
+
+def add_file(tar, name, size):
+    info = tarfile.TarInfo(name)
+    info.size = size
+    info.mtime = 0
+    tar.addfile(info, io.BytesIO(content(name[2:] if name.startswith("./") else name, size)))
+
+
+def add_entry(tar, name, type, linkname=""):
+    info = tarfile.TarInfo(name)
+    info.type = type
+    info.linkname = linkname
+    info.mtime = 0
+    tar.addfile(info)
+
+
+def archive(format, entries, **kwargs):
+    raw = io.BytesIO()
+    with tarfile.open(fileobj=raw, mode="w", format=format, **kwargs) as tar:
+        entries(tar)
+    return raw.getvalue()
+
+
+def write(name, data):
+    with open(name, "wb") as f:
+        f.write(data)
+
+
+def main():
+    def simple(tar):
+        add_entry(tar, "./", tarfile.DIRTYPE)
+        add_file(tar, "./index.html", 1000)
+        add_entry(tar, "./css", tarfile.DIRTYPE)
+        add_file(tar, "./css/app.css", 512)
+        add_file(tar, "./skip.txt", 700)
+        add_entry(tar, "./link.html", tarfile.SYMTYPE, "index.html")
+        add_file(tar, "./empty.txt", 0)
+    data = archive(tarfile.USTAR_FORMAT, simple)
+    write("simple.tar", data)
+
+    # Only one of the two end blocks, past the last entry
+    end = len(data.rstrip(b"\0"))
+    end += -end % 512
+    write("one-end-block.tar", data[:end + 512])
+
+    write("truncated.tar", data[:1536 + 300])
+
+    bad_checksum = bytearray(data)
+    bad_checksum[512 + 10] ^= 0x01
+    write("bad-checksum.tar", bytes(bad_checksum))
+
+    # Name split between the prefix and name fields of the header
+    write("prefix.tar", archive(tarfile.USTAR_FORMAT, lambda tar: add_file(tar, LONG_DIR + "/file.txt", 300)))
+    # Name in a GNU 'L' entry before the file
+    write("gnu-long.tar", archive(tarfile.GNU_FORMAT, lambda tar: add_file(tar, LONG_NAME, 600)))
+    # Name in a pax 'x' record before the file, after a global 'g' header
+    write("pax-long.tar", archive(tarfile.PAX_FORMAT, lambda tar: add_file(tar, PAX_NAME, 100),
+                                  pax_headers={"comment": "bundle"}))
+
+    write("dotdot.tar", archive(tarfile.USTAR_FORMAT, lambda tar: add_file(tar, "../evil.txt", 10)))
+    write("dotdot-inner.tar", archive(tarfile.USTAR_FORMAT, lambda tar: add_file(tar, "css/../../evil.txt", 10)))
+    write("dotdot-gnu.tar", archive(tarfile.GNU_FORMAT, lambda tar: add_file(tar, "../" + LONG_NAME, 10)))
+    write("dotdot-pax.tar", archive(tarfile.PAX_FORMAT, lambda tar: add_file(tar, "../" + PAX_NAME, 10)))
+    write("absolute.tar", archive(tarfile.USTAR_FORMAT, lambda tar: add_file(tar, "/etc/evil.txt", 10)))
+    # Dots within names are fine
+    write("dots.tar", archive(tarfile.USTAR_FORMAT, lambda tar: add_file(tar, "..hidden/a..b.txt", 10)))
+
+
+if __name__ == "__main__":
+    main()
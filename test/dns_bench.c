@@ -0,0 +1,153 @@
+// Queries answered per second by the captive DNS, parsing and replying in
+// place like answer_dns_query in src/captdns.c, without the socket. Then the
+// packets per second of the parser alone over the fuzzing seeds, which also
+// have malformed packets.
+
+#include "dns_parser.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CORPUS_DIR "data/dns/corpus"
+#define CORPUS_MAX 64
+
+#define QUERIES (4 * 1024 * 1024)
+#define RUNS 5
+#define AP_ADDRESS 0x0104a8c0 // 192.168.4.1 in network order
+#define TTL_SEC 300
+
+// Hosts of the connectivity checks made when a phone joins the access point
+static const char *hosts[] = {
+  "captive.apple.com",
+  "connectivitycheck.gstatic.com",
+  "www.msftconnecttest.com",
+  "detectportal.firefox.com",
+  "clients3.google.com",
+};
+static const uint16_t types[] = { DNS_TYPE_A, DNS_TYPE_AAAA, DNS_TYPE_HTTPS };
+
+#define HOSTS_COUNT (sizeof(hosts) / sizeof(hosts[0]))
+#define TYPES_COUNT (sizeof(types) / sizeof(types[0]))
+
+typedef struct {
+  uint8_t data[DNS_HEADER_LEN + DNS_NAME_MAX_LEN + 4];
+  size_t len;
+} query_t;
+
+static size_t build_query(uint8_t *packet, uint16_t id, const char *host, uint16_t type) {
+  const uint8_t header[DNS_HEADER_LEN] = { id >> 8, id & 0xff, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+  memcpy(packet, header, sizeof(header));
+  size_t len = sizeof(header);
+
+  for (const char *label = host; *label != '\0'; ) {
+    size_t label_len = strcspn(label, ".");
+    packet[len++] = label_len;
+    memcpy(packet + len, label, label_len);
+    len += label_len;
+    label += label_len + (label[label_len] == '.');
+  }
+  packet[len++] = 0;
+  packet[len++] = type >> 8;
+  packet[len++] = type & 0xff;
+  packet[len++] = 0;
+  packet[len++] = DNS_CLASS_IN;
+  return len;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fuzzing seeds, each packet as received
+static int load_corpus(query_t *packets) {
+  int count = 0;
+  DIR *dir = opendir(CORPUS_DIR);
+  if (dir == NULL) {
+    return 0;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL && count < CORPUS_MAX) {
+    char path[512];
+    snprintf(path, sizeof(path), CORPUS_DIR "/%s", entry->d_name);
+    FILE *f = entry->d_name[0] != '.' ? fopen(path, "rb") : NULL;
+    if (f) {
+      packets[count].len = fread(packets[count].data, 1, sizeof(packets[count].data), f);
+      fclose(f);
+      count++;
+    }
+  }
+  closedir(dir);
+  return count;
+}
+
+static void bench_parser(void) {
+  static query_t packets[CORPUS_MAX];
+  int count = load_corpus(packets);
+  if (count == 0) {
+    fprintf(stderr, "No packet in " CORPUS_DIR "\n");
+    return;
+  }
+
+  double best = 1e9;
+  size_t name_bytes = 0;
+  for (int run = 0; run < RUNS; ++run) {
+    name_bytes = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < QUERIES; ++i) {
+      const query_t *packet = &packets[i % count];
+      dns_question_t question;
+      if (dns_parse_query(packet->data, packet->len, &question) == DNS_QUERY_OK) {
+        char name[DNS_NAME_MAX_LEN + 1];
+        name_bytes += dns_parse_name(packet->data, packet->len, question.name_offset, name, sizeof(name));
+      }
+    }
+    double elapsed = now_seconds() - start;
+    if (elapsed < best) best = elapsed;
+  }
+
+  printf("dns_bench: %.1f M packets/s parsed, %d seed packets, %.1f name bytes per packet (best of %d)\n",
+         QUERIES / best / 1e6, count, (double)name_bytes / QUERIES, RUNS);
+}
+
+int main(void) {
+  query_t queries[HOSTS_COUNT * TYPES_COUNT];
+  for (size_t i = 0; i < HOSTS_COUNT * TYPES_COUNT; ++i) {
+    queries[i].len = build_query(queries[i].data, i, hosts[i / TYPES_COUNT], types[i % TYPES_COUNT]);
+  }
+
+  uint8_t packet[sizeof(queries[0].data) + DNS_ANSWER_LEN];
+  double best = 1e9;
+  size_t reply_bytes = 0;
+  for (int run = 0; run < RUNS; ++run) {
+    reply_bytes = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < QUERIES; ++i) {
+      const query_t *query = &queries[i % (HOSTS_COUNT * TYPES_COUNT)];
+      // The server receives every query into the same buffer
+      memcpy(packet, query->data, query->len);
+
+      dns_question_t question;
+      dns_query_status_t status = dns_parse_query(packet, query->len, &question);
+      int reply_len = dns_build_reply(packet, sizeof(packet), status, &question, AP_ADDRESS, TTL_SEC);
+      if (status != DNS_QUERY_OK || reply_len <= 0) {
+        fprintf(stderr, "Query %zu not answered (%d)\n", i, status);
+        return EXIT_FAILURE;
+      }
+      reply_bytes += reply_len;
+    }
+    double elapsed = now_seconds() - start;
+    if (elapsed < best) best = elapsed;
+  }
+
+  printf("dns_bench: %.1f M queries/s answered, A/AAAA/HTTPS mix, %.1f bytes per reply (best of %d)\n",
+         QUERIES / best / 1e6, (double)reply_bytes / QUERIES, RUNS);
+
+  bench_parser();
+  return EXIT_SUCCESS;
+}
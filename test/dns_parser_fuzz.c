@@ -0,0 +1,63 @@
+// Fuzz target of the captive DNS parser, packets come from anyone on the
+// access point. Built with libFuzzer (clang -fsanitize=fuzzer), AFL++
+// (afl-clang-fast -fsanitize=fuzzer) or fuzz_driver.c with any compiler:
+//   make -C test fuzz                          standalone driver, ASan/UBSan
+//   make -C test fuzz CC=clang FUZZER=libfuzzer
+// Seeds are in data/dns/corpus.
+
+#include "dns_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AP_ADDRESS 0x0104a8c0 // 192.168.4.1 in network order
+
+// Invariants the server relies on, abort so that the fuzzer keeps the input
+#define ASSERT(condition) do { \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+    abort(); \
+  } \
+} while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  // Exactly the room the server has, so that the sanitizers catch any overflow
+  size_t max_len = size + DNS_ANSWER_LEN;
+  uint8_t *packet = malloc(max_len);
+  memcpy(packet, data, size);
+
+  dns_question_t question;
+  dns_query_status_t status = dns_parse_query(packet, size, &question);
+  if (status == DNS_QUERY_OK) {
+    ASSERT(question.question_end <= size);
+
+    char name[DNS_NAME_MAX_LEN + 1];
+    int name_end = dns_parse_name(packet, size, question.name_offset, name, sizeof(name));
+    ASSERT(name_end == (int)question.question_end - 4);
+    ASSERT(strlen(name) <= DNS_NAME_MAX_LEN);
+
+    // Names that don't fit are rejected, never truncated
+    char short_name[8];
+    ASSERT(dns_parse_name(packet, size, question.name_offset, short_name, sizeof(short_name)) < 0 ||
+           strlen(name) < sizeof(short_name));
+  }
+
+  // Names are also read at any offset, following compression pointers
+  for (size_t offset = 0; offset < size && offset < 64; ++offset) {
+    char name[DNS_NAME_MAX_LEN + 1];
+    dns_parse_name(packet, size, offset, name, sizeof(name));
+  }
+
+  int reply_len = dns_build_reply(packet, max_len, status, &question, AP_ADDRESS, 300);
+  ASSERT(status != DNS_QUERY_MALFORMED || reply_len < 0);
+  ASSERT(reply_len <= (int)max_len);
+  if (reply_len > 0) {
+    // A reply is never taken for a query
+    dns_question_t reply_question;
+    ASSERT(dns_parse_query(packet, reply_len, &reply_question) == DNS_QUERY_MALFORMED);
+  }
+
+  free(packet);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Stand-in for libFuzzer when building with gcc: replays the seeds given on
+// the command line (files or directories), then random mutations of them.
+// Accepts -runs=N and -seed=N like libFuzzer, other options are ignored.
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_SEEDS 1024
+#define INPUT_MAX_LEN 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} seed_t;
+
+static seed_t seeds[MAX_SEEDS];
+static int seeds_count = 0;
+
+static void load_seed(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f || seeds_count == MAX_SEEDS) {
+    fprintf(stderr, "Can't load %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  seed_t *seed = &seeds[seeds_count++];
+  seed->data = malloc(INPUT_MAX_LEN);
+  seed->len = fread(seed->data, 1, INPUT_MAX_LEN, f);
+  fclose(f);
+}
+
+static void load_seeds(const char *path) {
+  struct stat path_stat;
+  if (stat(path, &path_stat) != 0 || !S_ISDIR(path_stat.st_mode)) {
+    load_seed(path);
+    return;
+  }
+
+  DIR *dir = opendir(path);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      char file_path[4096];
+      snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+      load_seed(file_path);
+    }
+  }
+  closedir(dir);
+}
+
+// Byte flips, special values, truncation and random tails
+static size_t mutate(uint8_t *data, size_t len) {
+  static const uint8_t specials[] = { 0x00, 0x01, 0x3f, 0x40, 0x80, 0xc0, 0xff };
+  int mutations = 1 + rand() % 8;
+
+  for (int i = 0; i < mutations; ++i) {
+    switch (rand() % 5) {
+      case 0:
+        if (len > 0) data[rand() % len] ^= 1 << (rand() % 8);
+        break;
+      case 1:
+        if (len > 0) data[rand() % len] = specials[rand() % sizeof(specials)];
+        break;
+      case 2:
+        len = rand() % (len + 1);
+        break;
+      case 3:
+        for (int count = rand() % 64; count > 0 && len < INPUT_MAX_LEN; --count) data[len++] = rand();
+        break;
+      case 4:
+        // Compression pointer to anywhere
+        if (len > 1) {
+          size_t offset = rand() % (len - 1);
+          data[offset] = 0xc0 | (rand() % 4);
+          data[offset + 1] = rand();
+        }
+        break;
+    }
+  }
+  return len;
+}
+
+int main(int argc, char **argv) {
+  long runs = 100000;
+  unsigned seed = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "-runs=", 6) == 0) {
+      runs = atol(argv[i] + 6);
+    } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+      seed = atoi(argv[i] + 6);
+    } else if (argv[i][0] != '-') {
+      load_seeds(argv[i]);
+    }
+  }
+  if (seeds_count == 0) {
+    fprintf(stderr, "Usage: %s [-runs=N] [-seed=N] corpus_dir_or_file...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < seeds_count; ++i) {
+    LLVMFuzzerTestOneInput(seeds[i].data, seeds[i].len);
+  }
+
+  srand(seed);
+  uint8_t input[INPUT_MAX_LEN];
+  for (long run = 0; run < runs; ++run) {
+    const seed_t *from = &seeds[rand() % seeds_count];
+    memcpy(input, from->data, from->len);
+    LLVMFuzzerTestOneInput(input, mutate(input, from->len));
+  }
+
+  printf("fuzz_driver: %d seeds, %ld mutations, no failure (seed %u)\n", seeds_count, runs, seed);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+// Decompression throughput of a firmware sized image, fed like an OTA upload
+
+#include "gunzip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#define IMAGE_SIZE (1024 * 1024)
+#define CHUNK_SIZE 8192 // TRANSFER_BUFSIZE
+#define RUNS 20
+
+static bool discard(const uint8_t *data, size_t len, void *ctx) {
+  (void)data;
+  *(size_t*)ctx += len;
+  return true;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+  // Code-like data: short random runs copied from earlier in the image
+  unsigned char *image = malloc(IMAGE_SIZE);
+  uint32_t state = 1;
+  for (size_t i = 0; i < IMAGE_SIZE; ) {
+    state = state * 1103515245 + 12345;
+    size_t run = 4 + (state >> 28);
+    if (i > 4096 && (state >> 16) % 3) {
+      size_t from = (state >> 8) % (i - run);
+      for (size_t j = 0; j < run && i < IMAGE_SIZE; ++j) image[i++] = image[from + j];
+    } else {
+      for (size_t j = 0; j < run && i < IMAGE_SIZE; ++j) {
+        state = state * 1103515245 + 12345;
+        // Opcodes and small immediates, not uniformly random
+        image[i++] = (state >> 16) & 0x3f;
+      }
+    }
+  }
+
+  uLongf stream_len = compressBound(IMAGE_SIZE) + 32;
+  unsigned char *stream = malloc(stream_len);
+  z_stream z = { 0 };
+  deflateInit2(&z, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  z.next_in = image;
+  z.avail_in = IMAGE_SIZE;
+  z.next_out = stream;
+  z.avail_out = stream_len;
+  deflate(&z, Z_FINISH);
+  stream_len = z.total_out;
+  deflateEnd(&z);
+
+  double best = 1e9;
+  for (int run = 0; run < RUNS; ++run) {
+    size_t output = 0;
+    double start = now_seconds();
+    gunzip_t *gz = gunzip_create();
+    for (size_t offset = 0; offset < stream_len; offset += CHUNK_SIZE) {
+      size_t count = stream_len - offset < CHUNK_SIZE ? stream_len - offset : CHUNK_SIZE;
+      gunzip_feed(gz, stream + offset, count, discard, &output);
+    }
+    gunzip_status_t status = gunzip_finish(gz);
+    gunzip_destroy(gz);
+    double elapsed = now_seconds() - start;
+
+    if (status != GUNZIP_OK || output != IMAGE_SIZE) {
+      fprintf(stderr, "Decompression failed (%d)\n", status);
+      return EXIT_FAILURE;
+    }
+    if (elapsed < best) best = elapsed;
+  }
+
+  printf("gunzip_bench: %d -> %lu bytes (%.0f%%), %.1f MB/s decompressed (best of %d)\n",
+         IMAGE_SIZE, (unsigned long)stream_len, 100.0 * stream_len / IMAGE_SIZE, IMAGE_SIZE / best / 1e6, RUNS);
+  free(stream);
+  free(image);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+// Known gzip streams fed to the decoder in chunks of every size
+
+#include "test.h"
+#include "gunzip.h"
+
+#include <zlib.h>
+
+#define DATA_DIR "data/gunzip/"
+
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t capacity;
+  size_t stop_after; // Output callback fails past this size, 0 for never
+} output_t;
+
+static bool collect(const uint8_t *data, size_t len, void *ctx) {
+  output_t *output = ctx;
+  if (output->stop_after && output->len + len > output->stop_after) {
+    return false;
+  }
+  if (output->len + len > output->capacity) {
+    output->capacity = (output->len + len) * 2;
+    output->data = realloc(output->data, output->capacity);
+  }
+  memcpy(output->data + output->len, data, len);
+  output->len += len;
+  return true;
+}
+
+// Decode a whole stream, chunk bytes at a time
+static gunzip_status_t decode(const unsigned char *stream, size_t len, size_t chunk, output_t *output) {
+  gunzip_t *gz = gunzip_create();
+  gunzip_status_t status = GUNZIP_OK;
+
+  for (size_t offset = 0; offset < len && status == GUNZIP_OK; offset += chunk) {
+    size_t count = len - offset < chunk ? len - offset : chunk;
+    status = gunzip_feed(gz, stream + offset, count, collect, output);
+  }
+  if (status == GUNZIP_OK) {
+    status = gunzip_finish(gz);
+  }
+  if (status == GUNZIP_OK) {
+    CHECK_EQ(gunzip_output_size(gz), output->len);
+  }
+  gunzip_destroy(gz);
+  return status;
+}
+
+static const size_t chunks[] = { 1, 2, 7, 10, 512, 8192, 1 << 20 };
+
+static void check_file(const char *name, gunzip_status_t expected, const unsigned char *plain, size_t plain_len) {
+  size_t len;
+  unsigned char *stream = test_read_file(name, &len);
+
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+    output_t output = { 0 };
+    gunzip_status_t status = decode(stream, len, chunks[i], &output);
+    if (status != expected) {
+      fprintf(stderr, "%s in chunks of %zu: status %d, expected %d\n", name, chunks[i], status, expected);
+      test_failures++;
+    }
+    if (expected == GUNZIP_OK) {
+      CHECK_EQ(output.len, plain_len);
+      CHECK(output.len == plain_len && (plain_len == 0 || memcmp(output.data, plain, plain_len) == 0));
+    }
+    free(output.data);
+  }
+  free(stream);
+}
+
+// Larger than the 32 KB window, so that back-references wrap around it
+static void check_large_stream(void) {
+  size_t plain_len = 300 * 1024;
+  unsigned char *plain = malloc(plain_len);
+  uint32_t state = 42;
+  for (size_t i = 0; i < plain_len; ++i) {
+    state = state * 1103515245 + 12345;
+    // Repeats from far behind, like the code of a firmware
+    plain[i] = i > 40000 && (state >> 16) % 4 ? plain[i - 40000 + (state >> 24) % 64] : state >> 16;
+  }
+
+  uLongf stream_len = compressBound(plain_len) + 32;
+  unsigned char *stream = malloc(stream_len);
+  z_stream z = { 0 };
+  deflateInit2(&z, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  z.next_in = plain;
+  z.avail_in = plain_len;
+  z.next_out = stream;
+  z.avail_out = stream_len;
+  CHECK_EQ(deflate(&z, Z_FINISH), Z_STREAM_END);
+  stream_len = z.total_out;
+  deflateEnd(&z);
+
+  output_t output = { 0 };
+  CHECK_EQ(decode(stream, stream_len, 4096, &output), GUNZIP_OK);
+  CHECK(output.len == plain_len && memcmp(output.data, plain, plain_len) == 0);
+  free(output.data);
+
+  // Data after the trailer
+  unsigned char *trailing = malloc(stream_len + 1);
+  memcpy(trailing, stream, stream_len);
+  trailing[stream_len] = 0;
+  output = (output_t){ 0 };
+  CHECK_EQ(decode(trailing, stream_len + 1, 4096, &output), GUNZIP_ERR_TRAILING);
+  free(output.data);
+
+  // The output callback stops the decoding, like a failing flash write
+  output = (output_t){ .stop_after = 100000 };
+  CHECK_EQ(decode(stream, stream_len, 4096, &output), GUNZIP_ERR_OUTPUT);
+  free(output.data);
+
+  free(trailing);
+  free(stream);
+  free(plain);
+}
+
+// The magic bytes of an upload, received in parts
+static void check_upload_magic(void) {
+  const uint8_t gzip[] = { 0x1f, 0x8b, 0x08 };
+  const uint8_t text[] = { 'x', 0x8b };
+
+  // Plain files of any size, even a single byte
+  CHECK(gunzip_upload_part_valid(false, text, 1, 0, 1));
+  CHECK(gunzip_upload_part_valid(false, text, 2, 0, 2));
+
+  CHECK(gunzip_upload_part_valid(true, gzip, 3, 0, 3));
+  CHECK(gunzip_upload_part_valid(true, gzip, 1, 0, 3));
+  CHECK(gunzip_upload_part_valid(true, gzip + 1, 2, 1, 3));
+  CHECK(gunzip_upload_part_valid(true, text + 1, 1, 1, 2));
+  // Past the magic, anything goes
+  CHECK(gunzip_upload_part_valid(true, text, 2, 2, 4));
+
+  CHECK(!gunzip_upload_part_valid(true, gzip, 1, 0, 1));
+  CHECK(!gunzip_upload_part_valid(true, text, 2, 0, 2));
+  CHECK(!gunzip_upload_part_valid(true, gzip, 1, 1, 3));
+}
+
+int main(void) {
+  size_t plain_len;
+  unsigned char *plain = test_read_file(DATA_DIR "lorem.txt", &plain_len);
+
+  check_file(DATA_DIR "lorem.txt.gz", GUNZIP_OK, plain, plain_len);
+  check_file(DATA_DIR "headers.gz", GUNZIP_OK, plain, plain_len);
+  check_file(DATA_DIR "empty.gz", GUNZIP_OK, plain, 0);
+  check_file(DATA_DIR "bad-crc.gz", GUNZIP_ERR_INTEGRITY, NULL, 0);
+  check_file(DATA_DIR "bad-size.gz", GUNZIP_ERR_INTEGRITY, NULL, 0);
+  check_file(DATA_DIR "truncated.gz", GUNZIP_ERR_TRUNCATED, NULL, 0);
+  check_file(DATA_DIR "corrupted.gz", GUNZIP_ERR_CORRUPTED, NULL, 0);
+  check_file(DATA_DIR "not-gzip.gz", GUNZIP_ERR_FORMAT, NULL, 0);
+
+  check_large_stream();
+  check_upload_magic();
+
+  free(plain);
+  return test_report("gunzip_test");
+}
@@ -0,0 +1,138 @@
+// Edge traces of the digital pedals replayed through the debouncing
+
+#include "test.h"
+#include "pedal_debounce.h"
+
+#define DEBOUNCE_US 5000 // PEDAL_DEBOUNCE_US
+
+static void test_clean_press(void) {
+  pedal_debounce_t pedal;
+  pedal_debounce_init(&pedal, false, 0);
+  CHECK_EQ(pedal_debounce_update(&pedal, 500, DEBOUNCE_US), 0);
+
+  // Accepted once held for the debounce time, dated from its edge
+  pedal_debounce_edge(&pedal, true, 1000);
+  CHECK_EQ(pedal_debounce_update(&pedal, 1000, DEBOUNCE_US), DEBOUNCE_US);
+  CHECK_EQ(pedal_debounce_update(&pedal, 3000, DEBOUNCE_US), 3000);
+  CHECK(!pedal.pressed);
+  CHECK_EQ(pedal_debounce_update(&pedal, 6000, DEBOUNCE_US), 0);
+  CHECK(pedal.pressed);
+  CHECK_EQ(pedal.changed_at_us, 1000);
+  CHECK_EQ(pedal.changes, 1);
+  CHECK_EQ(pedal.edges, 1);
+
+  // Nothing pending anymore
+  CHECK_EQ(pedal_debounce_update(&pedal, 20000, DEBOUNCE_US), 0);
+  CHECK_EQ(pedal.changes, 1);
+}
+
+static void test_bouncy_release(void) {
+  pedal_debounce_t pedal;
+  pedal_debounce_init(&pedal, true, 0);
+
+  // Contacts bouncing for 900 us, the car keeps driving meanwhile
+  int64_t time = 20000;
+  bool level = false;
+  for (int i = 0; i < 9; ++i, time += 100, level = !level) {
+    pedal_debounce_edge(&pedal, level, time);
+    CHECK_EQ(pedal_debounce_update(&pedal, time + 50, DEBOUNCE_US), DEBOUNCE_US - 50);
+    CHECK(pedal.pressed);
+  }
+  pedal_debounce_edge(&pedal, false, time);
+
+  // Settled from the last edge, dated from the first one
+  CHECK_EQ(pedal_debounce_update(&pedal, time + DEBOUNCE_US - 1, DEBOUNCE_US), 1);
+  CHECK(pedal.pressed);
+  CHECK_EQ(pedal_debounce_update(&pedal, time + DEBOUNCE_US, DEBOUNCE_US), 0);
+  CHECK(!pedal.pressed);
+  CHECK_EQ(pedal.changed_at_us, 20000);
+  CHECK_EQ(pedal.changes, 1);
+  CHECK_EQ(pedal.edges, 10);
+}
+
+static void test_glitch(void) {
+  pedal_debounce_t pedal;
+  pedal_debounce_init(&pedal, false, 0);
+
+  // A spike back to the same level is no change
+  pedal_debounce_edge(&pedal, true, 50000);
+  pedal_debounce_edge(&pedal, false, 50200);
+  CHECK_EQ(pedal_debounce_update(&pedal, 50200 + DEBOUNCE_US, DEBOUNCE_US), 0);
+  CHECK(!pedal.pressed);
+  CHECK_EQ(pedal.changes, 0);
+  CHECK_EQ(pedal.changed_at_us, 0);
+
+  // The next change is dated from its own edge, not the glitch
+  pedal_debounce_edge(&pedal, true, 60000);
+  CHECK_EQ(pedal_debounce_update(&pedal, 60000 + DEBOUNCE_US, DEBOUNCE_US), 0);
+  CHECK(pedal.pressed);
+  CHECK_EQ(pedal.changed_at_us, 60000);
+}
+
+static void test_missed_edge(void) {
+  pedal_debounce_t pedal;
+  pedal_debounce_init(&pedal, false, 0);
+
+  // The level read in the interrupt can repeat when an edge is missed
+  pedal_debounce_edge(&pedal, true, 70000);
+  pedal_debounce_edge(&pedal, true, 72000);
+  CHECK_EQ(pedal_debounce_update(&pedal, 76000, DEBOUNCE_US), 1000);
+  CHECK(!pedal.pressed);
+  CHECK_EQ(pedal_debounce_update(&pedal, 77000, DEBOUNCE_US), 0);
+  CHECK(pedal.pressed);
+  CHECK_EQ(pedal.changed_at_us, 70000);
+}
+
+static void test_late_update(void) {
+  pedal_debounce_t pedal;
+  pedal_debounce_init(&pedal, false, 0);
+
+  // Parked: the task only reads the pedal long after the edge
+  pedal_debounce_edge(&pedal, true, 1000);
+  CHECK_EQ(pedal_debounce_update(&pedal, 900000, DEBOUNCE_US), 0);
+  CHECK(pedal.pressed);
+  CHECK_EQ(pedal.changed_at_us, 1000);
+}
+
+// Random traces: bounces shorter than the debounce time never change the
+// state, the final level is accepted exactly when it has held long enough
+static void test_random_traces(void) {
+  uint32_t state = 1;
+  for (int trace = 0; trace < 20000; ++trace) {
+    pedal_debounce_t pedal;
+    pedal_debounce_init(&pedal, false, 0);
+
+    state = state * 1103515245 + 12345;
+    bool target = (state >> 16) & 1;
+    int bounces = (state >> 17) % 20;
+    int64_t time = 0;
+    for (int i = 0; i < bounces; ++i) {
+      state = state * 1103515245 + 12345;
+      time += 1 + (state >> 16) % (DEBOUNCE_US - 1);
+      pedal_debounce_edge(&pedal, (state >> 8) & 1, time);
+      pedal_debounce_update(&pedal, time, DEBOUNCE_US);
+    }
+    if (pedal.pressed) {
+      fprintf(stderr, "Trace %d: changed while bouncing\n", trace);
+      test_failures++;
+    }
+
+    time += 10;
+    pedal_debounce_edge(&pedal, target, time);
+    pedal_debounce_update(&pedal, time + DEBOUNCE_US - 1, DEBOUNCE_US);
+    CHECK(!pedal.pressed);
+    pedal_debounce_update(&pedal, time + DEBOUNCE_US, DEBOUNCE_US);
+    CHECK(pedal.pressed == target);
+    CHECK_EQ(pedal.changes, target ? 1 : 0);
+  }
+}
+
+int main(void) {
+  test_clean_press();
+  test_bouncy_release();
+  test_glitch();
+  test_missed_edge();
+  test_late_update();
+  test_random_traces();
+  return test_report("pedal_debounce_test");
+}
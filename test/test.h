@@ -0,0 +1,59 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimal checks for the host tests, every failure is reported and the
+// test exits with an error at the end
+
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    test_failures++; \
+  } \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+  long long actual_value = (long long)(actual); \
+  long long expected_value = (long long)(expected); \
+  if (actual_value != expected_value) { \
+    fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, \
+            #actual, #expected, actual_value, expected_value); \
+    test_failures++; \
+  } \
+} while (0)
+
+static inline int test_report(const char *name) {
+  if (test_failures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+    return EXIT_FAILURE;
+  }
+  printf("%s: ok\n", name);
+  return EXIT_SUCCESS;
+}
+
+// Whole file in memory, exits if it can't be read
+static inline unsigned char* test_read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *data = malloc(size ? size : 1);
+  if (fread(data, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "Can't read %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fclose(f);
+  *len = size;
+  return data;
+}
+
+#endif
@@ -0,0 +1,160 @@
+// Analog pedal mapping: lookup tables of the curves, calibration and learning
+
+#include "test.h"
+#include "throttle_curve.h"
+
+static void check_monotonic(const throttle_map_t *map) {
+  CHECK_EQ(map->lut[0], 0);
+  CHECK_EQ(map->lut[THROTTLE_LUT_STEPS], THROTTLE_POSITION_MAX);
+  for (int travel = 1; travel <= THROTTLE_LUT_STEPS; ++travel) {
+    CHECK(map->lut[travel] >= map->lut[travel - 1]);
+  }
+}
+
+static void test_linear(void) {
+  throttle_settings_t settings = THROTTLE_SETTINGS_DEFAULTS;
+  throttle_map_t map;
+  throttle_map_build(&map, &settings.forward, &settings.curve);
+  check_monotonic(&map);
+  CHECK_EQ(map.lut[THROTTLE_LUT_STEPS / 2], 50);
+  for (int travel = 1; travel <= THROTTLE_LUT_STEPS; ++travel) {
+    CHECK(map.lut[travel] - map.lut[travel - 1] <= 1);
+  }
+
+  // Clamped beyond the calibration, 1000 to 2600 mV by default
+  CHECK_EQ(throttle_map_position(&map, 0), 0);
+  CHECK_EQ(throttle_map_position(&map, 900), 0);
+  CHECK_EQ(throttle_map_position(&map, 1000), 0);
+  CHECK_EQ(throttle_map_position(&map, 1800), 50);
+  CHECK_EQ(throttle_map_position(&map, 2600), 100);
+  CHECK_EQ(throttle_map_position(&map, 3300), 100);
+
+  // Within a step of the former float mapping over the whole range
+  for (int mv = 1000; mv <= 2600; ++mv) {
+    int former = (mv - 1000) / 16;
+    CHECK(abs(throttle_map_position(&map, mv) - former) <= 1);
+  }
+}
+
+static void test_progressive(void) {
+  throttle_settings_t settings = THROTTLE_SETTINGS_DEFAULTS;
+  settings.curve.type = THROTTLE_CURVE_PROGRESSIVE;
+  throttle_map_t map;
+  throttle_map_build(&map, &settings.forward, &settings.curve);
+  check_monotonic(&map);
+
+  // Square of the travel: a quarter of it gives 6%, half of it 25%
+  CHECK_EQ(throttle_map_position(&map, 1400), 6);
+  CHECK_EQ(throttle_map_position(&map, 1800), 25);
+  CHECK_EQ(throttle_map_position(&map, 2200), 56);
+}
+
+static void test_custom(void) {
+  throttle_settings_t settings = THROTTLE_SETTINGS_DEFAULTS;
+  throttle_curve_t curve = { THROTTLE_CURVE_CUSTOM, { 0, 10, 30, 60, 100 } };
+  throttle_map_t map;
+  throttle_map_build(&map, &settings.forward, &curve);
+  check_monotonic(&map);
+
+  // Through the points, linear in between
+  CHECK_EQ(map.lut[32], 10);
+  CHECK_EQ(map.lut[64], 30);
+  CHECK_EQ(map.lut[96], 60);
+  CHECK_EQ(map.lut[16], 5);
+  CHECK_EQ(map.lut[48], 20);
+  CHECK_EQ(map.lut[112], 80);
+
+  // Points made non decreasing and capped
+  throttle_curve_t unsorted = { THROTTLE_CURVE_CUSTOM, { 50, 20, 200, 90, 95 } };
+  throttle_curve_sanitize(&unsorted);
+  const uint8_t expected[THROTTLE_CURVE_POINTS] = { 50, 50, 100, 100, 100 };
+  for (int i = 0; i < THROTTLE_CURVE_POINTS; ++i) {
+    CHECK_EQ(unsorted.points[i], expected[i]);
+  }
+
+  // Unknown curves from corrupted settings are linear
+  throttle_curve_t unknown = { 42, { 0 } };
+  throttle_curve_sanitize(&unknown);
+  CHECK_EQ(unknown.type, THROTTLE_CURVE_LINEAR);
+}
+
+static void test_calibration(void) {
+  throttle_curve_t linear = { THROTTLE_CURVE_LINEAR, { 0 } };
+  throttle_map_t map;
+
+  // Inverted pedals read less when pressed
+  const throttle_calibration_t inverted = { 2600, 900 };
+  CHECK(throttle_calibration_valid(&inverted));
+  throttle_map_build(&map, &inverted, &linear);
+  CHECK_EQ(throttle_map_position(&map, 2700), 0);
+  CHECK_EQ(throttle_map_position(&map, 1750), 50);
+  CHECK_EQ(throttle_map_position(&map, 800), 100);
+
+  // Invalid calibrations fall back to the defaults
+  const throttle_calibration_t invalid[] = { { 0, 0 }, { 1000, 1100 }, { 1000, 4000 }, { 5000, 1000 } };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    CHECK(!throttle_calibration_valid(&invalid[i]));
+    throttle_map_build(&map, &invalid[i], &linear);
+    CHECK_EQ(map.idle_mv, 1000);
+    CHECK_EQ(map.span_mv, 1600);
+  }
+}
+
+static void test_learning(void) {
+  throttle_learn_t learn;
+  throttle_calibration_t calibration = { 0, 0 };
+  throttle_map_t map;
+  throttle_curve_t linear = { THROTTLE_CURVE_LINEAR, { 0 } };
+
+  // Pressed a few times, with some noise below the rest voltage
+  throttle_learn_start(&learn, 980);
+  for (int press = 0; press < 3; ++press) {
+    for (int mv = 980; mv <= 2650; mv += 7) {
+      throttle_learn_sample(&learn, mv);
+    }
+  }
+  throttle_learn_sample(&learn, 960);
+  CHECK(throttle_learn_finish(&learn, &calibration));
+  // 5% of the travel above idle, 3% below full
+  CHECK_EQ(calibration.idle_mv, 960 + 1686 * 5 / 100);
+  CHECK_EQ(calibration.full_mv, 2646 - 1686 * 3 / 100);
+
+  // Inverted, told apart by the rest voltage
+  throttle_learn_start(&learn, 2500);
+  throttle_learn_sample(&learn, 800);
+  CHECK(throttle_learn_finish(&learn, &calibration));
+  CHECK_EQ(calibration.idle_mv, 2500 - 85);
+  CHECK_EQ(calibration.full_mv, 800 + 51);
+
+  // The minimum travel is checked before narrowing, and the result is usable
+  throttle_learn_start(&learn, 1000);
+  throttle_learn_sample(&learn, 1000 + THROTTLE_MIN_SPAN_MV);
+  CHECK(throttle_learn_finish(&learn, &calibration));
+  CHECK(throttle_calibration_valid(&calibration));
+  throttle_map_build(&map, &calibration, &linear);
+  CHECK_EQ(map.idle_mv, 1015);
+  CHECK_EQ(map.span_mv, 276);
+
+  throttle_learn_start(&learn, 1000 + THROTTLE_MIN_SPAN_MV);
+  throttle_learn_sample(&learn, 1000);
+  CHECK(throttle_learn_finish(&learn, &calibration));
+  CHECK_EQ(calibration.idle_mv, 1285);
+  CHECK_EQ(calibration.full_mv, 1009);
+
+  // Not pressed enough, the previous calibration is kept
+  throttle_learn_start(&learn, 1000);
+  throttle_learn_sample(&learn, 1000 + THROTTLE_MIN_SPAN_MV - 1);
+  CHECK(!throttle_learn_finish(&learn, &calibration));
+  CHECK_EQ(calibration.idle_mv, 1285);
+  throttle_learn_start(&learn, 1000);
+  CHECK(!throttle_learn_finish(&learn, &calibration));
+}
+
+int main(void) {
+  test_linear();
+  test_progressive();
+  test_custom();
+  test_calibration();
+  test_learning();
+  return test_report("throttle_curve_test");
+}
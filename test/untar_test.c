@@ -0,0 +1,197 @@
+// Known tar archives fed to the reader in chunks of every size
+
+#include "test.h"
+#include "untar.h"
+
+#define DATA_DIR "data/untar/"
+#define MAX_ENTRIES 8
+
+typedef struct {
+  char name[300];
+  size_t size;
+  size_t received;
+  bool content_valid;
+  bool ended;
+} entry_t;
+
+typedef struct {
+  entry_t entries[MAX_ENTRIES];
+  int count;
+  bool fail_data; // file_data fails, to check it stops unpacking
+} listing_t;
+
+static untar_status_t file_begin(const char *name, size_t size, void *ctx) {
+  listing_t *listing = ctx;
+  if (strncmp(name, "skip", 4) == 0) {
+    return UNTAR_SKIP;
+  }
+  if (listing->count == MAX_ENTRIES || strlen(name) >= sizeof(listing->entries[0].name)) {
+    return UNTAR_ERR_CALLBACK;
+  }
+
+  entry_t *entry = &listing->entries[listing->count++];
+  strcpy(entry->name, name);
+  entry->size = size;
+  entry->received = 0;
+  entry->content_valid = true;
+  entry->ended = false;
+  return UNTAR_OK;
+}
+
+// Every file repeats its name
+static bool file_data(const uint8_t *data, size_t len, void *ctx) {
+  listing_t *listing = ctx;
+  entry_t *entry = &listing->entries[listing->count - 1];
+  size_t name_len = strlen(entry->name);
+
+  for (size_t i = 0; i < len; ++i, ++entry->received) {
+    entry->content_valid &= data[i] == (uint8_t)entry->name[entry->received % name_len];
+  }
+  return !listing->fail_data;
+}
+
+static bool file_end(void *ctx) {
+  listing_t *listing = ctx;
+  listing->entries[listing->count - 1].ended = true;
+  return true;
+}
+
+static const untar_callbacks_t callbacks = { file_begin, file_data, file_end };
+
+// Unpack a whole archive, chunk bytes at a time
+static untar_status_t unpack(const unsigned char *archive, size_t len, size_t chunk, listing_t *listing) {
+  untar_t *tar = untar_create(&callbacks, listing);
+  untar_status_t status = UNTAR_OK;
+
+  for (size_t offset = 0; offset < len && status == UNTAR_OK; offset += chunk) {
+    size_t count = len - offset < chunk ? len - offset : chunk;
+    status = untar_feed(tar, archive + offset, count);
+  }
+  if (status == UNTAR_OK) {
+    status = untar_finish(tar);
+  } else {
+    // The error sticks
+    CHECK_EQ(untar_finish(tar), status);
+  }
+  untar_destroy(tar);
+  return status;
+}
+
+static const size_t chunks[] = { 1, 2, 7, 100, 511, 512, 513, 4096, 1 << 20 };
+
+typedef struct {
+  const char *name;
+  size_t size;
+} expected_t;
+
+static void check_archive(const char *name, untar_status_t expected, const expected_t *files, int count) {
+  size_t len;
+  unsigned char *archive = test_read_file(name, &len);
+
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+    listing_t listing = { 0 };
+    untar_status_t status = unpack(archive, len, chunks[i], &listing);
+    if (status != expected) {
+      fprintf(stderr, "%s in chunks of %zu: status %d, expected %d\n", name, chunks[i], status, expected);
+      test_failures++;
+    }
+
+    CHECK_EQ(listing.count, count);
+    for (int j = 0; j < count && j < listing.count; ++j) {
+      entry_t *entry = &listing.entries[j];
+      if (strcmp(entry->name, files[j].name) != 0) {
+        fprintf(stderr, "%s in chunks of %zu: file %d is %s, expected %s\n", name, chunks[i], j, entry->name, files[j].name);
+        test_failures++;
+      }
+      CHECK_EQ(entry->size, files[j].size);
+      CHECK_EQ(entry->received, files[j].size);
+      CHECK(entry->content_valid);
+      CHECK(entry->ended);
+    }
+  }
+  free(archive);
+}
+
+static char* repeat(char c, int count, const char *prefix, const char *suffix) {
+  static char names[3][300];
+  static int next = 0;
+  char *name = names[next++ % 3];
+  int len = sprintf(name, "%s", prefix);
+  memset(name + len, c, count);
+  sprintf(name + len + count, "%s", suffix);
+  return name;
+}
+
+static void test_formats(void) {
+  // "./" dropped, directories, links and skipped files don't show up
+  const expected_t simple[] = { { "index.html", 1000 }, { "css/app.css", 512 }, { "empty.txt", 0 } };
+  check_archive(DATA_DIR "simple.tar", UNTAR_OK, simple, 3);
+  check_archive(DATA_DIR "one-end-block.tar", UNTAR_OK, simple, 3);
+
+  const expected_t prefix[] = { { repeat('d', 120, "assets/", "/file.txt"), 300 } };
+  check_archive(DATA_DIR "prefix.tar", UNTAR_OK, prefix, 1);
+
+  const expected_t gnu[] = { { repeat('n', 190, "assets/", ".js"), 600 } };
+  check_archive(DATA_DIR "gnu-long.tar", UNTAR_OK, gnu, 1);
+
+  const expected_t pax[] = { { repeat('p', 240, "assets/", ".css"), 100 } };
+  check_archive(DATA_DIR "pax-long.tar", UNTAR_OK, pax, 1);
+
+  const expected_t dots[] = { { "..hidden/a..b.txt", 10 } };
+  check_archive(DATA_DIR "dots.tar", UNTAR_OK, dots, 1);
+}
+
+static void test_unsafe_paths(void) {
+  // Rejected before being handed over, whatever header gave the name
+  check_archive(DATA_DIR "dotdot.tar", UNTAR_ERR_PATH, NULL, 0);
+  check_archive(DATA_DIR "dotdot-inner.tar", UNTAR_ERR_PATH, NULL, 0);
+  check_archive(DATA_DIR "dotdot-gnu.tar", UNTAR_ERR_PATH, NULL, 0);
+  check_archive(DATA_DIR "dotdot-pax.tar", UNTAR_ERR_PATH, NULL, 0);
+  check_archive(DATA_DIR "absolute.tar", UNTAR_ERR_PATH, NULL, 0);
+}
+
+static void test_invalid(void) {
+  check_archive(DATA_DIR "bad-checksum.tar", UNTAR_ERR_FORMAT, NULL, 0);
+
+  // Cut in the middle of the first file, which is never ended
+  size_t len;
+  unsigned char *archive = test_read_file(DATA_DIR "truncated.tar", &len);
+  listing_t listing = { 0 };
+  CHECK_EQ(unpack(archive, len, 7, &listing), UNTAR_ERR_TRUNCATED);
+  CHECK_EQ(listing.count, 1);
+  CHECK_EQ(listing.entries[0].received, 812);
+  CHECK(listing.entries[0].content_valid);
+  CHECK(!listing.entries[0].ended);
+  free(archive);
+
+  // Not a tar archive at all
+  unsigned char garbage[1024];
+  memset(garbage, 'x', sizeof(garbage));
+  listing.count = 0;
+  CHECK_EQ(unpack(garbage, sizeof(garbage), 1, &listing), UNTAR_ERR_FORMAT);
+
+  // Nothing but the end of archive is a valid empty archive, nothing is not
+  unsigned char empty[1024] = { 0 };
+  CHECK_EQ(unpack(empty, sizeof(empty), 1, &listing), UNTAR_OK);
+  CHECK_EQ(unpack(empty, 0, 1, &listing), UNTAR_ERR_TRUNCATED);
+  CHECK_EQ(listing.count, 0);
+}
+
+static void test_callback_failure(void) {
+  size_t len;
+  unsigned char *archive = test_read_file(DATA_DIR "simple.tar", &len);
+
+  listing_t listing = { .fail_data = true };
+  CHECK_EQ(unpack(archive, len, 512, &listing), UNTAR_ERR_CALLBACK);
+  CHECK_EQ(listing.count, 1);
+  CHECK(!listing.entries[0].ended);
+  free(archive);
+}
+
+int main(void) {
+  test_formats();
+  test_unsafe_paths();
+  test_invalid();
+  test_callback_failure();
+  return test_report("untar_test");
+}
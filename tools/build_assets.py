@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+"""Build the storage partition content from the data folder.
+
+Local stylesheets and scripts are inlined into the HTML pages, then HTML, CSS
+and JS are minified and every file is written both minified and gzipped (the
+.gz sibling is served to browsers accepting gzip, the plain file to the
+others). Prints the size of each file before and after, and fails when the
+gzipped pages exceed the page weight budget or the files don't fit in the
+storage partition of partitions_custom.csv.
+
+The minifier is deliberately conservative: it only removes comments and
+whitespace, and keeps JS line breaks so automatic semicolons are unchanged.
+"""
+
+import argparse
+import csv
+import gzip
+import os
+import re
+import shutil
+import sys
+
+# Gzipped size of the HTML pages, with everything they inline
+DEFAULT_BUDGET = 32 * 1024
+# SPIFFS layout used by spiffsgen.py, to estimate the space taken by the files
+SPIFFS_PAGE_SIZE = 256
+SPIFFS_BLOCK_SIZE = 4096
+SPIFFS_PAGE_HEADER_SIZE = 5
+SPIFFS_RESERVED_BLOCKS = 2
+
+TEXT_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg")
+
+
+def minify_css(css):
+    css = re.sub(r"/\*.*?\*/", "", css, flags=re.S)
+    css = re.sub(r"\s+", " ", css)
+    css = re.sub(r"\s*([{};,>])\s*", r"\1", css)
+    # A space before ":" is a descendant selector, only the one after can go
+    css = re.sub(r":\s+", ":", css)
+    return css.replace(";}", "}").strip()
+
+
+def minify_js(js):
+    lines = []
+    in_comment = False
+    for line in js.splitlines():
+        line = line.strip()
+        # Only whole line comments, a "//" or "/*" may be part of a string
+        if in_comment:
+            in_comment = "*/" not in line
+            continue
+        if line.startswith("/*"):
+            in_comment = "*/" not in line
+            continue
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def inline_assets(html, directory):
+    def inline_stylesheet(match):
+        path = os.path.join(directory, match.group(1))
+        if not os.path.isfile(path):
+            return match.group(0)
+        with open(path, encoding="utf-8") as f:
+            return "<style>" + f.read() + "</style>"
+
+    def inline_script(match):
+        path = os.path.join(directory, match.group(1))
+        if not os.path.isfile(path):
+            return match.group(0)
+        with open(path, encoding="utf-8") as f:
+            return "<script>" + f.read() + "</script>"
+
+    html = re.sub(r'<link[^>]*rel="stylesheet"[^>]*href="([^":]+)"[^>]*>', inline_stylesheet, html)
+    html = re.sub(r'<script[^>]*src="([^":]+)"[^>]*>\s*</script>', inline_script, html)
+    return html
+
+
+def minify_html(html):
+    parts = re.split(r"(<style[^>]*>.*?</style>|<script[^>]*>.*?</script>|<pre[^>]*>.*?</pre>|<textarea[^>]*>.*?</textarea>)",
+                     html, flags=re.S | re.I)
+    output = []
+    for part in parts:
+        lower = part[:9].lower()
+        if lower.startswith("<style"):
+            start, end = part.index(">") + 1, part.rindex("<")
+            output.append(part[:start] + minify_css(part[start:end]) + part[end:])
+        elif lower.startswith("<script"):
+            start, end = part.index(">") + 1, part.rindex("<")
+            output.append(part[:start] + minify_js(part[start:end]) + part[end:])
+        elif lower.startswith("<pre") or lower.startswith("<textarea"):
+            output.append(part)
+        else:
+            part = re.sub(r"<!--(?!\[if).*?-->", "", part, flags=re.S)
+            part = re.sub(r"\s+", " ", part)
+            output.append(re.sub(r">\s+<", "><", part) if part.strip() == "" else part)
+    return "".join(output).strip()
+
+
+def minify(name, content, directory):
+    extension = os.path.splitext(name)[1].lower()
+    if extension == ".html":
+        return minify_html(inline_assets(content, directory))
+    if extension == ".css":
+        return minify_css(content)
+    if extension == ".js":
+        return minify_js(content)
+    return content
+
+
+def compress(content):
+    # No file name nor timestamp in the header, the output is reproducible
+    return gzip.compress(content, compresslevel=9, mtime=0)
+
+
+def prepare_assets(data):
+    """Yield the name, original and minified content of each file to store.
+
+    Also used by tools/embed_assets.py, so the assets compiled into the
+    firmware are the same bytes, and get the same ETags, as the storage ones.
+    """
+    # Files only used inlined are not copied
+    inlined = set()
+    for directory, _, filenames in os.walk(data):
+        for filename in filenames:
+            if filename.endswith(".html"):
+                with open(os.path.join(directory, filename), encoding="utf-8") as f:
+                    html = f.read()
+                for reference in re.findall(r'(?:href|src)="([^":]+\.(?:css|js))"', html):
+                    inlined.add(os.path.normpath(os.path.join(directory, reference)))
+
+    for directory, dirnames, filenames in os.walk(data):
+        dirnames[:] = sorted(d for d in dirnames if not d.startswith("."))
+        for filename in sorted(filenames):
+            path = os.path.join(directory, filename)
+            if filename.startswith(".") or filename.endswith(".gz") or os.path.normpath(path) in inlined:
+                continue
+            name = os.path.relpath(path, data)
+
+            with open(path, "rb") as f:
+                original = f.read()
+            content = original
+            if filename.lower().endswith(TEXT_EXTENSIONS):
+                content = minify(name, original.decode("utf-8"), directory).encode("utf-8")
+            yield name, original, content
+
+
+def read_partition_size(partitions, name):
+    with open(partitions, newline="") as f:
+        for row in csv.reader(f):
+            row = [field.strip() for field in row]
+            if row and not row[0].startswith("#") and row[0] == name:
+                size = row[4].upper()
+                if size.endswith("K"):
+                    return int(size[:-1]) * 1024
+                if size.endswith("M"):
+                    return int(size[:-1]) * 1024 * 1024
+                return int(size, 0)
+    sys.exit("No {} partition in {}".format(name, partitions))
+
+
+def spiffs_footprint(size):
+    page_data = SPIFFS_PAGE_SIZE - SPIFFS_PAGE_HEADER_SIZE
+    # One object index page per file, plus the data pages
+    return (1 + max(1, -(-size // page_data))) * SPIFFS_PAGE_SIZE
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("data", nargs="?", default="data")
+    parser.add_argument("-o", "--output", default="build/web_assets")
+    parser.add_argument("--partitions", default="partitions_custom.csv")
+    parser.add_argument("--partition", default="storage")
+    parser.add_argument("--budget", type=int, default=DEFAULT_BUDGET, help="max gzipped bytes of the HTML pages")
+    args = parser.parse_args()
+
+    if os.path.isdir(args.output):
+        shutil.rmtree(args.output)
+    os.makedirs(args.output)
+
+    print("{:<32} {:>9} {:>9} {:>9}".format("file", "original", "minified", "gzipped"))
+    total_original = total_minified = total_gzipped = page_weight = footprint = 0
+
+    for name, original, content in prepare_assets(args.data):
+        filename = os.path.basename(name)
+        compressed = compress(content)
+
+        output = os.path.join(args.output, name)
+        os.makedirs(os.path.dirname(output), exist_ok=True)
+        with open(output, "wb") as f:
+            f.write(content)
+        with open(output + ".gz", "wb") as f:
+            f.write(compressed)
+
+        print("{:<32} {:>9} {:>9} {:>9}".format(name, len(original), len(content), len(compressed)))
+        total_original += len(original)
+        total_minified += len(content)
+        total_gzipped += len(compressed)
+        footprint += spiffs_footprint(len(content)) + spiffs_footprint(len(compressed))
+        if filename.endswith(".html"):
+            page_weight += len(compressed)
+
+    print("{:<32} {:>9} {:>9} {:>9}".format("total", total_original, total_minified, total_gzipped))
+
+    partition_size = read_partition_size(args.partitions, args.partition)
+    usable = partition_size - SPIFFS_RESERVED_BLOCKS * SPIFFS_BLOCK_SIZE
+    print("Page weight: {} / {} bytes gzipped, storage: ~{} / {} bytes".format(page_weight, args.budget, footprint, usable))
+
+    errors = []
+    if page_weight > args.budget:
+        errors.append("page weight {} bytes exceeds the budget of {} bytes".format(page_weight, args.budget))
+    if footprint > usable:
+        errors.append("files take ~{} bytes, more than the {} bytes of the {} partition".format(footprint, usable, args.partition))
+    if errors:
+        sys.exit("\n".join("error: " + error for error in errors))
+
+
+if __name__ == "__main__":
+    main()
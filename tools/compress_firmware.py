@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+"""Compress a firmware image for a faster OTA update over wifi.
+
+Produces firmware.bin.gz next to the input. Drag & drop it onto the upload
+icon of the dashboard like the raw firmware.bin: the car decompresses it on
+the fly and checks the gzip CRC32 before switching to the new image.
+"""
+
+import argparse
+import gzip
+import os
+import sys
+
+ESP_IMAGE_MAGIC = 0xE9
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("firmware", nargs="?", default=".pio/build/esp32doit-devkit-v1/firmware.bin")
+    parser.add_argument("-o", "--output", help="output file (default: <firmware>.gz)")
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+
+    if not image or image[0] != ESP_IMAGE_MAGIC:
+        sys.exit("{} is not an ESP32 application image".format(args.firmware))
+
+    output = args.output or args.firmware + ".gz"
+    # No file name nor timestamp in the header, the output is reproducible
+    with open(output, "wb") as raw:
+        with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=raw, mtime=0) as f:
+            f.write(image)
+
+    compressed = os.path.getsize(output)
+    print("{}: {} -> {} bytes ({:.0%})".format(output, len(image), compressed, compressed / len(image)))
+
+
+if __name__ == "__main__":
+    main()
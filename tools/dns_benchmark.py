@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Measure the queries per second answered by the captive DNS of the car.
+
+Connect to the car wifi first. Sends the queries phones make when joining
+the access point (A, AAAA and HTTPS for the connectivity check hosts), keeps
+--window queries in flight and reports the answered rate, the lost queries
+and the answer of each type. The answering code alone is measured on a host
+by test/dns_bench.c (make -C test bench).
+"""
+
+import argparse
+import random
+import socket
+import struct
+import time
+
+HOSTS = [
+    "captive.apple.com",
+    "connectivitycheck.gstatic.com",
+    "www.msftconnecttest.com",
+    "detectportal.firefox.com",
+    "clients3.google.com",
+]
+QUERY_TYPES = {"A": 1, "AAAA": 28, "HTTPS": 65}
+
+
+def build_query(query_id, host, query_type):
+    header = struct.pack(">HHHHHH", query_id, 0x0100, 1, 0, 0, 0)
+    name = b"".join(bytes([len(label)]) + label.encode() for label in host.split(".")) + b"\0"
+    return header + name + struct.pack(">HH", query_type, 1)
+
+
+def parse_answer(reply):
+    query_id, flags, _, an_count = struct.unpack(">HHHH", reply[:8])
+    address = None
+    if an_count and len(reply) >= 4:
+        address = socket.inet_ntoa(reply[-4:])
+    return query_id, flags & 0xF, an_count, address
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--port", type=int, default=53)
+    parser.add_argument("--count", type=int, default=2000)
+    parser.add_argument("--window", type=int, default=8, help="queries in flight")
+    parser.add_argument("--timeout", type=float, default=0.5, help="seconds before a query is counted as lost")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(args.timeout)
+    destination = (args.host, args.port)
+
+    pending = {}
+    sent = answered = lost = 0
+    answers = {}
+    start = time.monotonic()
+
+    while answered + lost < args.count:
+        while sent < args.count and len(pending) < args.window:
+            query_type = random.choice(list(QUERY_TYPES))
+            query_id = sent & 0xFFFF
+            sock.sendto(build_query(query_id, random.choice(HOSTS), QUERY_TYPES[query_type]), destination)
+            pending[query_id] = (query_type, time.monotonic())
+            sent += 1
+
+        try:
+            reply, _ = sock.recvfrom(1024)
+        except socket.timeout:
+            # Everything in flight is lost
+            lost += len(pending)
+            pending.clear()
+            continue
+
+        query_id, rcode, an_count, address = parse_answer(reply)
+        if query_id not in pending:
+            continue
+        query_type, _ = pending.pop(query_id)
+        answered += 1
+        key = "{} rcode {} answers {} {}".format(query_type, rcode, an_count, address or "")
+        answers[key] = answers.get(key, 0) + 1
+
+    elapsed = time.monotonic() - start
+    print("{} queries in {:.2f}s: {:.0f} answered/s, {} lost".format(args.count, elapsed, answered / elapsed, lost))
+    for key, count in sorted(answers.items()):
+        print("  {:<40} {}".format(key, count))
+
+
+if __name__ == "__main__":
+    main()
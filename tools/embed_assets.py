@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Generate the table of dashboard assets compiled into the firmware.
+
+The files are inlined and minified by tools/build_assets.py, as for the
+storage image, then gzipped and written as C arrays, with their length, ETag
+and content type computed at build time: the fallback serves the same bytes
+under the same ETags as the storage partition. Run by the build
+(src/CMakeLists.txt), the table is only used with WITH_EMBEDDED_ASSETS.
+"""
+
+import argparse
+import hashlib
+import os
+
+from build_assets import compress, prepare_assets
+
+# Same as set_content_type_from_file in src/webfile.c
+CONTENT_TYPES = {
+    ".pdf": "application/pdf",
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpeg": "image/jpeg",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+}
+
+
+def c_array(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x{:02x}".format(b) for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("data", nargs="?", default="data")
+    parser.add_argument("-o", "--output", default="embedded_assets_table.c")
+    args = parser.parse_args()
+
+    assets = list(prepare_assets(args.data))
+
+    arrays = []
+    entries = []
+    for index, (name, _, content) in enumerate(assets):
+        uri = "/" + name.replace(os.sep, "/")
+        compressed = compress(content)
+        etag = hashlib.sha256(compressed).hexdigest()
+        content_type = CONTENT_TYPES.get(os.path.splitext(uri)[1].lower(), "text/plain")
+
+        arrays.append("// {} ({} bytes)\nstatic const uint8_t asset_{}[] = {{\n{}\n}};\n".format(
+            uri, len(content), index, c_array(compressed)))
+        entries.append('  {{ "{}", asset_{}, {}, "\\"{}\\"", "{}" }},'.format(
+            uri, index, len(compressed), etag, content_type))
+
+    with open(args.output, "w") as f:
+        f.write("// Generated by tools/embed_assets.py from {}, do not edit\n\n".format(os.path.basename(os.path.abspath(args.data))))
+        f.write('#include "embedded_assets.h"\n\n')
+        f.write("\n".join(arrays))
+        f.write("\nconst embedded_asset_t embedded_assets[] = {\n")
+        f.write("\n".join(entries))
+        f.write("\n};\n\n")
+        f.write("const size_t embedded_assets_count = {};\n".format(len(assets)))
+        f.write("bool embedded_assets_overridden[{}];\n".format(max(len(assets), 1)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Measure how many requests per second the PowerJeep web server answers.
+
+Runs full GETs, then conditional GETs revalidating the ETag of the first
+response (304 when the file cache is enabled). Compare a build with
+WITH_FILE_CACHE set to 1 and to 0 in src/webfile.c to see the cache effect.
+
+With --parallel, also fires parallel downloads without any cache header,
+checks every body against the first download (or --reference) and reports
+the aggregate throughput and the 503 answers when no transfer buffer is left.
+"""
+
+import argparse
+import hashlib
+import http.client
+import sys
+import threading
+import time
+
+
+def run(host, port, path, count, headers):
+    connection = http.client.HTTPConnection(host, port, timeout=10)
+    statuses = {}
+    received = 0
+    start = time.monotonic()
+    for _ in range(count):
+        connection.request("GET", path, headers=headers)
+        response = connection.getresponse()
+        received += len(response.read())
+        statuses[response.status] = statuses.get(response.status, 0) + 1
+    elapsed = time.monotonic() - start
+    connection.close()
+    return elapsed, received, statuses
+
+
+def report(name, count, result):
+    elapsed, received, statuses = result
+    print("{:<12} {:>4} requests in {:6.2f}s: {:7.1f} req/s, {:8.1f} KB/s, statuses {}".format(
+        name, count, elapsed, count / elapsed, received / elapsed / 1024, statuses))
+
+
+def download_worker(host, port, path, count, expected, results, lock):
+    connection = http.client.HTTPConnection(host, port, timeout=30)
+    for _ in range(count):
+        try:
+            connection.request("GET", path)
+            response = connection.getresponse()
+            body = response.read()
+        except (OSError, http.client.HTTPException):
+            connection.close()
+            connection = http.client.HTTPConnection(host, port, timeout=30)
+            with lock:
+                results["errors"] += 1
+            continue
+        with lock:
+            if response.status == 503:
+                results["busy"] += 1
+            elif response.status != 200:
+                results["errors"] += 1
+            elif hashlib.sha256(body).digest() != expected:
+                results["corrupted"] += 1
+            else:
+                results["ok"] += 1
+                results["bytes"] += len(body)
+    connection.close()
+
+
+def run_parallel(host, port, path, parallel, count, expected):
+    results = {"ok": 0, "busy": 0, "corrupted": 0, "errors": 0, "bytes": 0}
+    lock = threading.Lock()
+    threads = [threading.Thread(target=download_worker, args=(host, port, path, count, expected, results, lock))
+               for _ in range(parallel)]
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+    print("parallel     {} x {} downloads in {:6.2f}s: {:8.1f} KB/s, ok {}, busy (503) {}, corrupted {}, errors {}".format(
+        parallel, count, elapsed, results["bytes"] / elapsed / 1024,
+        results["ok"], results["busy"], results["corrupted"], results["errors"]))
+    return results["corrupted"] == 0 and results["errors"] == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/index.html")
+    parser.add_argument("--count", type=int, default=50)
+    parser.add_argument("--parallel", type=int, default=0, help="number of parallel downloaders")
+    parser.add_argument("--reference", help="local copy of the file to check the downloads against")
+    args = parser.parse_args()
+
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    connection.request("GET", args.path)
+    response = connection.getresponse()
+    body = response.read()
+    etag = response.getheader("ETag")
+    connection.close()
+    print("{} -> {} (ETag: {}, Cache-Control: {})".format(
+        args.path, response.status, etag, response.getheader("Cache-Control")))
+
+    report("full", args.count, run(args.host, args.port, args.path, args.count, {}))
+    if etag:
+        report("revalidate", args.count,
+               run(args.host, args.port, args.path, args.count, {"If-None-Match": etag}))
+    else:
+        print("No ETag, file cache disabled or file too large to be cached")
+
+    if args.parallel > 0:
+        if args.reference:
+            with open(args.reference, "rb") as f:
+                body = f.read()
+        if not run_parallel(args.host, args.port, args.path, args.parallel, args.count, hashlib.sha256(body).digest()):
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Pack the web UI into a single archive for POST /upload-bundle.
+
+Produces bundle.tar.gz from the data folder. Drag & drop it onto the upload
+icon of the dashboard, or send it with
+  curl --data-binary @bundle.tar.gz http://192.168.4.1/upload-bundle
+The car unpacks it on the fly and replaces the files only once the whole
+archive was received.
+"""
+
+import argparse
+import gzip
+import io
+import os
+import sys
+import tarfile
+
+# Must match src/webfile.c
+BUNDLE_MAX_FILES = 32
+MAX_FILE_SIZE = 200 * 1024
+# SPIFFS object name length, including the leading "/" and the ".tmp" suffix used while unpacking
+NAME_MAX = 32 - 1 - len("/") - len(".tmp")
+
+
+def collect_files(root):
+    files = []
+    for directory, dirnames, filenames in os.walk(root):
+        dirnames[:] = sorted(d for d in dirnames if not d.startswith("."))
+        for filename in sorted(filenames):
+            if filename.startswith("."):
+                continue
+            path = os.path.join(directory, filename)
+            files.append((os.path.relpath(path, root).replace(os.sep, "/"), path))
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("data", nargs="?", default="data")
+    parser.add_argument("-o", "--output", default="bundle.tar.gz")
+    parser.add_argument("--no-gzip", action="store_true", help="write a plain tar archive")
+    args = parser.parse_args()
+
+    files = collect_files(args.data)
+    if len(files) > BUNDLE_MAX_FILES:
+        sys.exit("{} files, the car accepts at most {}".format(len(files), BUNDLE_MAX_FILES))
+
+    archive = io.BytesIO()
+    # ustar only, without ownership nor timestamps so that the output is reproducible
+    with tarfile.open(fileobj=archive, mode="w", format=tarfile.USTAR_FORMAT) as tar:
+        for name, path in files:
+            size = os.path.getsize(path)
+            if len(name) > NAME_MAX:
+                sys.exit("{}: name longer than {} characters".format(name, NAME_MAX))
+            if size > MAX_FILE_SIZE:
+                sys.exit("{}: {} bytes, the car accepts at most {}".format(name, size, MAX_FILE_SIZE))
+            info = tarfile.TarInfo(name)
+            info.size = size
+            info.mode = 0o644
+            with open(path, "rb") as f:
+                tar.addfile(info, f)
+
+    with open(args.output, "wb") as raw:
+        if args.no_gzip:
+            raw.write(archive.getvalue())
+        else:
+            with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=raw, mtime=0) as f:
+                f.write(archive.getvalue())
+
+    print("{}: {} files, {} bytes".format(args.output, len(files), os.path.getsize(args.output)))
+
+
+if __name__ == "__main__":
+    main()
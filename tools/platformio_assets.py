@@ -0,0 +1,28 @@
+"""PlatformIO hook packing the minified web assets into the filesystem image.
+
+"Build/Upload Filesystem" run tools/build_assets.py first and pack its output
+instead of the data folder, failing when the page weight budget or the
+storage partition size is exceeded.
+"""
+
+import os
+
+Import("env")  # noqa: F821
+
+FILESYSTEM_TARGETS = ("buildfs", "uploadfs", "uploadfsota")
+
+if any(target in FILESYSTEM_TARGETS for target in COMMAND_LINE_TARGETS):  # noqa: F821
+    project_dir = env.subst("$PROJECT_DIR")
+    output = os.path.join(env.subst("$BUILD_DIR"), "web_assets")
+
+    ret = env.Execute(" ".join([
+        '"$PYTHONEXE"',
+        '"{}"'.format(os.path.join(project_dir, "tools", "build_assets.py")),
+        '"{}"'.format(env.subst("$PROJECT_DATA_DIR")),
+        '-o "{}"'.format(output),
+        '--partitions "{}"'.format(os.path.join(project_dir, "partitions_custom.csv")),
+    ]))
+    if ret:
+        env.Exit(ret)
+
+    env.Replace(PROJECT_DATA_DIR=output)
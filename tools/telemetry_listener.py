@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Listen to the PowerJeep UDP telemetry stream.
+
+Decodes the datagrams described by telemetry_datagram_t in src/telemetry.h,
+keeps track of lost, duplicated and reordered datagrams from the sequence
+numbers, and optionally plots the speed live (requires matplotlib).
+
+Enable the stream from the dashboard websocket first, for instance:
+  { "command": "udp_telemetry", "parameters": { "enabled": true, "rate_hz": 20 } }
+"""
+
+import argparse
+import collections
+import socket
+import struct
+import time
+
+TELEMETRY_MAGIC = 0x4A50
+TELEMETRY_VERSION = 2
+TELEMETRY_FLAG_EMERGENCY_STOP = 1 << 0
+DATAGRAM_V1 = struct.Struct("<HBBIQfff")
+# Version 2 appends the radio profile, TX power, worst RTT and battery current
+DATAGRAM_V2_EXTRA = struct.Struct("<BbHi")
+RADIO_PROFILES = ("driving", "parked")
+
+
+class LossCounter:
+    """Receiver side accounting based on the sequence numbers."""
+
+    def __init__(self):
+        self.received = 0
+        self.lost = 0
+        self.duplicated = 0
+        self.reordered = 0
+        self.highest = None
+
+    def update(self, sequence):
+        self.received += 1
+        if self.highest is None:
+            self.highest = sequence
+            return
+        delta = (sequence - self.highest) & 0xFFFFFFFF
+        if delta == 0:
+            self.duplicated += 1
+        elif delta < 0x80000000:
+            # Everything between the highest and this one is missing so far
+            self.lost += delta - 1
+            self.highest = sequence
+        else:
+            # Late datagram, it was counted as lost when the gap was seen
+            self.reordered += 1
+            self.lost = max(0, self.lost - 1)
+
+    def loss_ratio(self):
+        expected = self.received + self.lost
+        return self.lost / expected if expected else 0.0
+
+    def __str__(self):
+        return "received={} lost={} ({:.1%}) duplicated={} reordered={}".format(
+            self.received, self.lost, self.loss_ratio(), self.duplicated, self.reordered)
+
+
+def decode(data):
+    if len(data) < DATAGRAM_V1.size:
+        return None
+    magic, version, flags, sequence, timestamp_us, speed, max_forward, max_backward = \
+        DATAGRAM_V1.unpack_from(data)
+    if magic != TELEMETRY_MAGIC or version not in (1, TELEMETRY_VERSION):
+        return None
+    sample = {
+        "sequence": sequence,
+        "timestamp_us": timestamp_us,
+        "emergency_stop": bool(flags & TELEMETRY_FLAG_EMERGENCY_STOP),
+        "current_speed": speed,
+        "max_forward": max_forward,
+        "max_backward": max_backward,
+        "radio_profile": None,
+        "tx_power_dbm": None,
+        "rtt_ms": None,
+        "supply_current_ma": None,
+    }
+    if version >= 2:
+        if len(data) < DATAGRAM_V1.size + DATAGRAM_V2_EXTRA.size:
+            return None
+        radio_profile, tx_power, rtt_ms, current_ma = DATAGRAM_V2_EXTRA.unpack_from(data, DATAGRAM_V1.size)
+        sample["radio_profile"] = RADIO_PROFILES[radio_profile] if radio_profile < len(RADIO_PROFILES) else radio_profile
+        sample["tx_power_dbm"] = tx_power / 4
+        sample["rtt_ms"] = rtt_ms
+        sample["supply_current_ma"] = current_ma if current_ma >= 0 else None
+    return sample
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=4210, help="UDP port (default: 4210)")
+    parser.add_argument("--plot", action="store_true", help="plot the speed live with matplotlib")
+    parser.add_argument("--window", type=float, default=30.0, help="seconds of history to plot")
+    parser.add_argument("--quiet", action="store_true", help="only print the periodic statistics")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", args.port))
+    sock.settimeout(0.1)
+
+    counter = LossCounter()
+    history = collections.deque()
+    first_timestamp = None
+    last_report = time.monotonic()
+
+    if args.plot:
+        import matplotlib.pyplot as plt
+        plt.ion()
+        figure, axis = plt.subplots()
+        line, = axis.plot([], [])
+        axis.set_xlabel("device time (s)")
+        axis.set_ylabel("speed (%)")
+        axis.set_ylim(-100, 100)
+
+    try:
+        while True:
+            try:
+                data, _ = sock.recvfrom(512)
+            except socket.timeout:
+                data = None
+
+            sample = decode(data) if data else None
+            if sample:
+                counter.update(sample["sequence"])
+                if first_timestamp is None:
+                    first_timestamp = sample["timestamp_us"]
+                seconds = (sample["timestamp_us"] - first_timestamp) / 1e6
+                history.append((seconds, sample["current_speed"]))
+                while history and history[0][0] < seconds - args.window:
+                    history.popleft()
+                if not args.quiet:
+                    print("#{sequence} t={timestamp_us}us speed={current_speed:.1f} "
+                          "max={max_forward:.0f}/{max_backward:.0f} stop={emergency_stop} "
+                          "radio={radio_profile}@{tx_power_dbm}dBm rtt={rtt_ms}ms "
+                          "current={supply_current_ma}mA".format(**sample))
+
+            now = time.monotonic()
+            if now - last_report >= 1.0:
+                last_report = now
+                print(counter)
+                if args.plot and history:
+                    xs, ys = zip(*history)
+                    line.set_data(xs, ys)
+                    axis.set_xlim(max(0, xs[-1] - args.window), max(args.window, xs[-1]))
+                    plt.pause(0.001)
+    except KeyboardInterrupt:
+        print(counter)
+
+
+if __name__ == "__main__":
+    main()